@@ -0,0 +1,73 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *  \brief Application Configuration Header File
+ *
+ *  This is a header file which is be used to configure some of
+ *  the application's compile time options, as an alternative to
+ *  specifying the compile time constants supplied through a
+ *  makefile or build system.
+ *
+ *  For information on what each token does, refer to the
+ *  \ref Sec_Options section of the application documentation.
+ */
+
+#ifndef _APP_CONFIG_H_
+#define _APP_CONFIG_H_
+
+	#define CDC_TXRX_EPSIZE          32
+//	#define CDC_TXRX_BANKS           1
+
+//	#define USBTOUSART_BUFFER_SIZE   64
+//	#define USARTTOUSB_BUFFER_SIZE   64
+
+	#define DEFAULT_LATENCY_TIMER_MS 1
+
+	#define ACTIVITY_LED_PULSE_MS    10
+
+	#define MIDI_EVENT_FIFO_SIZE     16
+//	#define NO_MIDI_TX_RUNNING_STATUS
+//	#define ENABLE_MIDI_LATENCY_STATS
+//	#define ENABLE_MIDI_CLOCK_STATS
+
+//	#define ENABLE_PROFILING
+
+//	#define ENABLE_COMPOSITE_MODE
+//	#define COMPOSITE_VENDOR_ID      0x04D8
+//	#define COMPOSITE_PRODUCT_ID     0x0000
+
+//	#define ENABLE_HARDWARE_FLOW_CONTROL
+
+//	#define ENABLE_MIDI_SOFT_THRU
+
+//	#define ENABLE_MIDI_CLOCK_PLL
+
+#endif
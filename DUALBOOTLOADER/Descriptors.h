@@ -41,6 +41,8 @@
 
 		#include <LUFA/Drivers/USB/USB.h>
 
+		#include "Config/AppConfig.h"
+
 	/* Macros: */
 		/** Endpoint address of the CDC device-to-host notification IN endpoint. */
 		#define CDC_NOTIFICATION_EPADDR        (ENDPOINT_DIR_IN  | 2)
@@ -51,21 +53,101 @@
 		/** Endpoint address of the CDC host-to-device data OUT endpoint. */
 		#define CDC_RX_EPADDR                  (ENDPOINT_DIR_OUT | 4)
 
-		/** Size in bytes of the CDC device-to-host notification IN endpoint. */
-		#define CDC_NOTIFICATION_EPSIZE        8
+		/** Size in bytes of the CDC device-to-host notification IN endpoint, large enough for a whole
+		 *  SerialState notification in a single packet.
+		 */
+		#define CDC_NOTIFICATION_EPSIZE        16
+
+		/** Polling interval in milliseconds of the CDC notification endpoint, which is also the shortest time
+		 *  between two SerialState notifications.
+		 */
+		#define CDC_NOTIFICATION_INTERVAL_MS   16
+
+		/** Total size in bytes of the USB controller's endpoint memory (DPRAM), shared between all endpoints. */
+		#if (defined(__AVR_ATmega16U4__) || defined(__AVR_ATmega32U4__))
+			#define ENDPOINT_MEMORY_SIZE       832
+		#else
+			#define ENDPOINT_MEMORY_SIZE       176
+		#endif
 
-		/** Size in bytes of the CDC data IN and OUT endpoints. */
-		#define CDC_TXRX_EPSIZE                16
-		
 		/** Endpoint address of the MIDI streaming data IN endpoint, for device-to-host data transfers. */
 		#define MIDI_STREAM_IN_EPADDR       (ENDPOINT_DIR_IN  | 1)
 
-		/** Endpoint address of the MIDI streaming data OUT endpoint, for host-to-device data transfers. */
-		#define MIDI_STREAM_OUT_EPADDR      (ENDPOINT_DIR_OUT | 2)
+		/** Endpoint address of the MIDI streaming data OUT endpoint, for host-to-device data transfers. The
+		 *  composite configuration needs every endpoint number, so there it moves out of the way of the CDC
+		 *  notification endpoint.
+		 */
+		#if defined(ENABLE_COMPOSITE_MODE)
+			#define MIDI_STREAM_OUT_EPADDR  (ENDPOINT_DIR_OUT | 5)
+		#else
+			#define MIDI_STREAM_OUT_EPADDR  (ENDPOINT_DIR_OUT | 2)
+		#endif
+
+		/** Vendor ID of the composite configuration. Unless set in the application configuration header, this is
+		 *  the vendor ID of the MIDI configuration, which the composite one replaces. Its product ID,
+		 *  COMPOSITE_PRODUCT_ID, has no default and must be set along with it.
+		 */
+		#if !defined(COMPOSITE_VENDOR_ID)
+			#define COMPOSITE_VENDOR_ID     0x04D8
+		#endif
 
 		/** Endpoint size in bytes of the Audio isochronous streaming data IN and OUT endpoints. */
 		#define MIDI_STREAM_EPSIZE          64
 
+		/** Endpoint memory taken by the MIDI endpoints alongside the CDC endpoints, in the composite configuration. */
+		#if defined(ENABLE_COMPOSITE_MODE)
+			#define COMPOSITE_MIDI_EPMEMORY (2 * MIDI_STREAM_EPSIZE)
+		#else
+			#define COMPOSITE_MIDI_EPMEMORY 0
+		#endif
+
+		/** Number of hardware banks used by each of the CDC data IN and OUT endpoints. Unless set in the
+		 *  application configuration header, the endpoints are double banked whenever both of them fit into
+		 *  the endpoint memory alongside the control and notification endpoints, so that the host can fill or
+		 *  drain one bank while the firmware is still processing the other.
+		 */
+		#if !defined(CDC_TXRX_BANKS)
+			#if ((FIXED_CONTROL_ENDPOINT_SIZE + CDC_NOTIFICATION_EPSIZE + (4 * CDC_TXRX_EPSIZE) + COMPOSITE_MIDI_EPMEMORY) <= ENDPOINT_MEMORY_SIZE)
+				#define CDC_TXRX_BANKS         2
+			#else
+				#define CDC_TXRX_BANKS         1
+			#endif
+		#endif
+
+	/* Preprocessor Checks: */
+		#if ((CDC_TXRX_EPSIZE != 8) && (CDC_TXRX_EPSIZE != 16) && (CDC_TXRX_EPSIZE != 32) && (CDC_TXRX_EPSIZE != 64))
+			#error CDC_TXRX_EPSIZE must be one of 8, 16, 32 or 64 bytes.
+		#endif
+
+		#if ((CDC_TXRX_BANKS != 1) && (CDC_TXRX_BANKS != 2))
+			#error CDC_TXRX_BANKS must be either 1 or 2.
+		#endif
+
+		#if ((FIXED_CONTROL_ENDPOINT_SIZE + CDC_NOTIFICATION_EPSIZE + (2 * CDC_TXRX_BANKS * CDC_TXRX_EPSIZE)) > ENDPOINT_MEMORY_SIZE)
+			#error The CDC endpoints do not fit into the endpoint memory of the selected device.
+		#endif
+
+		#if ((FIXED_CONTROL_ENDPOINT_SIZE + (2 * MIDI_STREAM_EPSIZE)) > ENDPOINT_MEMORY_SIZE)
+			#error The MIDI endpoints do not fit into the endpoint memory of the selected device.
+		#endif
+
+		#if defined(ENABLE_COMPOSITE_MODE)
+			#if !(defined(__AVR_ATmega16U4__) || defined(__AVR_ATmega32U4__))
+				#error Composite mode needs five endpoints besides the control endpoint, so is only supported on the ATMEGA16U4 and ATMEGA32U4.
+			#endif
+
+			#if ((FIXED_CONTROL_ENDPOINT_SIZE + CDC_NOTIFICATION_EPSIZE + (2 * CDC_TXRX_BANKS * CDC_TXRX_EPSIZE) + COMPOSITE_MIDI_EPMEMORY) > ENDPOINT_MEMORY_SIZE)
+				#error The composite CDC and MIDI endpoints do not fit into the endpoint memory of the selected device.
+			#endif
+
+			/* A host which has seen the MIDI configuration would keep its cached descriptors and driver for the same IDs */
+			#if !defined(COMPOSITE_PRODUCT_ID)
+				#error Composite mode needs its own USB product ID, set COMPOSITE_PRODUCT_ID in AppConfig.h.
+			#elif ((COMPOSITE_VENDOR_ID == 0x04D8) && (COMPOSITE_PRODUCT_ID == 0xED67))
+				#error COMPOSITE_PRODUCT_ID must differ from the product ID of the MIDI configuration.
+			#endif
+		#endif
+
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
 		 *  application code, as the configuration descriptor contains several sub-descriptors which
@@ -109,6 +191,48 @@
 			USB_MIDI_Descriptor_Jack_Endpoint_t       MIDI_Out_Jack_Endpoint_SPC;
 		} USB_MIDI_Descriptor_Configuration_t;
 
+		typedef struct
+		{
+			USB_Descriptor_Configuration_Header_t     Config;
+
+			// CDC Command Interface
+			USB_Descriptor_Interface_Association_t    CDC_IAD;
+			USB_Descriptor_Interface_t                CDC_CCI_Interface;
+			USB_CDC_Descriptor_FunctionalHeader_t     CDC_Functional_Header;
+			USB_CDC_Descriptor_FunctionalACM_t        CDC_Functional_ACM;
+			USB_CDC_Descriptor_FunctionalUnion_t      CDC_Functional_Union;
+			USB_Descriptor_Endpoint_t                 CDC_NotificationEndpoint;
+
+			// CDC Data Interface
+			USB_Descriptor_Interface_t                CDC_DCI_Interface;
+			USB_Descriptor_Endpoint_t                 CDC_DataOutEndpoint;
+			USB_Descriptor_Endpoint_t                 CDC_DataInEndpoint;
+
+			// MIDI Audio Control Interface
+			USB_Descriptor_Interface_t                Audio_ControlInterface;
+			USB_Audio_Descriptor_Interface_AC_t       Audio_ControlInterface_SPC;
+
+			// MIDI Audio Streaming Interface
+			USB_Descriptor_Interface_t                Audio_StreamInterface;
+			USB_MIDI_Descriptor_AudioInterface_AS_t   Audio_StreamInterface_SPC;
+			USB_MIDI_Descriptor_InputJack_t           MIDI_In_Jack_Emb;
+			USB_MIDI_Descriptor_InputJack_t           MIDI_In_Jack_Ext;
+			USB_MIDI_Descriptor_OutputJack_t          MIDI_Out_Jack_Emb;
+			USB_MIDI_Descriptor_OutputJack_t          MIDI_Out_Jack_Ext;
+			USB_Audio_Descriptor_StreamEndpoint_Std_t MIDI_In_Jack_Endpoint;
+			USB_MIDI_Descriptor_Jack_Endpoint_t       MIDI_In_Jack_Endpoint_SPC;
+			USB_Audio_Descriptor_StreamEndpoint_Std_t MIDI_Out_Jack_Endpoint;
+			USB_MIDI_Descriptor_Jack_Endpoint_t       MIDI_Out_Jack_Endpoint_SPC;
+		} USB_Composite_Descriptor_Configuration_t;
+
+		/** Enum for the device personalities, selected by the global \c mode variable. */
+		enum DeviceModes_t
+		{
+			MODE_Serial    = 0, /**< CDC-ACM virtual serial port */
+			MODE_MIDI      = 1, /**< USB-MIDI device */
+			MODE_Composite = 2, /**< CDC-ACM and USB-MIDI at once, sharing the USART, when built with ENABLE_COMPOSITE_MODE */
+		};
+
 		/** Enum for the device interface descriptor IDs within the device. Each interface descriptor
 		 *  should have a unique ID index associated with it, which can be used to refer to the
 		 *  interface from other descriptors.
@@ -119,6 +243,8 @@
 			INTERFACE_ID_CDC_DCI = 1, /**< CDC DCI interface descriptor ID */
 			INTERFACE_ID_AudioControl = 0, /**< Audio control interface descriptor ID */
 			INTERFACE_ID_AudioStream  = 1, /**< Audio stream interface descriptor ID */
+			INTERFACE_ID_Composite_AudioControl = 2, /**< Audio control interface descriptor ID, composite configuration */
+			INTERFACE_ID_Composite_AudioStream  = 3, /**< Audio stream interface descriptor ID, composite configuration */
 		};
 
 		/** Enum for the device string descriptor IDs within the device. Each string descriptor should
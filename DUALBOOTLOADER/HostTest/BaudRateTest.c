@@ -0,0 +1,211 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Unit tests of the USART baud rate selection in Lib/BaudRate.h, checking the settings chosen for the standard
+ *  baud rates against the datasheet, and the optimality of the choice for every baud rate up to 2Mbps against
+ *  the divisors either side of it.
+ */
+
+#include "HostTest.h"
+
+#include <stdlib.h>
+
+#include "../Lib/BaudRate.h"
+
+/** Calculates the baud rate given by a baud rate register value in one USART speed mode. */
+static uint32_t ActualRate(const uint32_t ClockHz,
+                           const uint8_t Divider,
+                           const uint32_t UBRR)
+{
+	return (ClockHz / (Divider * (UBRR + 1)));
+}
+
+/** Calculates the exact difference between the baud rate given by a register value and a requested baud rate,
+ *  without the rounding down of the integer rate.
+ */
+static double ExactDifference(const uint32_t ClockHz,
+                              const uint8_t Divider,
+                              const uint32_t UBRR,
+                              const uint32_t BaudBPS)
+{
+	double Difference = (((double)ClockHz / (Divider * (UBRR + 1))) - BaudBPS);
+
+	return ((Difference < 0) ? -Difference : Difference);
+}
+
+/** Finds the smallest difference from a requested baud rate any register value gives, in either speed mode. The
+ *  best register values are the two either side of the exact divisor, the rest are only further away.
+ */
+static double BestDifference(const uint32_t ClockHz,
+                             const uint32_t BaudBPS)
+{
+	double Best = ClockHz;
+
+	for (uint8_t Divider = 8; Divider <= 16; Divider += 8)
+	{
+		uint32_t Exact = (ClockHz / ((uint32_t)Divider * BaudBPS));
+
+		for (uint32_t UBRR = (Exact ? (Exact - 1) : 0); UBRR <= (Exact + 1); UBRR++)
+		{
+			if (UBRR > BAUD_RATE_MAX_UBRR)
+			  break;
+
+			double Difference = ExactDifference(ClockHz, Divider, UBRR, BaudBPS);
+
+			if (Difference < Best)
+			  Best = Difference;
+		}
+	}
+
+	return Best;
+}
+
+/** Checks one chosen setting against the speed mode, register value and error expected for it. */
+#define EXPECT_SETTING(BaudBPS, ExpectedDoubleSpeed, ExpectedUBRR, ExpectedError)              \
+	do                                                                                       \
+	{                                                                                        \
+		BaudRate_Setting_t Setting;                                                          \
+		BaudRate_Select(16000000, (BaudBPS), &Setting);                                      \
+		TEST_ASSERT_EQUAL((BaudBPS),             Setting.RequestedBPS);                      \
+		TEST_ASSERT_EQUAL((ExpectedDoubleSpeed), Setting.DoubleSpeed);                       \
+		TEST_ASSERT_EQUAL((ExpectedUBRR),        Setting.UBRR);                              \
+		TEST_ASSERT_EQUAL((ExpectedError),       Setting.Error);                             \
+	} while (0)
+
+static void Test_StandardRates(void)
+{
+	/* Settings as in the 16MHz table of the ATmega8U2 datasheet, taking the more accurate mode; the errors are
+	 * rounded towards zero */
+	EXPECT_SETTING(2400,    true,  832, 0);
+	EXPECT_SETTING(4800,    true,  416, -8);
+	EXPECT_SETTING(9600,    false, 103, 15);
+	EXPECT_SETTING(14400,   true,  138, -8);
+	EXPECT_SETTING(19200,   false, 51,  15);
+	EXPECT_SETTING(28800,   true,  68,  64);
+	EXPECT_SETTING(38400,   false, 25,  15);
+	EXPECT_SETTING(57600,   true,  34,  -79);
+	EXPECT_SETTING(76800,   false, 12,  16);
+	EXPECT_SETTING(115200,  true,  16,  212);
+	EXPECT_SETTING(230400,  true,  8,   -354);
+	EXPECT_SETTING(250000,  false, 3,   0);
+	EXPECT_SETTING(500000,  false, 1,   0);
+	EXPECT_SETTING(1000000, false, 0,   0);
+}
+
+static void Test_MIDIRate(void)
+{
+	EXPECT_SETTING(31250, false, 31, 0);
+}
+
+static void Test_DoubleSpeedOnlyRates(void)
+{
+	/* Only double speed mode reaches 2Mbps, and 1Mbps ties, where normal speed is preferred */
+	EXPECT_SETTING(2000000, true,  0, 0);
+	EXPECT_SETTING(1000000, false, 0, 0);
+}
+
+static void Test_OutOfRange(void)
+{
+	BaudRate_Setting_t Setting;
+
+	/* A zero rate falls back to the slowest rate the USART can make */
+	BaudRate_Select(16000000, 0, &Setting);
+	TEST_ASSERT_EQUAL(0,                   Setting.RequestedBPS);
+	TEST_ASSERT_EQUAL(false,               Setting.DoubleSpeed);
+	TEST_ASSERT_EQUAL(BAUD_RATE_MAX_UBRR,  Setting.UBRR);
+	TEST_ASSERT_EQUAL(244,                 Setting.ActualBPS);
+
+	/* Far too slow, the register saturates and so does the error, being over 100% */
+	BaudRate_Select(16000000, 50, &Setting);
+	TEST_ASSERT_EQUAL(BAUD_RATE_MAX_UBRR,  Setting.UBRR);
+	TEST_ASSERT_EQUAL(BAUD_RATE_MAX_ERROR, Setting.Error);
+
+	/* Far too fast, the error is still exact even though scaling the difference directly would overflow */
+	BaudRate_Select(16000000, 8000000, &Setting);
+	TEST_ASSERT_EQUAL(true,    Setting.DoubleSpeed);
+	TEST_ASSERT_EQUAL(0,       Setting.UBRR);
+	TEST_ASSERT_EQUAL(2000000, Setting.ActualBPS);
+	TEST_ASSERT_EQUAL(-7500,   Setting.Error);
+}
+
+/** Checks every baud rate from 300bps to 2Mbps at one clock frequency, returning whether all of them passed. As
+ *  the modes are compared on their rates rounded down to whole bits per second, the chosen setting may be up to
+ *  2bps further off than the best.
+ */
+static bool CheckEveryRate(const uint32_t ClockHz)
+{
+	for (uint32_t BaudBPS = 300; BaudBPS <= 2000000; BaudBPS++)
+	{
+		BaudRate_Setting_t Setting;
+
+		BaudRate_Select(ClockHz, BaudBPS, &Setting);
+
+		uint8_t  Divider    = (Setting.DoubleSpeed ? 8 : 16);
+		double   Difference = ExactDifference(ClockHz, Divider, Setting.UBRR, BaudBPS);
+		int32_t  Error      = (int32_t)((((int64_t)Setting.ActualBPS - BaudBPS) * 10000) / BaudBPS);
+
+		if (Error > BAUD_RATE_MAX_ERROR)
+		  Error = BAUD_RATE_MAX_ERROR;
+		else if (Error < -BAUD_RATE_MAX_ERROR)
+		  Error = -BAUD_RATE_MAX_ERROR;
+
+		if ((Setting.ActualBPS != ActualRate(ClockHz, Divider, Setting.UBRR)) ||
+		    (Difference >= (BestDifference(ClockHz, BaudBPS) + 2)) || (Setting.Error != Error))
+		{
+			printf("%lu bps at %lu Hz: %s UBRR %u gives %lu bps, error %d\n", (unsigned long)BaudBPS,
+			       (unsigned long)ClockHz, (Setting.DoubleSpeed ? "U2X" : "1X"), Setting.UBRR,
+			       (unsigned long)Setting.ActualBPS, Setting.Error);
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void Test_EveryRate(void)
+{
+	TEST_ASSERT(CheckEveryRate(16000000));
+	TEST_ASSERT(CheckEveryRate(8000000));
+}
+
+int main(void)
+{
+	RUN_TEST(Test_StandardRates);
+	RUN_TEST(Test_MIDIRate);
+	RUN_TEST(Test_DoubleSpeedOnlyRates);
+	RUN_TEST(Test_OutOfRange);
+	RUN_TEST(Test_EveryRate);
+
+	return HostTest_Finish("BaudRateTest");
+}
@@ -0,0 +1,226 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+/** \file
+ *
+ *  Harness for running the firmware natively against the shims in Shims/. The firmware source is included here,
+ *  so that its tasks, ISRs and state can be reached directly by the tests and scenarios built on this header,
+ *  which play the host through the modelled endpoints and the target by calling the USART ISRs.
+ */
+
+#ifndef _FIRMWARE_HARNESS_H_
+#define _FIRMWARE_HARNESS_H_
+
+	/* Includes: */
+		#define main USBtoSerial_Main
+		#include "../USBtoSerial.c"
+		#undef main
+
+		#include <HostShims.h>
+
+	/* Inline Functions: */
+		/** Returns the firmware to its power on state in the given device mode, configured by the host.
+		 *
+		 *  \param[in] Mode  Device mode to start in, one of the \ref DeviceModes_t values
+		 */
+		static inline void Harness_Reset(const uint8_t Mode)
+		{
+			HostShim_Reset();
+
+			memset(&DeviceStats, 0, sizeof(DeviceStats));
+			memset(&MIDIPackingStats, 0, sizeof(MIDIPackingStats));
+			memset(&VirtualSerial_CDC_Interface.State, 0, sizeof(VirtualSerial_CDC_Interface.State));
+
+			/* No mode jumper fitted, so that the stored mode applies */
+			PINB           = MODE_JUMPER_MASK;
+			StoredMode     = Mode;
+			RequestedMode  = Mode;
+			LatencyTimerMS = DEFAULT_LATENCY_TIMER_MS;
+			TxLEDPulseMS   = 0;
+			RxLEDPulseMS   = 0;
+
+			/* Lets a line error be reported straight away */
+			SerialStateTimerRemaining = 0;
+
+			#if !defined(NO_MIDI_TX_RUNNING_STATUS)
+			MIDI_TX_RunningStatus          = true;
+			MIDI_TX_RunningStatusRequested = true;
+			#endif
+
+			#if defined(ENABLE_MIDI_SOFT_THRU)
+			MIDI_SoftThru = false;
+			#endif
+
+			#if defined(ENABLE_MIDI_LATENCY_STATS)
+			memset(&MIDILatencyStats, 0, sizeof(MIDILatencyStats));
+			MIDI_OUTBankTimed = false;
+			MIDI_TxStampHead  = 0;
+			MIDI_TxStampTail  = 0;
+			#endif
+
+			#if defined(ENABLE_MIDI_CLOCK_STATS)
+			memset(&MIDIClockStats, 0, sizeof(MIDIClockStats));
+			MIDIClockStats.MinInterval = UINT16_MAX;
+			#endif
+
+			#if defined(ENABLE_MIDI_CLOCK_PLL)
+			MIDIClock_Mode = MIDI_CLOCK_MODE_Off;
+			#endif
+
+			Mode_Setup();
+			EVENT_USB_Device_ConfigurationChanged();
+		}
+
+		/** Sets the line encoding of the virtual serial port, as the host does when it opens the port.
+		 *
+		 *  \param[in] BaudRate  Baud rate to open the port at, in bits per second
+		 */
+		static inline void Harness_OpenSerialPort(const uint32_t BaudRate)
+		{
+			VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS = BaudRate;
+			VirtualSerial_CDC_Interface.State.LineEncoding.DataBits    = 8;
+
+			EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+		}
+
+		/** Sets the control lines of the virtual serial port, as the host does with a SET_CONTROL_LINE_STATE request.
+		 *
+		 *  \param[in] Lines  Mask of the \c CDC_CONTROL_LINE_OUT_* lines to assert
+		 */
+		static inline void Harness_SetControlLines(const uint16_t Lines)
+		{
+			VirtualSerial_CDC_Interface.State.ControlLineStates.HostToDevice = Lines;
+
+			EVENT_CDC_Device_ControLineStateChanged(&VirtualSerial_CDC_Interface);
+		}
+
+		/** Delivers a run of bytes from the target, one USART receive interrupt each.
+		 *
+		 *  \param[in] Bytes   Bytes received by the USART
+		 *  \param[in] Length  Number of bytes to deliver
+		 */
+		static inline void Harness_ReceiveFromTarget(const uint8_t* const Bytes,
+		                                             const uint16_t Length)
+		{
+			for (uint16_t i = 0; i < Length; i++)
+			{
+				UDR1 = Bytes[i];
+				USART1_RX_vect();
+			}
+		}
+
+		/** Runs the USART data register empty interrupt for as long as it stays armed, collecting what it sends.
+		 *
+		 *  \param[out] Buffer     Location where the bytes sent to the target are to be stored, or \c NULL
+		 *  \param[in]  MaxLength  Largest number of bytes to send
+		 *
+		 *  \return Number of bytes sent to the target
+		 */
+		static inline uint16_t Harness_SendToTarget(uint8_t* const Buffer,
+		                                            const uint16_t MaxLength)
+		{
+			uint16_t Length = 0;
+
+			while ((UCSR1B & (1 << UDRIE1)) && (Length < MaxLength))
+			{
+				/* The ISR may disarm itself without loading a byte, when it finds nothing to send */
+				bool BytePending = !(USBtoUSART_Buffer_IsEmpty());
+
+				USART1_UDRE_vect();
+
+				if (BytePending)
+				{
+					if (Buffer)
+					  Buffer[Length] = UDR1;
+
+					Length++;
+				}
+			}
+
+			return Length;
+		}
+
+		/** Runs one pass of the firmware's main loop, as \c main() does in the current device mode. */
+		static inline void Harness_MainLoopPass(void)
+		{
+			switch (mode)
+			{
+				case MODE_Serial:
+					Serial_To_Arduino();
+					Serial_To_Host();
+
+					#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+					FlowControl_Task();
+					#endif
+
+					SerialState_Task();
+
+					if (FlushBuffersPending)
+					  Serial_FlushBuffers();
+
+					break;
+				case MODE_MIDI:
+					#if defined(ENABLE_MIDI_SOFT_THRU)
+					MIDI_SoftThru_Task();
+					#endif
+
+					MIDI_To_Arduino();
+					MIDI_To_Host();
+					break;
+				#if defined(ENABLE_COMPOSITE_MODE)
+				case MODE_Composite:
+					Serial_To_Arduino();
+
+					#if defined(ENABLE_MIDI_SOFT_THRU)
+					MIDI_SoftThru_Task();
+					#endif
+
+					MIDI_To_Arduino();
+
+					Serial_To_Host();
+					MIDI_To_Host();
+
+					#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+					FlowControl_Task();
+					#endif
+
+					SerialState_Task();
+
+					if (FlushBuffersPending)
+					  Serial_FlushBuffers();
+
+					break;
+				#endif
+			}
+
+			if (RequestedMode != StoredMode)
+			  Mode_Change(RequestedMode);
+		}
+
+#endif
@@ -0,0 +1,1138 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+/** \file
+ *
+ *  Tests of the firmware as a whole, run through FirmwareHarness.h. Each test plays the host through the modelled
+ *  endpoints and control requests, plays the target by calling the USART ISRs, and checks what comes out at the
+ *  other end.
+ */
+
+#include "HostTest.h"
+#include "FirmwareHarness.h"
+
+/* Name the results are reported under, which tells apart the builds with different compile time options */
+#if !defined(FIRMWARE_TEST_SUITE)
+	#define FIRMWARE_TEST_SUITE  "FirmwareTest"
+#endif
+
+/** Checks that a run of bytes matches the expected one. */
+#define EXPECT_BYTES(Actual, ActualLength, ...)                                                 \
+	do                                                                                        \
+	{                                                                                         \
+		static const uint8_t Expected[] = {__VA_ARGS__};                                      \
+		TEST_ASSERT_EQUAL(sizeof(Expected), (ActualLength));                                  \
+		TEST_ASSERT(((ActualLength) == sizeof(Expected)) &&                                   \
+		            !(memcmp(Expected, (Actual), sizeof(Expected))));                         \
+	} while (0)
+
+static void Test_MIDI_TargetToHost(void)
+{
+	MIDI_PackingStats_t Stats;
+	uint8_t             Packet[64];
+	uint16_t            Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	/* A Timing Clock in the middle of a note, then a second note, all completed before the main loop runs */
+	Harness_ReceiveFromTarget((const uint8_t[]){0x90, 0x40, 0x7F, 0xF8, 0x41, 0x00}, 6);
+	MIDI_To_Host();
+
+	Length = HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+	TEST_ASSERT_EQUAL(12, Length);
+	TEST_ASSERT(!(memcmp(Packet, (const uint8_t[]){0x09, 0x90, 0x40, 0x7F,  0x0F, 0xF8, 0x00, 0x00,
+	                                               0x09, 0x90, 0x41, 0x00}, 12)));
+
+	/* The events are taken from the FIFO, and counted as one packet */
+	TEST_ASSERT_EQUAL(0, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetMIDIPackingStats, 0, 0, &Stats, sizeof(Stats)));
+	TEST_ASSERT_EQUAL(3, Stats.Events);
+	TEST_ASSERT_EQUAL(1, Stats.Packets);
+	TEST_ASSERT_EQUAL(1,  DeviceStats.INPackets);
+	TEST_ASSERT_EQUAL(12, DeviceStats.BytesToHost);
+
+	/* With nothing pending, no packet is sent */
+	MIDI_To_Host();
+	TEST_ASSERT_EQUAL(1, HostShim_Endpoints[MIDI_STREAM_IN_EPADDR & ENDPOINT_EPNUM_MASK].INPackets);
+}
+
+static void Test_MIDI_SysExToHost(void)
+{
+	uint8_t  Packet[64];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	/* Streamed three bytes at a time, with a Timing Clock passed through without ending it */
+	Harness_ReceiveFromTarget((const uint8_t[]){0xF0, 0x01, 0x02, 0x03, 0xF8, 0x04, 0xF7}, 7);
+	MIDI_To_Host();
+
+	Length = HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+	EXPECT_BYTES(Packet, Length, 0x04, 0xF0, 0x01, 0x02,  0x0F, 0xF8, 0x00, 0x00,  0x07, 0x03, 0x04, 0xF7);
+
+	/* One cut short by a channel message is given the EOX it lacks, and the message follows */
+	Harness_ReceiveFromTarget((const uint8_t[]){0xF0, 0x01, 0x90, 0x40, 0x7F}, 5);
+	MIDI_To_Host();
+
+	Length = HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+	EXPECT_BYTES(Packet, Length, 0x07, 0xF0, 0x01, 0xF7,  0x09, 0x90, 0x40, 0x7F);
+
+	/* And so is one cut short on a packet boundary, by a lone EOX */
+	Harness_ReceiveFromTarget((const uint8_t[]){0xF0, 0x01, 0x02, 0xC0, 0x05}, 5);
+	MIDI_To_Host();
+
+	Length = HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+	EXPECT_BYTES(Packet, Length, 0x04, 0xF0, 0x01, 0x02,  0x05, 0xF7, 0x00, 0x00,  0x0C, 0xC0, 0x05, 0x00);
+}
+
+static void Test_MIDI_OverflowRequest(void)
+{
+	uint16_t Overflows = 0;
+
+	Harness_Reset(MODE_MIDI);
+
+	/* Fill the event FIFO without letting the main loop drain it, then one more */
+	for (uint8_t i = 0; i <= MIDI_EVENT_FIFO_SIZE; i++)
+	  Harness_ReceiveFromTarget((const uint8_t[]){0x90, i, 0x7F}, 3);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetMIDIOverflows, 0, 0, &Overflows, sizeof(Overflows)));
+	TEST_ASSERT_EQUAL(1, Overflows);
+}
+
+static void Test_MIDI_Unconfigured(void)
+{
+	uint8_t Packet[64];
+
+	Harness_Reset(MODE_MIDI);
+	USB_DeviceState = DEVICE_STATE_Default;
+
+	/* Without a host to send them to, the bytes are counted as dropped rather than parsed */
+	Harness_ReceiveFromTarget((const uint8_t[]){0x90, 0x40, 0x7F}, 3);
+	MIDI_To_Host();
+
+	TEST_ASSERT_EQUAL(3, DeviceStats.DroppedBytes);
+	TEST_ASSERT_EQUAL(0, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+	TEST_ASSERT_EQUAL(0, HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet)));
+}
+
+static void Test_MIDI_HostToTarget(void)
+{
+	static const uint8_t Events[] = {0x00, 0x00, 0x00, 0x00,  0x09, 0x91, 0x10, 0x20,  0x09, 0x91, 0x11, 0x00,
+	                                 0x0F, 0xF8, 0x00, 0x00};
+
+	uint8_t  Sent[32];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	/* The whole bank is queued for the transmit interrupt rather than sent while the main loop waits */
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+	MIDI_To_Arduino();
+
+	TEST_ASSERT(!(HostShim_Endpoints[MIDI_STREAM_OUT_EPADDR & ENDPOINT_EPNUM_MASK].OUTReceived));
+	TEST_ASSERT(UCSR1B & (1 << UDRIE1));
+
+	/* Each event goes out as the bytes its CIN carries, the reserved CIN as nothing at all, and the second Note On
+	 * under running status */
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x91, 0x10, 0x20, 0x11, 0x00, 0xF8);
+
+	TEST_ASSERT_EQUAL(1, DeviceStats.OUTPackets);
+}
+
+static void Test_MIDI_RunningStatusRequest(void)
+{
+	static const uint8_t Events[] = {0x09, 0x91, 0x10, 0x20,  0x09, 0x91, 0x11, 0x00};
+
+	uint8_t  Sent[32];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDIRunningStatus, 0, 0, NULL, 0));
+
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+	MIDI_To_Arduino();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x91, 0x10, 0x20, 0x91, 0x11, 0x00);
+}
+
+static void Test_MIDI_RunningStatusAppliedByMainLoop(void)
+{
+	static const uint8_t Events[] = {0x09, 0x91, 0x10, 0x20,  0x09, 0x91, 0x11, 0x00};
+
+	uint8_t  Sent[32];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+	MIDI_To_Arduino();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x91, 0x10, 0x20, 0x11, 0x00);
+
+	/* The request only records the change, which is left to the next queued message */
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDIRunningStatus, 1, 0, NULL, 0));
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDIRunningStatus, 0, 0, NULL, 0));
+	TEST_ASSERT(MIDI_TX_RunningStatus);
+	TEST_ASSERT_EQUAL(0x91, mRunningStatus_TX);
+
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+	MIDI_To_Arduino();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x91, 0x10, 0x20, 0x91, 0x11, 0x00);
+	TEST_ASSERT(!(MIDI_TX_RunningStatus));
+
+	/* Turning it back on starts again from a status byte sent in full */
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDIRunningStatus, 1, 0, NULL, 0));
+
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+	MIDI_To_Arduino();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x91, 0x10, 0x20, 0x11, 0x00);
+}
+
+#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+static void Test_MIDI_IgnoresCTS(void)
+{
+	static const uint8_t Events[] = {0x09, 0x92, 0x30, 0x40};
+
+	uint8_t  Sent[8];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	/* The CTS line floats in MIDI mode, and may read as deasserted */
+	PINB |= AVR_CTS_LINE_MASK;
+
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+	MIDI_To_Arduino();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x92, 0x30, 0x40);
+}
+#endif
+
+static void Test_MIDI_EventWaitsForRoom(void)
+{
+	static const uint8_t Event[] = {0x09, 0x91, 0x10, 0x20};
+
+	Harness_Reset(MODE_MIDI);
+
+	/* Leave room for less than a whole event */
+	while (USBtoUSART_Buffer_GetFreeCount() > 2)
+	  USBtoUSART_Buffer_Insert(0xF8);
+
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Event, sizeof(Event)));
+	MIDI_To_Arduino();
+
+	/* The event stays in the bank, rather than being sent in part */
+	TEST_ASSERT(HostShim_Endpoints[MIDI_STREAM_OUT_EPADDR & ENDPOINT_EPNUM_MASK].OUTReceived);
+	TEST_ASSERT_EQUAL(2, USBtoUSART_Buffer_GetFreeCount());
+}
+
+static void Test_Serial_HostToTarget(void)
+{
+	static const char Data[] = "Hello, target";
+
+	uint8_t  Sent[64];
+	uint16_t Length;
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+
+	TEST_ASSERT(HostShim_SendOUT(CDC_RX_EPADDR, Data, (sizeof(Data) - 1)));
+	Serial_To_Arduino();
+
+	/* The whole packet is taken in one pass, freeing the bank for the next one */
+	TEST_ASSERT_EQUAL((sizeof(Data) - 1), USBtoUSART_Buffer_GetCount());
+	TEST_ASSERT_EQUAL(1, HostShim_Endpoints[CDC_RX_EPADDR & ENDPOINT_EPNUM_MASK].OUTPackets);
+	TEST_ASSERT(!(HostShim_Endpoints[CDC_RX_EPADDR & ENDPOINT_EPNUM_MASK].OUTReceived));
+
+	/* The transmit interrupt is armed to send it in the background */
+	TEST_ASSERT(UCSR1B & (1 << UDRIE1));
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	TEST_ASSERT_EQUAL((sizeof(Data) - 1), Length);
+	TEST_ASSERT(!(memcmp(Sent, Data, (sizeof(Data) - 1))));
+
+	/* Once the buffer is empty, the interrupt disarms itself */
+	TEST_ASSERT(!(UCSR1B & (1 << UDRIE1)));
+}
+
+static void Test_Serial_OUTBankWaitsForRoom(void)
+{
+	HostShim_Endpoint_t* Endpoint = &HostShim_Endpoints[CDC_RX_EPADDR & ENDPOINT_EPNUM_MASK];
+	uint8_t              Data[CDC_TXRX_EPSIZE];
+	uint8_t              Sent[USBTOUSART_BUFFER_SIZE + CDC_TXRX_EPSIZE];
+	uint16_t             Length = 0;
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+
+	/* Fill the transmit buffer up to a few bytes short of full */
+	for (uint16_t i = 0; i < (USBTOUSART_BUFFER_SIZE - 4); i++)
+	  USBtoUSART_Buffer_Insert(0xAA);
+
+	for (uint8_t i = 0; i < sizeof(Data); i++)
+	  Data[i] = i;
+
+	TEST_ASSERT(HostShim_SendOUT(CDC_RX_EPADDR, Data, sizeof(Data)));
+	Serial_To_Arduino();
+
+	/* Only what fits is taken, the rest stays in the bank */
+	TEST_ASSERT(USBtoUSART_Buffer_IsFull());
+	TEST_ASSERT(Endpoint->OUTReceived);
+	TEST_ASSERT_EQUAL((sizeof(Data) - 4), Endpoint_BytesInEndpoint());
+
+	Length += Harness_SendToTarget(Sent, sizeof(Sent));
+	Serial_To_Arduino();
+
+	/* Once there is room, the rest is taken and the bank released */
+	TEST_ASSERT(!(Endpoint->OUTReceived));
+	TEST_ASSERT_EQUAL(1, Endpoint->OUTPackets);
+
+	Length += Harness_SendToTarget(&Sent[Length], (sizeof(Sent) - Length));
+	TEST_ASSERT_EQUAL((USBTOUSART_BUFFER_SIZE - 4 + sizeof(Data)), Length);
+	TEST_ASSERT(!(memcmp(&Sent[USBTOUSART_BUFFER_SIZE - 4], Data, sizeof(Data))));
+}
+
+#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+static void Test_Serial_FlowControl(void)
+{
+	static const uint8_t Data[] = {0x01, 0x02, 0x03};
+
+	uint8_t  Received[CDC_TXRX_EPSIZE + RTS_HIGH_WATERMARK];
+	uint8_t  Sent[8];
+	uint16_t Length;
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+	VirtualSerial_CDC_Interface.State.ControlLineStates.HostToDevice = CDC_CONTROL_LINE_OUT_RTS;
+
+	/* RTS (active low) starts deasserted, until the main loop sees the host is ready */
+	TEST_ASSERT(AVR_RTS_LINE_PORT & AVR_RTS_LINE_MASK);
+	Harness_MainLoopPass();
+	TEST_ASSERT(!(AVR_RTS_LINE_PORT & AVR_RTS_LINE_MASK));
+
+	/* A deasserted CTS holds the data from the host back without losing it */
+	PINB |= AVR_CTS_LINE_MASK;
+
+	TEST_ASSERT(HostShim_SendOUT(CDC_RX_EPADDR, Data, sizeof(Data)));
+	Serial_To_Arduino();
+	USART1_UDRE_vect();
+
+	TEST_ASSERT(!(UCSR1B & (1 << UDRIE1)));
+	TEST_ASSERT_EQUAL(sizeof(Data), USBtoUSART_Buffer_GetCount());
+
+	/* The main loop restarts the transmission once the target asserts CTS */
+	PINB &= ~AVR_CTS_LINE_MASK;
+	Harness_MainLoopPass();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x01, 0x02, 0x03);
+
+	/* The receive ISR deasserts RTS once the buffer behind the full IN bank reaches the high watermark */
+	memset(Received, 0x55, sizeof(Received));
+	Harness_ReceiveFromTarget(Received, (sizeof(Received) - 1));
+	TEST_ASSERT(!(AVR_RTS_LINE_PORT & AVR_RTS_LINE_MASK));
+
+	Harness_ReceiveFromTarget(Received, 1);
+	TEST_ASSERT_EQUAL(RTS_HIGH_WATERMARK, USARTtoUSB_Buffer_GetCount());
+	TEST_ASSERT(AVR_RTS_LINE_PORT & AVR_RTS_LINE_MASK);
+
+	/* It is asserted again once the host has taken the buffer down to the low watermark */
+	for (uint8_t i = 0; (i < 10) && (USARTtoUSB_Buffer_GetCount() > RTS_LOW_WATERMARK); i++)
+	{
+		TEST_ASSERT(AVR_RTS_LINE_PORT & AVR_RTS_LINE_MASK);
+		Harness_MainLoopPass();
+	}
+
+	TEST_ASSERT(USARTtoUSB_Buffer_GetCount() <= RTS_LOW_WATERMARK);
+	TEST_ASSERT(!(AVR_RTS_LINE_PORT & AVR_RTS_LINE_MASK));
+}
+#endif
+
+static void Test_Serial_TargetToHost(void)
+{
+	static const char Data[] = "Hello, host";
+
+	uint8_t  Packet[64];
+	uint16_t Length;
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+
+	/* The idle main loop keeps the latency timer primed */
+	Harness_MainLoopPass();
+
+	Harness_ReceiveFromTarget((const uint8_t*)Data, (sizeof(Data) - 1));
+
+	/* Nothing is sent until the latency timer runs out */
+	Harness_MainLoopPass();
+	TEST_ASSERT_EQUAL(0, HostShim_TakeIN(CDC_TX_EPADDR, Packet, sizeof(Packet)));
+
+	for (uint8_t i = 0; i < DEFAULT_LATENCY_TIMER_MS; i++)
+	{
+		TIMER0_COMPA_vect();
+		Harness_MainLoopPass();
+	}
+
+	Length = HostShim_TakeIN(CDC_TX_EPADDR, Packet, sizeof(Packet));
+	TEST_ASSERT_EQUAL((sizeof(Data) - 1), Length);
+	TEST_ASSERT(!(memcmp(Packet, Data, (sizeof(Data) - 1))));
+	TEST_ASSERT_EQUAL(1, HostShim_Endpoints[CDC_TX_EPADDR & ENDPOINT_EPNUM_MASK].INPackets);
+}
+
+static void Test_Serial_FullPacketEndedByZLP(void)
+{
+	HostShim_Endpoint_t* Endpoint = &HostShim_Endpoints[CDC_TX_EPADDR & ENDPOINT_EPNUM_MASK];
+	uint8_t              Data[CDC_TXRX_EPSIZE];
+	uint8_t              Packet[64];
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+	Harness_MainLoopPass();
+
+	memset(Data, 0x55, sizeof(Data));
+	Harness_ReceiveFromTarget(Data, sizeof(Data));
+
+	/* A full packet goes out straight away */
+	Harness_MainLoopPass();
+	TEST_ASSERT_EQUAL(1, Endpoint->INPackets);
+	TEST_ASSERT_EQUAL(CDC_TXRX_EPSIZE, HostShim_TakeIN(CDC_TX_EPADDR, Packet, sizeof(Packet)));
+
+	Harness_MainLoopPass();
+	TEST_ASSERT_EQUAL(1, Endpoint->INPackets);
+
+	/* With nothing more to send, the transfer is ended once the latency timer expires */
+	for (uint8_t i = 0; i < DEFAULT_LATENCY_TIMER_MS; i++)
+	{
+		TIMER0_COMPA_vect();
+		Harness_MainLoopPass();
+	}
+
+	TEST_ASSERT_EQUAL(2, Endpoint->INPackets);
+	TEST_ASSERT_EQUAL(0, HostShim_TakeIN(CDC_TX_EPADDR, Packet, sizeof(Packet)));
+
+	for (uint8_t i = 0; i < DEFAULT_LATENCY_TIMER_MS; i++)
+	{
+		TIMER0_COMPA_vect();
+		Harness_MainLoopPass();
+	}
+
+	TEST_ASSERT_EQUAL(2, Endpoint->INPackets);
+}
+
+static void Test_Serial_StatsRequestsKeepData(void)
+{
+	uint8_t  Data[USARTTOUSB_BUFFER_SIZE];
+	uint8_t  Received[USARTTOUSB_BUFFER_SIZE + CDC_TXRX_EPSIZE];
+	uint16_t Length = 0;
+	uint16_t Overflows;
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+
+	for (uint8_t i = 0; i < sizeof(Data); i++)
+	  Data[i] = i;
+
+	Harness_ReceiveFromTarget(Data, sizeof(Data));
+
+	/* The MIDI overflow count is not kept in serial mode, where it would be part of the buffered data */
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetMIDIOverflows, 0, 0, &Overflows, sizeof(Overflows)));
+	TEST_ASSERT_EQUAL(0, Overflows);
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_ClearDeviceStats, 0, 0, NULL, 0));
+
+	for (uint8_t i = 0; (i < 16) && (Length < sizeof(Data)); i++)
+	{
+		TIMER0_COMPA_vect();
+		Serial_To_Host();
+
+		Length += HostShim_TakeIN(CDC_TX_EPADDR, &Received[Length], (sizeof(Received) - Length));
+	}
+
+	TEST_ASSERT_EQUAL(sizeof(Data), Length);
+	TEST_ASSERT(!(memcmp(Received, Data, sizeof(Data))));
+}
+
+static void Test_Serial_LatencyTimerRequest(void)
+{
+	uint8_t LatencyTimer = 0;
+
+	Harness_Reset(MODE_Serial);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetLatencyTimer, 2, 0, NULL, 0));
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetLatencyTimer, 0, 0, &LatencyTimer, sizeof(LatencyTimer)));
+	TEST_ASSERT_EQUAL(2, LatencyTimer);
+}
+
+static void Test_Serial_LineErrorsNotified(void)
+{
+	HostShim_Endpoint_t* Endpoint = &HostShim_Endpoints[CDC_NOTIFICATION_EPADDR & ENDPOINT_EPNUM_MASK];
+	uint8_t              Notification[16];
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+	HostShim_HoldIN = true;
+
+	/* Errors seen together are reported in one notification */
+	UCSR1A |= ((1 << FE1) | (1 << DOR1));
+	Harness_ReceiveFromTarget((const uint8_t[]){0x55}, 1);
+	UCSR1A &= ~((1 << FE1) | (1 << DOR1));
+	Harness_MainLoopPass();
+
+	TEST_ASSERT_EQUAL(1, Endpoint->INPackets);
+	TEST_ASSERT_EQUAL(10, HostShim_TakeIN(CDC_NOTIFICATION_EPADDR, Notification, sizeof(Notification)));
+	TEST_ASSERT_EQUAL(CDC_NOTIF_SerialState, Notification[1]);
+	TEST_ASSERT_EQUAL((CDC_CONTROL_LINE_IN_FRAMEERROR | CDC_CONTROL_LINE_IN_OVERRUNERROR), Notification[8]);
+	TEST_ASSERT_EQUAL(0, VirtualSerial_CDC_Interface.State.ControlLineStates.DeviceToHost);
+
+	/* A later error waits for the notification interval to pass */
+	UCSR1A |= (1 << UPE1);
+	Harness_ReceiveFromTarget((const uint8_t[]){0x55}, 1);
+	UCSR1A &= ~(1 << UPE1);
+
+	for (uint8_t i = 0; i < (CDC_NOTIFICATION_INTERVAL_MS - 1); i++)
+	{
+		TIMER0_COMPA_vect();
+		Harness_MainLoopPass();
+	}
+
+	TEST_ASSERT_EQUAL(1, Endpoint->INPackets);
+
+	TIMER0_COMPA_vect();
+	Harness_MainLoopPass();
+
+	TEST_ASSERT_EQUAL(2, Endpoint->INPackets);
+	TEST_ASSERT_EQUAL(10, HostShim_TakeIN(CDC_NOTIFICATION_EPADDR, Notification, sizeof(Notification)));
+	TEST_ASSERT_EQUAL(CDC_CONTROL_LINE_IN_PARITYERROR, Notification[8]);
+	TEST_ASSERT_EQUAL(1, DeviceStats.ParityErrors);
+}
+
+static void Test_Serial_DTRResetsTarget(void)
+{
+	uint8_t Packet[64];
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+	TEST_ASSERT(AVR_RESET_LINE_PORT & AVR_RESET_LINE_MASK);
+
+	/* Data from before the reset is left waiting in both directions, behind a packet the host has yet to collect */
+	HostShim_HoldIN = true;
+	memset(Packet, 'x', CDC_TXRX_EPSIZE);
+	Harness_ReceiveFromTarget(Packet, CDC_TXRX_EPSIZE);
+	Harness_MainLoopPass();
+	Harness_ReceiveFromTarget((const uint8_t*)"stale", 5);
+	TEST_ASSERT(HostShim_SendOUT(CDC_RX_EPADDR, "old", 3));
+	Serial_To_Arduino();
+
+	/* Asserting DTR pulses the reset line low, and the main loop then discards the buffered data */
+	Harness_SetControlLines(CDC_CONTROL_LINE_OUT_DTR);
+	TEST_ASSERT(!(AVR_RESET_LINE_PORT & AVR_RESET_LINE_MASK));
+
+	Harness_MainLoopPass();
+	TEST_ASSERT_EQUAL(0, USBtoUSART_Buffer_GetCount());
+	TEST_ASSERT_EQUAL(0, USARTtoUSB_Buffer_GetCount());
+
+	for (uint8_t i = 0; i < (TARGET_RESET_PULSE_MS - 1); i++)
+	  TIMER0_COMPA_vect();
+
+	TEST_ASSERT(!(AVR_RESET_LINE_PORT & AVR_RESET_LINE_MASK));
+	TIMER0_COMPA_vect();
+	TEST_ASSERT(AVR_RESET_LINE_PORT & AVR_RESET_LINE_MASK);
+
+	/* Only the edge resets the target, not DTR staying asserted */
+	Harness_SetControlLines(CDC_CONTROL_LINE_OUT_DTR | CDC_CONTROL_LINE_OUT_RTS);
+	TEST_ASSERT(AVR_RESET_LINE_PORT & AVR_RESET_LINE_MASK);
+
+	/* Only the packet sent before the reset reaches the host */
+	TEST_ASSERT_EQUAL(CDC_TXRX_EPSIZE, HostShim_TakeIN(CDC_TX_EPADDR, Packet, sizeof(Packet)));
+
+	for (uint8_t i = 0; i < DEFAULT_LATENCY_TIMER_MS; i++)
+	{
+		TIMER0_COMPA_vect();
+		Harness_MainLoopPass();
+	}
+
+	TEST_ASSERT_EQUAL(0, HostShim_TakeIN(CDC_TX_EPADDR, Packet, sizeof(Packet)));
+}
+
+static void Test_LEDs_StatusRestoredAfterPulse(void)
+{
+	static const uint8_t Data[] = "0123";
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+
+	/* The board's LEDs are lit when their pin is low, and the ready status shares a LED with the TX activity */
+	TEST_ASSERT_EQUAL((uint8_t)~LEDMASK_USB_READY & LEDS_ALL_LEDS, LEDs_GetLEDs());
+
+	Serial_To_Host();
+	Harness_ReceiveFromTarget(Data, (sizeof(Data) - 1));
+	TEST_ASSERT(HostShim_SendOUT(CDC_RX_EPADDR, Data, (sizeof(Data) - 1)));
+
+	for (uint8_t i = 0; i <= DEFAULT_LATENCY_TIMER_MS; i++)
+	  TIMER0_COMPA_vect();
+
+	Serial_To_Arduino();
+	Serial_To_Host();
+
+	/* Both activity LEDs show the opposite of their status during the pulse */
+	TEST_ASSERT_EQUAL((uint8_t)~(LEDMASK_USB_READY ^ (LEDMASK_TX | LEDMASK_RX)) & LEDS_ALL_LEDS, LEDs_GetLEDs());
+
+	for (uint8_t i = 0; i < ACTIVITY_LED_PULSE_MS; i++)
+	  TIMER0_COMPA_vect();
+
+	TEST_ASSERT_EQUAL((uint8_t)~LEDMASK_USB_READY & LEDS_ALL_LEDS, LEDs_GetLEDs());
+}
+
+static void Test_Mode_SwitchReenumerates(void)
+{
+	uint8_t  Packet[64];
+	uint16_t Length;
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(115200);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetDeviceMode, MODE_MIDI, 0, NULL, 0));
+
+	/* The switch waits for the main loop, after the request has completed */
+	TEST_ASSERT_EQUAL(MODE_Serial, mode);
+	TEST_ASSERT_EQUAL(0, HostShim_DelayedMS);
+
+	Harness_MainLoopPass();
+
+	/* The main loop is held up for the wait before detaching and the time spent detached */
+	TEST_ASSERT_EQUAL(MODE_MIDI, mode);
+	TEST_ASSERT_EQUAL(MODE_MIDI, eeprom_read_byte(&StoredModeEEPROM));
+	TEST_ASSERT_EQUAL((2 * MODE_SWITCH_DETACH_MS), HostShim_DelayedMS);
+	TEST_ASSERT(HostShim_Attached);
+
+	/* Once the host has configured the device again, it works in the new mode */
+	USB_DeviceState = DEVICE_STATE_Configured;
+	EVENT_USB_Device_ConfigurationChanged();
+
+	Harness_ReceiveFromTarget((const uint8_t[]){0x90, 0x40, 0x7F}, 3);
+	Harness_MainLoopPass();
+
+	Length = HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+	EXPECT_BYTES(Packet, Length, 0x09, 0x90, 0x40, 0x7F);
+	TEST_ASSERT_EQUAL(2 * MODE_SWITCH_DETACH_MS, HostShim_DelayedMS);
+}
+
+static void Test_Mode_RejectsOutOfRangeRequest(void)
+{
+	Harness_Reset(MODE_Serial);
+
+	/* The low byte alone would name MIDI mode */
+	TEST_ASSERT(!(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                      VENDOR_REQ_SetDeviceMode, (0x0100 | MODE_MIDI), 0, NULL, 0)));
+	TEST_ASSERT_EQUAL(MODE_Serial, RequestedMode);
+
+	Harness_MainLoopPass();
+	TEST_ASSERT_EQUAL(MODE_Serial, mode);
+}
+
+static void Test_LEDs_PulseIndependentOfLoopPasses(void)
+{
+	static const uint8_t NoteOn[] = {0x90, 0x40, 0x7F};
+
+	uint8_t Packet[64];
+	uint8_t IdleLEDs;
+	uint8_t PulsedLEDs;
+
+	Harness_Reset(MODE_MIDI);
+	IdleLEDs = LEDs_GetLEDs();
+
+	Harness_ReceiveFromTarget(NoteOn, sizeof(NoteOn));
+	Harness_MainLoopPass();
+	HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+
+	PulsedLEDs = LEDs_GetLEDs();
+	TEST_ASSERT(PulsedLEDs != IdleLEDs);
+
+	/* Idle main loop passes leave the LEDs alone, however many there are */
+	for (uint16_t i = 0; i < 10000; i++)
+	  Harness_MainLoopPass();
+
+	TEST_ASSERT_EQUAL(PulsedLEDs, LEDs_GetLEDs());
+
+	/* Only the millisecond tick ends the pulse */
+	for (uint8_t i = 1; i < ACTIVITY_LED_PULSE_MS; i++)
+	  TIMER0_COMPA_vect();
+
+	TEST_ASSERT_EQUAL(PulsedLEDs, LEDs_GetLEDs());
+
+	TIMER0_COMPA_vect();
+	TEST_ASSERT_EQUAL(IdleLEDs, LEDs_GetLEDs());
+}
+
+#if defined(ENABLE_PROFILING)
+static void Test_Profiling_ReadClears(void)
+{
+	ProfilingStats_t Stats;
+
+	Harness_Reset(MODE_MIDI);
+
+	ProfilingStats.RXISRMaxCycles   = 120;
+	ProfilingStats.UDREISRMaxCycles = 80;
+	ProfilingStats.LoopMaxCycles    = 1500;
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetProfilingStats, 0, 0, &Stats, sizeof(Stats)));
+
+	/* The host gets the figures as they were, and the next measurement starts from zero */
+	TEST_ASSERT_EQUAL(120, Stats.RXISRMaxCycles);
+	TEST_ASSERT_EQUAL(80, Stats.UDREISRMaxCycles);
+	TEST_ASSERT_EQUAL(1500, Stats.LoopMaxCycles);
+	TEST_ASSERT_EQUAL(0, ProfilingStats.RXISRMaxCycles);
+	TEST_ASSERT_EQUAL(0, ProfilingStats.UDREISRMaxCycles);
+	TEST_ASSERT_EQUAL(0, ProfilingStats.LoopMaxCycles);
+}
+#endif
+
+#if defined(ENABLE_COMPOSITE_MODE)
+static void Test_Composite_HostToTarget(void)
+{
+	static const uint8_t Events[] = {0x09, 0x90, 0x40, 0x7F};
+	static const uint8_t Data[]   = {'A', COMPOSITE_FRAME_ESCAPE};
+
+	uint8_t  Sent[16];
+	uint16_t Length;
+
+	Harness_Reset(MODE_Composite);
+	Harness_OpenSerialPort(115200);
+
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+	TEST_ASSERT(HostShim_SendOUT(CDC_RX_EPADDR, Data, sizeof(Data)));
+	Harness_MainLoopPass();
+
+	/* The MIDI message goes out as a frame, and the serial data's escape byte as a zero length frame */
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 'A', COMPOSITE_FRAME_ESCAPE, 0,  COMPOSITE_FRAME_ESCAPE, 3, 0x90, 0x40, 0x7F);
+}
+
+static void Test_Composite_TargetToHost(void)
+{
+	static const uint8_t Received[] = {'A', COMPOSITE_FRAME_ESCAPE, 3, 0x90, 0x40, 0x7F,
+	                                   COMPOSITE_FRAME_ESCAPE, 0, 'B'};
+
+	uint8_t  Packet[64];
+	uint16_t Length;
+
+	Harness_Reset(MODE_Composite);
+	Harness_OpenSerialPort(115200);
+
+	Harness_ReceiveFromTarget(Received, sizeof(Received));
+
+	for (uint8_t i = 0; i < DEFAULT_LATENCY_TIMER_MS; i++)
+	{
+		TIMER0_COMPA_vect();
+		Harness_MainLoopPass();
+	}
+
+	/* The frame is taken out of the serial data for the MIDI interface */
+	Length = HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+	EXPECT_BYTES(Packet, Length, 0x09, 0x90, 0x40, 0x7F);
+
+	Length = HostShim_TakeIN(CDC_TX_EPADDR, Packet, sizeof(Packet));
+	EXPECT_BYTES(Packet, Length, 'A', COMPOSITE_FRAME_ESCAPE, 'B');
+}
+#endif
+
+#if defined(ENABLE_COMPOSITE_MODE)
+static void Test_Composite_FlushKeepsFrameInProgress(void)
+{
+	static const uint8_t Events[] = {0x09, 0x90, 0x40, 0x7F};
+	static const uint8_t Frame[]  = {COMPOSITE_FRAME_ESCAPE, 3, 0x90, 0x40, 0x7F};
+
+	uint8_t  Sent[16];
+	uint16_t Length;
+
+	/* Reset the target at each point of a MIDI frame which has partly gone out, with serial data queued behind it */
+	for (uint8_t Cut = 1; Cut < sizeof(Frame); Cut++)
+	{
+		Harness_Reset(MODE_Composite);
+		Harness_OpenSerialPort(115200);
+		Harness_SetControlLines(0);
+
+		TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, Events, sizeof(Events)));
+		MIDI_To_Arduino();
+		TEST_ASSERT(HostShim_SendOUT(CDC_RX_EPADDR, "AB", 2));
+		Serial_To_Arduino();
+
+		TEST_ASSERT_EQUAL(Cut, Harness_SendToTarget(Sent, Cut));
+
+		Harness_SetControlLines(CDC_CONTROL_LINE_OUT_DTR);
+		Serial_FlushBuffers();
+
+		/* Only the rest of the frame follows, so the Arduino's decoder is left between frames */
+		Length = Harness_SendToTarget(Sent, sizeof(Sent));
+		TEST_ASSERT_EQUAL((sizeof(Frame) - Cut), Length);
+		TEST_ASSERT(!(memcmp(Sent, &Frame[Cut], Length)));
+		TEST_ASSERT_EQUAL(0, CompositeTxMIDIBytes);
+		TEST_ASSERT(!(CompositeTxEscaped));
+	}
+}
+#endif
+
+#if defined(ENABLE_MIDI_LATENCY_STATS)
+static void Test_MIDI_LatencyPastTimestampWrap(void)
+{
+	uint8_t Packet[64];
+
+	Harness_Reset(MODE_MIDI);
+
+	/* Hold an event back for just over the 262ms wrap of a 16-bit count of 4us ticks */
+	Harness_ReceiveFromTarget((const uint8_t[]){0x90, 0x40, 0x7F}, 3);
+
+	for (uint16_t i = 0; i < 263; i++)
+	  TIMER0_COMPA_vect();
+
+	MIDI_To_Host();
+	HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+
+	/* The next event goes straight out */
+	Harness_ReceiveFromTarget((const uint8_t[]){0x80, 0x40, 0x00}, 3);
+	MIDI_To_Host();
+	HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+
+	TEST_ASSERT_EQUAL(1, MIDILatencyStats.ToHost[0]);
+	TEST_ASSERT_EQUAL(1, MIDILatencyStats.ToHost[MIDI_LATENCY_BUCKETS - 1]);
+}
+#endif
+
+#if defined(ENABLE_MIDI_SOFT_THRU)
+static void Test_MIDI_SoftThru(void)
+{
+	uint8_t  Sent[16];
+	uint8_t  Packet[64];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	/* Off at startup, so nothing is echoed */
+	Harness_ReceiveFromTarget((const uint8_t[]){0x90, 0x40, 0x7F}, 3);
+	Harness_MainLoopPass();
+
+	TEST_ASSERT_EQUAL(0, Harness_SendToTarget(Sent, sizeof(Sent)));
+	HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+
+	/* Once on, each message goes back to the target as well as to the host */
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDISoftThru, 1, 0, NULL, 0));
+
+	Harness_ReceiveFromTarget((const uint8_t[]){0x90, 0x41, 0x7F}, 3);
+	Harness_MainLoopPass();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x90, 0x41, 0x7F);
+
+	Length = HostShim_TakeIN(MIDI_STREAM_IN_EPADDR, Packet, sizeof(Packet));
+	EXPECT_BYTES(Packet, Length, 0x09, 0x90, 0x41, 0x7F);
+}
+
+static void Test_MIDI_SoftThruWaitsForHostSysEx(void)
+{
+	uint8_t  Sent[16];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDISoftThru, 1, 0, NULL, 0));
+
+	/* The host starts a System Exclusive message */
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, (const uint8_t[]){0x04, 0xF0, 0x01, 0x02}, 4));
+	Harness_MainLoopPass();
+
+	/* A Real Time message may be echoed in the middle of it, but not the Note On behind it */
+	Harness_ReceiveFromTarget((const uint8_t[]){0xF8, 0x90, 0x40, 0x7F}, 4);
+	Harness_MainLoopPass();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0xF0, 0x01, 0x02, 0xF8);
+
+	/* Once the host ends it, the Note On follows with its status byte in full */
+	TEST_ASSERT(HostShim_SendOUT(MIDI_STREAM_OUT_EPADDR, (const uint8_t[]){0x06, 0x03, 0xF7, 0x00}, 4));
+	Harness_MainLoopPass();
+	Harness_MainLoopPass();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x03, 0xF7, 0x90, 0x40, 0x7F);
+}
+
+static void Test_MIDI_SoftThruUnconfigured(void)
+{
+	uint8_t  Sent[16];
+	uint16_t Length;
+
+	Harness_Reset(MODE_MIDI);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDISoftThru, 1, 0, NULL, 0));
+	USB_DeviceState = DEVICE_STATE_Default;
+
+	/* The bytes are dropped for the host, but still echoed */
+	Harness_ReceiveFromTarget((const uint8_t[]){0x90, 0x40, 0x7F}, 3);
+	MIDI_SoftThru_Task();
+
+	Length = Harness_SendToTarget(Sent, sizeof(Sent));
+	EXPECT_BYTES(Sent, Length, 0x90, 0x40, 0x7F);
+
+	TEST_ASSERT_EQUAL(3, DeviceStats.DroppedBytes);
+	TEST_ASSERT_EQUAL(0, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+}
+#endif
+
+#if defined(ENABLE_MIDI_CLOCK_STATS)
+/** Delivers a MIDI clock from the target, after the given number of millisecond ticks. */
+static void ReceiveClockAfter(const uint16_t MS)
+{
+	for (uint16_t i = 0; i < MS; i++)
+	  TIMER0_COMPA_vect();
+
+	Harness_ReceiveFromTarget((const uint8_t[]){0xF8}, 1);
+}
+
+static void Test_MIDI_ClockStats(void)
+{
+	MIDI_ClockStats_t Stats;
+
+	Harness_Reset(MODE_MIDI);
+
+	/* Five clocks 20ms apart, 125 BPM at 24 clocks per quarter note */
+	for (uint8_t i = 0; i < 5; i++)
+	  ReceiveClockAfter(20);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetMIDIClockStats, 0, 0, &Stats, sizeof(Stats)));
+	TEST_ASSERT_EQUAL(12500, Stats.Tempo);
+	TEST_ASSERT_EQUAL(5000,  Stats.Interval);
+	TEST_ASSERT_EQUAL(0,     Stats.Jitter);
+	TEST_ASSERT_EQUAL(5000,  Stats.MinInterval);
+	TEST_ASSERT_EQUAL(5000,  Stats.MaxInterval);
+	TEST_ASSERT_EQUAL(4,     Stats.Intervals);
+	TEST_ASSERT(!(Stats.Locked));
+
+	/* The clocks still reach the host */
+	TEST_ASSERT_EQUAL(5, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+
+	/* A gap too long for a running clock starts a new run, without measuring the gap */
+	ReceiveClockAfter(MIDI_CLOCK_MAX_INTERVAL_MS);
+	ReceiveClockAfter(10);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetMIDIClockStats, 0, 0, &Stats, sizeof(Stats)));
+	TEST_ASSERT_EQUAL(2500, Stats.Interval);
+	TEST_ASSERT_EQUAL(2500, Stats.MinInterval);
+	TEST_ASSERT_EQUAL(5000, Stats.MaxInterval);
+	TEST_ASSERT_EQUAL(5,    Stats.Intervals);
+
+	/* Clearing the device statistics clears the interval count and extremes */
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_ClearDeviceStats, 0, 0, NULL, 0));
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetMIDIClockStats, 0, 0, &Stats, sizeof(Stats)));
+	TEST_ASSERT_EQUAL(UINT16_MAX, Stats.MinInterval);
+	TEST_ASSERT_EQUAL(0,          Stats.MaxInterval);
+	TEST_ASSERT_EQUAL(0,          Stats.Intervals);
+}
+#endif
+
+#if defined(ENABLE_MIDI_CLOCK_PLL)
+static void Test_MIDI_ClockPLL(void)
+{
+	MIDI_ClockStats_t Stats;
+
+	Harness_Reset(MODE_MIDI);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDIClockMode,
+	                                    (MIDI_CLOCK_MODE_Regenerate | MIDI_CLOCK_MODE_ToSerial), 0, NULL, 0));
+
+	/* The PLL locks on the clock which ends enough steady intervals, which is still passed on */
+	for (uint8_t i = 0; i <= MIDI_CLOCK_LOCK_INTERVALS; i++)
+	  ReceiveClockAfter(20);
+
+	TEST_ASSERT(MIDIClock_Locked);
+	TEST_ASSERT_EQUAL(4999, OCR1A);
+	TEST_ASSERT_EQUAL(MIDI_CLOCK_LOCK_INTERVALS + 1, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_GetMIDIClockStats, 0, 0, &Stats, sizeof(Stats)));
+	TEST_ASSERT(Stats.Locked);
+
+	/* A received clock arriving early is dropped. It brings the averaged period down to 4937, and pulls the
+	 * regenerated clock a quarter of the way towards itself */
+	TCNT1 = 4000;
+	ReceiveClockAfter(16);
+
+	TEST_ASSERT_EQUAL(MIDI_CLOCK_LOCK_INTERVALS + 1, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+	TEST_ASSERT_EQUAL(4937, MIDIClock_Period);
+	TEST_ASSERT_EQUAL(4702, OCR1A);
+
+	/* Which goes to the host and straight to the free USART, then falls back to the averaged period */
+	UDR1 = 0;
+	TIMER1_COMPA_vect();
+
+	TEST_ASSERT_EQUAL(MIDI_CLOCK_LOCK_INTERVALS + 2, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+	TEST_ASSERT_EQUAL(0xF8, UDR1);
+	TEST_ASSERT_EQUAL(4936, OCR1A);
+
+	/* With the received clock gone, the PLL unlocks rather than run more than one clock ahead */
+	TIMER1_COMPA_vect();
+	TIMER1_COMPA_vect();
+
+	TEST_ASSERT(!(MIDIClock_Locked));
+	TEST_ASSERT_EQUAL(0, TIMSK1);
+	TEST_ASSERT_EQUAL(MIDI_CLOCK_LOCK_INTERVALS + 3, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+
+	/* The late received clock already went out, so is not passed on again */
+	ReceiveClockAfter(20);
+	TEST_ASSERT_EQUAL(MIDI_CLOCK_LOCK_INTERVALS + 3, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+	ReceiveClockAfter(20);
+	TEST_ASSERT_EQUAL(MIDI_CLOCK_LOCK_INTERVALS + 4, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+}
+
+static void Test_MIDI_ClockPLLStoppedByTransport(void)
+{
+	Harness_Reset(MODE_MIDI);
+
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDIClockMode, MIDI_CLOCK_MODE_Regenerate, 0, NULL, 0));
+
+	for (uint8_t i = 0; i <= MIDI_CLOCK_LOCK_INTERVALS; i++)
+	  ReceiveClockAfter(20);
+
+	TEST_ASSERT(MIDIClock_Locked);
+
+	/* A Stop unlocks the PLL and is passed on, and the next clock is passed on as it comes */
+	Harness_ReceiveFromTarget((const uint8_t[]){0xFC}, 1);
+	TEST_ASSERT(!(MIDIClock_Locked));
+
+	ReceiveClockAfter(20);
+	TEST_ASSERT_EQUAL(MIDI_CLOCK_LOCK_INTERVALS + 3, MIDIEventFIFO_GetCount(&USARTtoUSB_Events));
+
+	/* Turning the regeneration off stops it straight away */
+	for (uint8_t i = 0; i < MIDI_CLOCK_LOCK_INTERVALS; i++)
+	  ReceiveClockAfter(20);
+
+	TEST_ASSERT(MIDIClock_Locked);
+	TEST_ASSERT(HostShim_ControlRequest(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE,
+	                                    VENDOR_REQ_SetMIDIClockMode, MIDI_CLOCK_MODE_Off, 0, NULL, 0));
+	TEST_ASSERT(!(MIDIClock_Locked));
+	TEST_ASSERT_EQUAL(0, TCCR1B);
+}
+#endif
+
+int main(void)
+{
+	RUN_TEST(Test_MIDI_TargetToHost);
+	RUN_TEST(Test_MIDI_HostToTarget);
+	RUN_TEST(Test_MIDI_RunningStatusRequest);
+	RUN_TEST(Test_MIDI_RunningStatusAppliedByMainLoop);
+	RUN_TEST(Test_MIDI_SysExToHost);
+	RUN_TEST(Test_MIDI_OverflowRequest);
+	RUN_TEST(Test_MIDI_Unconfigured);
+	RUN_TEST(Test_MIDI_EventWaitsForRoom);
+
+	#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+	RUN_TEST(Test_MIDI_IgnoresCTS);
+	#endif
+
+	RUN_TEST(Test_Serial_HostToTarget);
+	RUN_TEST(Test_Serial_OUTBankWaitsForRoom);
+
+	#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+	RUN_TEST(Test_Serial_FlowControl);
+	#endif
+
+	RUN_TEST(Test_Serial_TargetToHost);
+	RUN_TEST(Test_Serial_FullPacketEndedByZLP);
+	RUN_TEST(Test_Serial_StatsRequestsKeepData);
+	RUN_TEST(Test_Serial_LatencyTimerRequest);
+	RUN_TEST(Test_Serial_LineErrorsNotified);
+	RUN_TEST(Test_Serial_DTRResetsTarget);
+	RUN_TEST(Test_LEDs_StatusRestoredAfterPulse);
+	RUN_TEST(Test_Mode_SwitchReenumerates);
+	RUN_TEST(Test_Mode_RejectsOutOfRangeRequest);
+	RUN_TEST(Test_LEDs_PulseIndependentOfLoopPasses);
+
+	#if defined(ENABLE_PROFILING)
+	RUN_TEST(Test_Profiling_ReadClears);
+	#endif
+
+	#if defined(ENABLE_COMPOSITE_MODE)
+	RUN_TEST(Test_Composite_HostToTarget);
+	RUN_TEST(Test_Composite_TargetToHost);
+	#endif
+
+	#if defined(ENABLE_COMPOSITE_MODE)
+	RUN_TEST(Test_Composite_FlushKeepsFrameInProgress);
+	#endif
+
+	#if defined(ENABLE_MIDI_LATENCY_STATS)
+	RUN_TEST(Test_MIDI_LatencyPastTimestampWrap);
+	#endif
+
+	#if defined(ENABLE_MIDI_SOFT_THRU)
+	RUN_TEST(Test_MIDI_SoftThru);
+	RUN_TEST(Test_MIDI_SoftThruWaitsForHostSysEx);
+	RUN_TEST(Test_MIDI_SoftThruUnconfigured);
+	#endif
+
+	#if defined(ENABLE_MIDI_CLOCK_STATS)
+	RUN_TEST(Test_MIDI_ClockStats);
+	#endif
+
+	#if defined(ENABLE_MIDI_CLOCK_PLL)
+	RUN_TEST(Test_MIDI_ClockPLL);
+	RUN_TEST(Test_MIDI_ClockPLLStoppedByTransport);
+	#endif
+
+	return HostTest_Finish(FIRMWARE_TEST_SUITE);
+}
@@ -0,0 +1,154 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Standalone driver for the libFuzzer style fuzz targets, for use where libFuzzer is not available. It replays
+ *  any input files given on the command line, then runs the target on pseudo-random inputs from a fixed seed, so
+ *  that every run covers the same inputs. The inputs are weighted towards MIDI-like streams: mostly data bytes,
+ *  with channel, System Common, SysEx and Real Time status bytes mixed in.
+ *
+ *  Usage: FuzzDriver [-iterations N] [-seed S] [input files...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t* Data, size_t Size);
+
+/** State of the xorshift pseudo-random generator. */
+static uint32_t RandomState;
+
+/** Returns the next pseudo-random number, from a 32-bit xorshift generator. */
+static uint32_t Random(void)
+{
+	RandomState ^= (RandomState << 13);
+	RandomState ^= (RandomState >> 17);
+	RandomState ^= (RandomState << 5);
+
+	return RandomState;
+}
+
+/** Returns a pseudo-random byte, weighted towards the bytes found in MIDI streams. */
+static uint8_t RandomMIDIByte(void)
+{
+	static const uint8_t StatusBytes[] =
+		{
+			0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0, 0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7,
+			0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF,
+		};
+
+	uint32_t Value = Random();
+
+	switch (Value % 8)
+	{
+		case 0:
+			return (uint8_t)(Value >> 8);
+		case 1:
+		case 2:
+		{
+			uint8_t Status = StatusBytes[(Value >> 8) % sizeof(StatusBytes)];
+
+			/* Channel messages get a random channel, the System messages must keep their low nibble */
+			if (Status < 0xF0)
+			  Status |= ((Value >> 16) & 0x0F);
+
+			return Status;
+		}
+		default:
+			return ((Value >> 8) & 0x7F);
+	}
+}
+
+/** Runs the fuzz target on the contents of a file.
+ *
+ *  \return Zero on success, non-zero if the file could not be read
+ */
+static int ReplayFile(const char* const Path)
+{
+	static uint8_t Input[65536];
+
+	FILE* File = fopen(Path, "rb");
+
+	if (!(File))
+	{
+		perror(Path);
+		return 1;
+	}
+
+	size_t Size = fread(Input, 1, sizeof(Input), File);
+	fclose(File);
+
+	LLVMFuzzerTestOneInput(Input, Size);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned long Iterations = 200000;
+	int           Replayed   = 0;
+
+	RandomState = 0x4D494449;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!(strcmp(argv[i], "-iterations")) && ((i + 1) < argc))
+		  Iterations = strtoul(argv[++i], NULL, 0);
+		else if (!(strcmp(argv[i], "-seed")) && ((i + 1) < argc))
+		  RandomState = (uint32_t)strtoul(argv[++i], NULL, 0) | 1;
+		else if (ReplayFile(argv[i]))
+		  return 1;
+		else
+		  Replayed++;
+	}
+
+	uint8_t       Input[256];
+	unsigned long TotalBytes = 0;
+
+	for (unsigned long Iteration = 0; Iteration < Iterations; Iteration++)
+	{
+		size_t Size = (Random() % sizeof(Input));
+
+		for (size_t i = 0; i < Size; i++)
+		  Input[i] = RandomMIDIByte();
+
+		LLVMFuzzerTestOneInput(Input, Size);
+		TotalBytes += Size;
+	}
+
+	printf("%-24s %lu inputs (%lu bytes) and %d files, no failures\n", "MIDIParserFuzz", Iterations, TotalBytes,
+	       Replayed);
+
+	return 0;
+}
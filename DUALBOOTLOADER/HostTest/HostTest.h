@@ -0,0 +1,121 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Minimal unit test support for the host tests. Each test is a function making checks with \ref TEST_ASSERT()
+ *  and \ref TEST_ASSERT_EQUAL(), run by \ref RUN_TEST(). A failed check is reported with its location and the
+ *  test carries on, so that one run shows every failure.
+ */
+
+#ifndef _HOST_TEST_H_
+#define _HOST_TEST_H_
+
+	/* Includes: */
+		#include <stdio.h>
+		#include <stdint.h>
+		#include <stdbool.h>
+
+	/* Macros: */
+		/** Checks that a condition holds, reporting it as a failure otherwise. */
+		#define TEST_ASSERT(Condition) \
+			HostTest_Check(!!(Condition), #Condition, __FILE__, __LINE__)
+
+		/** Checks that two integer values are equal, reporting both values as a failure otherwise. */
+		#define TEST_ASSERT_EQUAL(Expected, Actual) \
+			HostTest_CheckEqual((long)(Expected), (long)(Actual), #Expected, #Actual, __FILE__, __LINE__)
+
+		/** Runs a test function, counting it as failed if any of its checks fail. */
+		#define RUN_TEST(Test)  HostTest_Run(Test, #Test)
+
+	/* Global Variables: */
+		static unsigned HostTest_Tests;
+		static unsigned HostTest_Failures;
+		static unsigned HostTest_CheckFailures;
+
+	/* Inline Functions: */
+		static inline void HostTest_Check(const bool Passed,
+		                                  const char* const Condition,
+		                                  const char* const File,
+		                                  const int Line)
+		{
+			if (!(Passed))
+			{
+				printf("%s:%d: check failed: %s\n", File, Line, Condition);
+				HostTest_CheckFailures++;
+			}
+		}
+
+		static inline void HostTest_CheckEqual(const long Expected,
+		                                       const long Actual,
+		                                       const char* const ExpectedText,
+		                                       const char* const ActualText,
+		                                       const char* const File,
+		                                       const int Line)
+		{
+			if (Expected != Actual)
+			{
+				printf("%s:%d: check failed: %s == %s (%ld != %ld)\n", File, Line, ExpectedText, ActualText,
+				       Expected, Actual);
+				HostTest_CheckFailures++;
+			}
+		}
+
+		static inline void HostTest_Run(void (*const Test)(void),
+		                                const char* const Name)
+		{
+			unsigned FailuresBefore = HostTest_CheckFailures;
+
+			Test();
+
+			HostTest_Tests++;
+
+			if (HostTest_CheckFailures != FailuresBefore)
+			{
+				printf("FAIL %s\n", Name);
+				HostTest_Failures++;
+			}
+		}
+
+		/** Prints the summary of a test run.
+		 *
+		 *  \param[in] Suite  Name of the test suite
+		 *
+		 *  \return Process exit code, zero if every test passed
+		 */
+		static inline int HostTest_Finish(const char* const Suite)
+		{
+			printf("%-24s %u tests, %u failed\n", Suite, HostTest_Tests, HostTest_Failures);
+
+			return (HostTest_Failures ? 1 : 0);
+		}
+
+#endif
@@ -0,0 +1,290 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Reference copy of the serial MIDI parser as it was before the status table in Lib/MIDIParser.c replaced it,
+ *  taken from the USART receive ISR of the firmware with its globals gathered into a state structure. It classifies
+ *  bytes with the getTypeFromStatusByte() and isChannelMessage() compare chains which the firmware used, kept here
+ *  with the other MIDI utility functions of that time. It is only built into the host tests, to check the table
+ *  driven parser against it and to compare their speed.
+ */
+
+#include "LegacyMIDIParser.h"
+
+/** Queues a complete message, with the CIN taken from the high nibble of its type. */
+static void Legacy_QueueEvent(MIDIEventFIFO_t* const FIFO,
+                              const uint8_t Data1,
+                              const uint8_t Data2,
+                              const uint8_t Data3)
+{
+	MIDI_EventPacket_t CompleteMessage =
+		{
+			.Event = MIDI_EVENT(0, getTypeFromStatusByte(Data1)),
+			.Data1 = Data1,
+			.Data2 = Data2,
+			.Data3 = Data3,
+		};
+
+	MIDIEventFIFO_Push(FIFO, &CompleteMessage);
+}
+
+/** Queues a SysEx packet made up of the first bytes of the pending message buffer. */
+static void Legacy_QueueSysEx(LegacyMIDIParser_t* const Parser,
+                              MIDIEventFIFO_t* const FIFO,
+                              const uint8_t Length,
+                              const bool EndOfSysEx)
+{
+	MIDI_EventPacket_t SysExPacket =
+		{
+			.Event = MIDI_EVENT(0, EndOfSysEx ? (MIDI_COMMAND_SYSEX_START_3BYTE + (Length << 4))
+			                                  : MIDI_COMMAND_SYSEX_START_3BYTE),
+			.Data1 = Parser->PendingMessage[0],
+			.Data2 = (Length > 1) ? Parser->PendingMessage[1] : 0,
+			.Data3 = (Length > 2) ? Parser->PendingMessage[2] : 0,
+		};
+
+	MIDIEventFIFO_Push(FIFO, &SysExPacket);
+}
+
+/** Resets the legacy parser, as the firmware's zeroed globals were at power on. */
+void LegacyMIDIParser_Init(LegacyMIDIParser_t* const Parser)
+{
+	*Parser = (LegacyMIDIParser_t){ .RunningStatus = InvalidType };
+}
+
+/** Processes one byte received from the serial port, queueing the USB-MIDI event packets it completes. */
+void LegacyMIDIParser_ProcessByte(LegacyMIDIParser_t* const Parser,
+                                  MIDIEventFIFO_t* const FIFO,
+                                  const uint8_t ReceivedByte)
+{
+	if (Parser->SysExActive)
+	{
+		if (ReceivedByte >= Clock)
+		{
+			// Real Time messages may be interleaved with the SysEx data without ending it
+			Legacy_QueueEvent(FIFO, ReceivedByte, 0, 0);
+			return;
+		}
+
+		if (ReceivedByte < 0x80)
+		{
+			Parser->PendingMessage[Parser->PendingMessageIndex++] = ReceivedByte;
+
+			if (Parser->PendingMessageIndex == 3)
+			{
+				Legacy_QueueSysEx(Parser, FIFO, 3, false);
+				Parser->PendingMessageIndex = 0;
+			}
+
+			return;
+		}
+
+		// Any other status byte ends the SysEx, with the EOX being sent as its last byte. A SysEx cut short by
+		// another status byte is given the EOX it lacks, so that the host never sees an end packet without one
+		Parser->PendingMessage[Parser->PendingMessageIndex++] = 0xF7;
+		Legacy_QueueSysEx(Parser, FIFO, Parser->PendingMessageIndex, true);
+
+		Parser->SysExActive         = false;
+		Parser->PendingMessageIndex = 0;
+
+		if (ReceivedByte == 0xF7)
+		  return;
+
+		// Otherwise the status byte starts a new message of its own
+	}
+
+	if (Parser->PendingMessageIndex == 0)
+	{
+		// Start a new pending message
+		Parser->PendingMessage[0] = ReceivedByte;
+
+		// Check for running status first, if the status byte is not received prepend it to the pending message
+		if (isChannelMessage(getTypeFromStatusByte(Parser->RunningStatus)) && (ReceivedByte < 0x80))
+		{
+			Parser->PendingMessage[0]   = Parser->RunningStatus;
+			Parser->PendingMessage[1]   = ReceivedByte;
+			Parser->PendingMessageIndex = 1;
+		}
+
+		switch (getTypeFromStatusByte(Parser->PendingMessage[0]))
+		{
+			case Start:
+			case Continue:
+			case Stop:
+			case Clock:
+			case ActiveSensing:
+			case SystemReset:
+			case TuneRequest:
+				Legacy_QueueEvent(FIFO, Parser->PendingMessage[0], 0, 0);
+
+				Parser->PendingMessageIndex          = 0;
+				Parser->PendingMessageExpectedLength = 0;
+				return;
+
+			case ProgramChange:
+			case AfterTouchChannel:
+			case TimeCodeQuarterFrame:
+			case SongSelect:
+				Parser->PendingMessageExpectedLength = 2;
+				break;
+
+			case NoteOn:
+			case NoteOff:
+			case ControlChange:
+			case PitchBend:
+			case AfterTouchPoly:
+			case SongPosition:
+				Parser->PendingMessageExpectedLength = 3;
+				break;
+
+			case SystemExclusive:
+				// Streamed as it arrives, see above. SysEx also cancels the running status
+				Parser->SysExActive         = true;
+				Parser->RunningStatus       = InvalidType;
+				Parser->PendingMessageIndex = 1;
+				return;
+
+			default:
+				break;
+		}
+
+		if (Parser->PendingMessageIndex >= (Parser->PendingMessageExpectedLength - 1))
+		{
+			Legacy_QueueEvent(FIFO, Parser->PendingMessage[0], Parser->PendingMessage[1],
+			                  (Parser->PendingMessageExpectedLength == 3) ? Parser->PendingMessage[2] : 0);
+
+			Parser->PendingMessageIndex          = 0;
+			Parser->PendingMessageExpectedLength = 0;
+			return;
+		}
+		else
+		{
+			Parser->PendingMessageIndex++;
+		}
+	}
+	else
+	{
+		// Status bytes in the middle of an uncompleted message are allowed only for Real Time messages and SysEx
+		if (ReceivedByte >= 0x80)
+		{
+			switch (ReceivedByte)
+			{
+				case Clock:
+				case Start:
+				case Continue:
+				case Stop:
+				case ActiveSensing:
+				case SystemReset:
+					// The pending message is left as is, to be completed by the following bytes
+					Legacy_QueueEvent(FIFO, ReceivedByte, 0, 0);
+					return;
+
+				case SystemExclusive:
+					// The incomplete message is abandoned, and the SysEx is streamed as it arrives
+					Parser->PendingMessage[0]            = ReceivedByte;
+					Parser->PendingMessageIndex          = 1;
+					Parser->PendingMessageExpectedLength = 0;
+					Parser->SysExActive                  = true;
+					Parser->RunningStatus                = InvalidType;
+					return;
+
+				default:
+					break;
+			}
+		}
+
+		Parser->PendingMessage[Parser->PendingMessageIndex] = ReceivedByte;
+
+		if (Parser->PendingMessageIndex >= (Parser->PendingMessageExpectedLength - 1))
+		{
+			Legacy_QueueEvent(FIFO, Parser->PendingMessage[0], Parser->PendingMessage[1],
+			                  (Parser->PendingMessageExpectedLength == 3) ? Parser->PendingMessage[2] : 0);
+
+			Parser->PendingMessageIndex          = 0;
+			Parser->PendingMessageExpectedLength = 0;
+
+			// Running status is kept from channel messages only
+			Parser->RunningStatus = isChannelMessage(getTypeFromStatusByte(Parser->PendingMessage[0])) ?
+			                        Parser->PendingMessage[0] : InvalidType;
+		}
+		else
+		{
+			Parser->PendingMessageIndex++;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MIDI Utility Functions
+///////////////////////////////////////////////////////////////////////////////
+
+MidiMessageType getStatus(MidiMessageType inType, uint8_t inChannel) 
+{
+    return ((uint8_t)inType | ((inChannel - 1) & 0x0f));
+}
+
+MidiMessageType getTypeFromStatusByte(uint8_t inStatus)
+{
+    if ((inStatus  < 0x80) ||
+        (inStatus == 0xf4) ||
+        (inStatus == 0xf5) ||
+        (inStatus == 0xf9) ||
+        (inStatus == 0xfD))
+    {
+        // Data bytes and undefined.
+        return InvalidType;
+    }
+
+    if (inStatus < 0xf0)
+    {
+        // Channel message, remove channel nibble.
+        return (inStatus & 0xf0);
+    }
+
+    return inStatus;
+}
+
+uint8_t getChannelFromStatusByte(uint8_t inStatus)
+{
+	return (inStatus & 0x0f) + 1;
+}
+
+bool isChannelMessage(uint8_t inType)
+{
+    return (inType == NoteOff           ||
+            inType == NoteOn            ||
+            inType == ControlChange     ||
+            inType == AfterTouchPoly    ||
+            inType == AfterTouchChannel ||
+            inType == PitchBend         ||
+            inType == ProgramChange);
+}
@@ -0,0 +1,67 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Header file for LegacyMIDIParser.c.
+ */
+
+#ifndef _LEGACY_MIDI_PARSER_H_
+#define _LEGACY_MIDI_PARSER_H_
+
+	/* Includes: */
+		#include "../Lib/MIDIParser.h"
+
+	/* Type Defines: */
+		/** Type define for the state of the legacy parser, as kept in globals by the firmware before the status
+		 *  table was introduced.
+		 */
+		typedef struct
+		{
+			uint8_t RunningStatus; /**< Running status of the received stream, or \c InvalidType */
+			uint8_t PendingMessage[3]; /**< Bytes of the message being received */
+			uint8_t PendingMessageExpectedLength; /**< Total length of the message being received */
+			uint8_t PendingMessageIndex; /**< Number of bytes of the message received so far */
+			bool    SysExActive; /**< Whether a SysEx message is being streamed */
+		} LegacyMIDIParser_t;
+
+	/* Function Prototypes: */
+		void LegacyMIDIParser_Init(LegacyMIDIParser_t* const Parser);
+		void LegacyMIDIParser_ProcessByte(LegacyMIDIParser_t* const Parser,
+		                                  MIDIEventFIFO_t* const FIFO,
+		                                  const uint8_t ReceivedByte);
+
+		MidiMessageType getStatus(MidiMessageType inType, uint8_t inChannel);
+		MidiMessageType getTypeFromStatusByte(uint8_t inStatus);
+		uint8_t getChannelFromStatusByte(uint8_t inStatus);
+		bool isChannelMessage(uint8_t inType);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Throughput report for the serial MIDI stream parser in Lib/MIDIParser.c. Each scenario builds a stream of
+ *  serial MIDI bytes, feeds it through the parser several times while draining the event FIFO as the firmware's
+ *  main loop does, and prints the best rate seen, alongside that of the legacy parser the status table replaced.
+ *  The figures are host figures, useful for comparing parser changes against each other; the AVR cycle counts
+ *  come from the ENABLE_PROFILING build of the firmware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../Lib/MIDIParser.h"
+#include "LegacyMIDIParser.h"
+
+/** Number of serial MIDI bytes in each scenario's stream. */
+#define BENCH_STREAM_SIZE    (1UL << 20)
+
+/** Number of timed passes over each stream, of which the fastest is reported. */
+#define BENCH_PASSES         8
+
+/** Serial MIDI stream of the scenario being run. */
+static uint8_t Stream[BENCH_STREAM_SIZE];
+
+/** Fills the stream with Note On and Note Off messages, each sent with its status byte. */
+static void Build_NoteFlood(void)
+{
+	for (uint32_t i = 0; i < BENCH_STREAM_SIZE; i++)
+	{
+		switch (i % 3)
+		{
+			case 0:
+				Stream[i] = ((i & 0x08) ? NoteOn : NoteOff) | ((i >> 4) & 0x0F);
+				break;
+			case 1:
+				Stream[i] = ((i >> 2) & 0x7F);
+				break;
+			default:
+				Stream[i] = 0x64;
+				break;
+		}
+	}
+}
+
+/** Fills the stream with Control Change messages under a single running status. */
+static void Build_RunningStatus(void)
+{
+	Stream[0] = (ControlChange | 0x02);
+
+	for (uint32_t i = 1; i < BENCH_STREAM_SIZE; i++)
+	  Stream[i] = ((i * 7) & 0x7F);
+}
+
+/** Fills the stream with 256 byte SysEx messages, as sent by a patch dump. */
+static void Build_SysExBulk(void)
+{
+	for (uint32_t i = 0; i < BENCH_STREAM_SIZE; i++)
+	{
+		switch (i % 256)
+		{
+			case 0:
+				Stream[i] = SystemExclusive;
+				break;
+			case 255:
+				Stream[i] = 0xF7;
+				break;
+			default:
+				Stream[i] = (i & 0x7F);
+				break;
+		}
+	}
+}
+
+/** Fills the stream with running status notes, with a Timing Clock message interleaved every few bytes. */
+static void Build_ClockAndNotes(void)
+{
+	uint32_t DataBytes = 0;
+
+	Stream[0] = NoteOn;
+
+	for (uint32_t i = 1; i < BENCH_STREAM_SIZE; i++)
+	  Stream[i] = ((i % 5) == 0) ? Clock : ((DataBytes++ * 13) & 0x7F);
+}
+
+/** Returns the current monotonic time in seconds. */
+static double Bench_Now(void)
+{
+	struct timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+
+	return (Now.tv_sec + (Now.tv_nsec / 1e9));
+}
+
+/** Feeds the stream through one of the parsers several times, returning the fastest time taken.
+ *
+ *  \param[in]  Legacy      Whether to time the legacy parser instead of the table driven one
+ *  \param[out] EventCount  Location where the number of events produced is to be stored
+ *
+ *  \return Fastest time taken to parse the stream, in seconds
+ */
+static double Bench_Time(const bool Legacy,
+                         uint32_t* const EventCount)
+{
+	static MIDIParser_t       Parser;
+	static LegacyMIDIParser_t LegacyParser;
+	static MIDIEventFIFO_t    Events;
+
+	double BestTime = 0;
+
+	for (uint8_t Pass = 0; Pass < BENCH_PASSES; Pass++)
+	{
+		MIDI_EventPacket_t Event;
+
+		MIDIParser_Init(&Parser);
+		LegacyMIDIParser_Init(&LegacyParser);
+		MIDIEventFIFO_Init(&Events);
+		*EventCount = 0;
+
+		double StartTime = Bench_Now();
+
+		for (uint32_t i = 0; i < BENCH_STREAM_SIZE; i++)
+		{
+			if (Legacy)
+			  LegacyMIDIParser_ProcessByte(&LegacyParser, &Events, Stream[i]);
+			else
+			  MIDIParser_ProcessByte(&Parser, &Events, NULL, Stream[i]);
+
+			/* Drain as the main loop does, which gets round once every few bytes at full rate */
+			if ((i & 0x03) == 0x03)
+			{
+				while (MIDIEventFIFO_Pop(&Events, &Event))
+				  (*EventCount)++;
+			}
+		}
+
+		double Elapsed = (Bench_Now() - StartTime);
+
+		if (!(Pass) || (Elapsed < BestTime))
+		  BestTime = Elapsed;
+
+		if (Events.Overflows)
+		{
+			printf("Event FIFO overflowed\n");
+			exit(1);
+		}
+	}
+
+	return BestTime;
+}
+
+/** Builds and runs one scenario, printing the throughput of the table driven parser, the time per byte of both
+ *  parsers and the number of events produced.
+ */
+static void Bench_Run(const char* const Name,
+                      void (*const Build)(void))
+{
+	uint32_t EventCount;
+	uint32_t LegacyEventCount;
+
+	Build();
+
+	double Time       = Bench_Time(false, &EventCount);
+	double LegacyTime = Bench_Time(true,  &LegacyEventCount);
+
+	printf("%-24s %8.1f MB/s %6.2f ns/byte (legacy %6.2f ns/byte) %8lu events\n", Name,
+	       (BENCH_STREAM_SIZE / Time / 1e6), (Time * 1e9 / BENCH_STREAM_SIZE),
+	       (LegacyTime * 1e9 / BENCH_STREAM_SIZE), (unsigned long)EventCount);
+
+	/* The scenarios are well-formed apart from their System Common CINs, so both parsers give as many events */
+	if (EventCount != LegacyEventCount)
+	{
+		printf("%-24s legacy parser gave %lu events\n", Name, (unsigned long)LegacyEventCount);
+		exit(1);
+	}
+}
+
+int main(void)
+{
+	Bench_Run("Note flood",      Build_NoteFlood);
+	Bench_Run("Running status",  Build_RunningStatus);
+	Bench_Run("SysEx bulk",      Build_SysExBulk);
+	Bench_Run("Clock and notes", Build_ClockAndNotes);
+
+	return 0;
+}
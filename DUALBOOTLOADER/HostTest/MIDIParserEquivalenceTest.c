@@ -0,0 +1,353 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Equivalence tests of the table driven serial MIDI parser in Lib/MIDIParser.c against the compare chain parser
+ *  it replaced, kept in LegacyMIDIParser.c. The status table is checked against the old classification for every
+ *  byte value, and both parsers are run on every well-formed stream of up to four messages drawn from a set
+ *  covering each kind of message, with and without running status and with a Timing Clock interleaved at each
+ *  position. Their event packets must match, except for the Code Index Numbers of the System Common messages
+ *  which the old parser got wrong. Malformed input is handled differently on purpose, as listed in the last test.
+ */
+
+#include "HostTest.h"
+
+#include <string.h>
+
+/* The status table is private to the parser, so the parser is built into this test directly */
+#include "../Lib/MIDIParser.c"
+#include "LegacyMIDIParser.h"
+
+/** Largest number of bytes in a generated stream. */
+#define MAX_STREAM_LENGTH    40
+
+/** Largest number of messages in a generated stream. */
+#define MAX_STREAM_MESSAGES  4
+
+/** Type define for one of the messages streams are made up of. */
+typedef struct
+{
+	uint8_t Length; /**< Number of bytes in the message, including its status byte */
+	uint8_t Bytes[12]; /**< Bytes of the message */
+} Message_t;
+
+/** Messages the generated streams are made up of, one or more of each kind. The channel messages on the same
+ *  status byte exercise running status.
+ */
+static const Message_t Messages[] =
+	{
+		{3, {NoteOff | 0x03, 0x10, 0x20}},
+		{3, {NoteOn  | 0x00, 0x3C, 0x7F}},
+		{3, {NoteOn  | 0x00, 0x3C, 0x00}},
+		{3, {AfterTouchPoly | 0x01, 0x3C, 0x40}},
+		{3, {ControlChange | 0x02, 0x07, 0x64}},
+		{2, {ProgramChange | 0x03, 0x05}},
+		{2, {AfterTouchChannel | 0x04, 0x30}},
+		{3, {PitchBend | 0x0F, 0x00, 0x40}},
+		{2, {TimeCodeQuarterFrame, 0x23}},
+		{3, {SongPosition, 0x10, 0x20}},
+		{2, {SongSelect, 0x05}},
+		{1, {TuneRequest}},
+		{2, {SystemExclusive, 0xF7}},
+		{3, {SystemExclusive, 0x01, 0xF7}},
+		{4, {SystemExclusive, 0x01, 0x02, 0xF7}},
+		{5, {SystemExclusive, 0x01, 0x02, 0x03, 0xF7}},
+		{6, {SystemExclusive, 0x01, 0x02, 0x03, 0x04, 0xF7}},
+		{7, {SystemExclusive, 0x01, 0x02, 0x03, 0x04, 0x05, 0xF7}},
+		{8, {SystemExclusive, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0xF7}},
+		{1, {Clock}},
+		{1, {Start}},
+		{1, {Continue}},
+		{1, {Stop}},
+		{1, {ActiveSensing}},
+		{1, {SystemReset}},
+	};
+
+/** Number of streams checked, and of those whose events differed. */
+static uint32_t StreamsChecked;
+static uint32_t StreamsDiffering;
+
+/** Retrieves the CIN the old parser should have given a complete message, from the first byte of its packet. */
+static uint8_t CorrectedCIN(const MIDI_EventPacket_t* const Event)
+{
+	switch (Event->Data1)
+	{
+		case TimeCodeQuarterFrame:
+		case SongSelect:
+			return 0x2;
+		case SongPosition:
+			return 0x3;
+		case TuneRequest:
+			return 0x5;
+		default:
+			return (Event->Event & 0x0F);
+	}
+}
+
+/** Runs both parsers on one stream, reporting the stream if their event packets differ. */
+static void CheckStream(const uint8_t* const Stream,
+                        const uint8_t Length)
+{
+	static MIDIParser_t       Parser;
+	static LegacyMIDIParser_t LegacyParser;
+	static MIDIEventFIFO_t    Events;
+	static MIDIEventFIFO_t    LegacyEvents;
+
+	MIDIParser_Init(&Parser);
+	LegacyMIDIParser_Init(&LegacyParser);
+
+	bool Differs = false;
+
+	for (uint8_t i = 0; i < Length; i++)
+	{
+		MIDIEventFIFO_Init(&Events);
+		MIDIEventFIFO_Init(&LegacyEvents);
+
+		MIDIParser_ProcessByte(&Parser, &Events, NULL, Stream[i]);
+		LegacyMIDIParser_ProcessByte(&LegacyParser, &LegacyEvents, Stream[i]);
+
+		MIDI_EventPacket_t Event;
+		MIDI_EventPacket_t LegacyEvent;
+
+		while (MIDIEventFIFO_Pop(&LegacyEvents, &LegacyEvent))
+		{
+			LegacyEvent.Event = ((LegacyEvent.Event & 0xF0) | CorrectedCIN(&LegacyEvent));
+
+			if (!(MIDIEventFIFO_Pop(&Events, &Event)) || memcmp(&Event, &LegacyEvent, sizeof(Event)))
+			  Differs = true;
+		}
+
+		if (MIDIEventFIFO_GetCount(&Events))
+		  Differs = true;
+	}
+
+	StreamsChecked++;
+
+	if (Differs)
+	{
+		/* Only the first few are printed, the count tells how many there are */
+		if (StreamsDiffering++ < 5)
+		{
+			printf("Streams differ:");
+
+			for (uint8_t i = 0; i < Length; i++)
+			  printf(" %02X", Stream[i]);
+
+			printf("\n");
+		}
+	}
+}
+
+/** Checks a stream as it is, and with a Timing Clock interleaved before each of its bytes. */
+static void CheckStreamWithClocks(const uint8_t* const Stream,
+                                  const uint8_t Length)
+{
+	uint8_t Interleaved[MAX_STREAM_LENGTH + 1];
+
+	CheckStream(Stream, Length);
+
+	for (uint8_t Position = 0; Position < Length; Position++)
+	{
+		memcpy(Interleaved, Stream, Position);
+		Interleaved[Position] = Clock;
+		memcpy(&Interleaved[Position + 1], &Stream[Position], (Length - Position));
+
+		CheckStream(Interleaved, (Length + 1));
+	}
+}
+
+/** Checks every stream which starts with the given bytes and has up to the given number of messages more. A
+ *  channel message on the running status is added both with and without its status byte.
+ */
+static void CheckStreamsFrom(uint8_t* const Stream,
+                             const uint8_t Length,
+                             const uint8_t MessagesLeft,
+                             const uint8_t RunningStatus)
+{
+	if (Length)
+	  CheckStreamWithClocks(Stream, Length);
+
+	if (!(MessagesLeft))
+	  return;
+
+	for (uint8_t i = 0; i < (sizeof(Messages) / sizeof(Messages[0])); i++)
+	{
+		const Message_t* Message = &Messages[i];
+		uint8_t          Status  = Message->Bytes[0];
+		uint8_t          NextRunningStatus;
+
+		if (Status < SystemExclusive)
+		  NextRunningStatus = Status;
+		else if (Status >= Clock)
+		  NextRunningStatus = RunningStatus;
+		else
+		  NextRunningStatus = InvalidType;
+
+		memcpy(&Stream[Length], Message->Bytes, Message->Length);
+		CheckStreamsFrom(Stream, (Length + Message->Length), (MessagesLeft - 1), NextRunningStatus);
+
+		if (Status == RunningStatus)
+		{
+			memcpy(&Stream[Length], &Message->Bytes[1], (Message->Length - 1));
+			CheckStreamsFrom(Stream, (Length + Message->Length - 1), (MessagesLeft - 1), NextRunningStatus);
+		}
+	}
+}
+
+static void Test_UtilityFunctions(void)
+{
+	TEST_ASSERT_EQUAL(NoteOn,      getTypeFromStatusByte(0x93));
+	TEST_ASSERT_EQUAL(PitchBend,   getTypeFromStatusByte(0xEF));
+	TEST_ASSERT_EQUAL(Clock,       getTypeFromStatusByte(0xF8));
+	TEST_ASSERT_EQUAL(InvalidType, getTypeFromStatusByte(0x40));
+	TEST_ASSERT_EQUAL(InvalidType, getTypeFromStatusByte(0xF4));
+	TEST_ASSERT_EQUAL(InvalidType, getTypeFromStatusByte(0xFD));
+
+	TEST_ASSERT_EQUAL(4,    getChannelFromStatusByte(0x93));
+	TEST_ASSERT_EQUAL(0x93, getStatus(NoteOn, 4));
+
+	TEST_ASSERT(isChannelMessage(ProgramChange));
+	TEST_ASSERT(!(isChannelMessage(SystemExclusive)));
+	TEST_ASSERT(!(isChannelMessage(Clock)));
+}
+
+static void Test_StatusTable(void)
+{
+	for (uint16_t Byte = 0; Byte <= 0xFF; Byte++)
+	{
+		uint8_t Entry = pgm_read_byte(&MIDI_StatusTable[Byte]);
+		uint8_t Type  = getTypeFromStatusByte(Byte);
+		uint8_t Length;
+		uint8_t CIN   = (Type >> 4);
+
+		/* Message lengths as given by the old parser's switch on the message type */
+		switch (Type)
+		{
+			case Start:
+			case Continue:
+			case Stop:
+			case Clock:
+			case ActiveSensing:
+			case SystemReset:
+			case TuneRequest:
+				Length = 1;
+				break;
+			case ProgramChange:
+			case AfterTouchChannel:
+			case TimeCodeQuarterFrame:
+			case SongSelect:
+				Length = 2;
+				break;
+			case NoteOn:
+			case NoteOff:
+			case ControlChange:
+			case PitchBend:
+			case AfterTouchPoly:
+			case SongPosition:
+				Length = 3;
+				break;
+			default:
+				Length = 0;
+				break;
+		}
+
+		/* The SysEx start and the System Common messages have CINs of their own, rather than the status nibble */
+		if (Type == SystemExclusive)
+		  CIN = MIDI_CIN_SYSEX_START;
+		else if ((Type > SystemExclusive) && (Type < Clock))
+		  CIN = ((Length == 3) ? 0x3 : ((Length == 2) ? 0x2 : ((Length == 1) ? 0x5 : 0x0)));
+
+		TEST_ASSERT_EQUAL(CIN,    (Entry & MIDI_STATUS_CIN_MASK));
+		TEST_ASSERT_EQUAL(Length, ((Entry & MIDI_STATUS_LENGTH_MASK) >> MIDI_STATUS_LENGTH_SHIFT));
+		TEST_ASSERT_EQUAL(isChannelMessage(Type), !!(Entry & MIDI_STATUS_RUNNING));
+		TEST_ASSERT_EQUAL((Byte >= Clock),        !!(Entry & MIDI_STATUS_REALTIME));
+	}
+}
+
+static void Test_WellFormedStreams(void)
+{
+	uint8_t Stream[MAX_STREAM_LENGTH];
+
+	StreamsChecked   = 0;
+	StreamsDiffering = 0;
+
+	CheckStreamsFrom(Stream, 0, MAX_STREAM_MESSAGES, InvalidType);
+
+	printf("%-24s %lu streams checked\n", "MIDIParserEquivalence", (unsigned long)StreamsChecked);
+
+	TEST_ASSERT(StreamsChecked > 1000000);
+	TEST_ASSERT_EQUAL(0, StreamsDiffering);
+}
+
+/** Runs both parsers on a malformed stream, returning whether they give different event packets. */
+static bool MalformedStreamDiffers(const uint8_t* const Stream,
+                                   const uint8_t Length)
+{
+	uint32_t DifferingBefore = StreamsDiffering;
+
+	/* The difference is expected, so it is counted without being printed */
+	StreamsDiffering = 5;
+	CheckStream(Stream, Length);
+
+	bool Differs = (StreamsDiffering != 5);
+
+	StreamsDiffering = DifferingBefore;
+
+	return Differs;
+}
+
+#define MALFORMED_DIFFERS(...)  MalformedStreamDiffers((const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}))
+
+static void Test_MalformedStreams(void)
+{
+	/* A stray data byte gave a CIN 0 packet, and is now dropped */
+	TEST_ASSERT(MALFORMED_DIFFERS(0x40));
+
+	/* A status byte in the middle of a message was stored as data, and now starts a new message */
+	TEST_ASSERT(MALFORMED_DIFFERS(NoteOn, 0x40, NoteOff, 0x40, 0x00));
+
+	/* An undefined status byte was stored as data, and now cancels the running status */
+	TEST_ASSERT(MALFORMED_DIFFERS(NoteOn, 0x40, 0x7F, 0xF4, 0x41, 0x7F));
+
+	/* A Tune Request left the running status in place, and now cancels it like any System Common message */
+	TEST_ASSERT(MALFORMED_DIFFERS(NoteOn, 0x40, 0x7F, TuneRequest, 0x41, 0x7F));
+}
+
+int main(void)
+{
+	RUN_TEST(Test_UtilityFunctions);
+	RUN_TEST(Test_StatusTable);
+	RUN_TEST(Test_WellFormedStreams);
+	RUN_TEST(Test_MalformedStreams);
+
+	return HostTest_Finish("MIDIParserEquivalence");
+}
@@ -0,0 +1,196 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Fuzz target for the serial MIDI stream parser in Lib/MIDIParser.c, in the libFuzzer style. Every input is
+ *  parsed into a main and an echo event FIFO, and each queued event packet is checked to be well formed for its
+ *  Code Index Number. Every Real Time byte must come out as exactly one event, and both FIFOs must receive the
+ *  same events. Built with clang's -fsanitize=fuzzer, this file is the whole fuzzer; otherwise FuzzDriver.c runs
+ *  it on generated inputs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "../Lib/MIDIParser.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t* Data, size_t Size);
+
+/** Reports a broken invariant along with the offending event, and aborts so that the fuzzer keeps the input. */
+static void Fuzz_Fail(const char* const Reason,
+                      const MIDI_EventPacket_t* const Event,
+                      const size_t Offset)
+{
+	fprintf(stderr, "MIDIParserFuzz: %s at input byte %zu: event %02X %02X %02X %02X\n", Reason, Offset,
+	        Event->Event, Event->Data1, Event->Data2, Event->Data3);
+	abort();
+}
+
+/** Checks whether a byte is a MIDI data byte. */
+static inline bool Fuzz_IsData(const uint8_t Byte)
+{
+	return !(Byte & 0x80);
+}
+
+/** Checks whether a byte is a defined System Real Time status byte, which the parser passes on as an event. */
+static inline bool Fuzz_IsRealTime(const uint8_t Byte)
+{
+	return ((Byte == Clock) || (Byte == Start) || (Byte == Continue) || (Byte == Stop) ||
+	        (Byte == ActiveSensing) || (Byte == SystemReset));
+}
+
+/** Checks one event packet queued by the parser against the rules for its Code Index Number. */
+static void Fuzz_CheckEvent(const MIDI_EventPacket_t* const Event,
+                            const size_t Offset)
+{
+	uint8_t CIN = (Event->Event & 0x0F);
+
+	if (Event->Event & 0xF0)
+	  Fuzz_Fail("non-zero cable number", Event, Offset);
+
+	switch (CIN)
+	{
+		case 0x2:
+			if (((Event->Data1 != TimeCodeQuarterFrame) && (Event->Data1 != SongSelect)) ||
+			    !(Fuzz_IsData(Event->Data2)) || Event->Data3)
+			{
+				Fuzz_Fail("bad two byte System Common message", Event, Offset);
+			}
+			break;
+		case 0x3:
+			if ((Event->Data1 != SongPosition) || !(Fuzz_IsData(Event->Data2)) || !(Fuzz_IsData(Event->Data3)))
+			  Fuzz_Fail("bad three byte System Common message", Event, Offset);
+			break;
+		case 0x4:
+			if (!((Event->Data1 == SystemExclusive) || Fuzz_IsData(Event->Data1)) ||
+			    !(Fuzz_IsData(Event->Data2)) || !(Fuzz_IsData(Event->Data3)))
+			{
+				Fuzz_Fail("bad SysEx start or continuation", Event, Offset);
+			}
+			break;
+		case 0x5:
+		case 0x6:
+		case 0x7:
+		{
+			/* The bytes of a SysEx end are data, except for the F0 of a short SysEx at the start and the EOX
+			 * at the end; a lone Tune Request shares CIN 0x5 */
+			const uint8_t* Bytes  = &Event->Data1;
+			uint8_t        Length = (CIN - 0x4);
+
+			if ((CIN == 0x5) && (Event->Data1 == TuneRequest))
+			  Length = 0;
+
+			for (uint8_t i = 0; i < Length; i++)
+			{
+				if (!(Fuzz_IsData(Bytes[i]) || ((i == 0) && (Bytes[i] == SystemExclusive)) ||
+				      ((i == (Length - 1)) && (Bytes[i] == 0xF7))))
+				{
+					Fuzz_Fail("bad SysEx end", Event, Offset);
+				}
+			}
+
+			for (uint8_t i = (Length ? Length : 1); i < 3; i++)
+			{
+				if (Bytes[i])
+				  Fuzz_Fail("unused SysEx end byte not cleared", Event, Offset);
+			}
+
+			break;
+		}
+		case 0x8:
+		case 0x9:
+		case 0xA:
+		case 0xB:
+		case 0xE:
+			if (((Event->Data1 >> 4) != CIN) || !(Fuzz_IsData(Event->Data2)) || !(Fuzz_IsData(Event->Data3)))
+			  Fuzz_Fail("bad three byte channel message", Event, Offset);
+			break;
+		case 0xC:
+		case 0xD:
+			if (((Event->Data1 >> 4) != CIN) || !(Fuzz_IsData(Event->Data2)) || Event->Data3)
+			  Fuzz_Fail("bad two byte channel message", Event, Offset);
+			break;
+		case 0xF:
+			if (!(Fuzz_IsRealTime(Event->Data1)) || Event->Data2 || Event->Data3)
+			  Fuzz_Fail("bad Real Time message", Event, Offset);
+			break;
+		default:
+			Fuzz_Fail("reserved Code Index Number", Event, Offset);
+			break;
+	}
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* Data,
+                           size_t Size)
+{
+	static MIDIParser_t    Parser;
+	static MIDIEventFIFO_t Events;
+	static MIDIEventFIFO_t EchoEvents;
+
+	MIDIParser_Init(&Parser);
+	MIDIEventFIFO_Init(&Events);
+	MIDIEventFIFO_Init(&EchoEvents);
+
+	for (size_t Offset = 0; Offset < Size; Offset++)
+	{
+		MIDIParser_ProcessByte(&Parser, &Events, &EchoEvents, Data[Offset]);
+
+		/* No byte may queue more events than fit, so draining after each byte must never lose any */
+		if (Events.Overflows || EchoEvents.Overflows)
+		  Fuzz_Fail("event FIFO overflow", &Events.Events[0], Offset);
+
+		uint8_t            RealTimeEvents = 0;
+		MIDI_EventPacket_t Event;
+		MIDI_EventPacket_t EchoEvent;
+
+		while (MIDIEventFIFO_Pop(&Events, &Event))
+		{
+			if (!(MIDIEventFIFO_Pop(&EchoEvents, &EchoEvent)) || memcmp(&Event, &EchoEvent, sizeof(Event)))
+			  Fuzz_Fail("echo FIFO event differs", &Event, Offset);
+
+			Fuzz_CheckEvent(&Event, Offset);
+
+			if ((Event.Event & 0x0F) == 0x0F)
+			  RealTimeEvents++;
+		}
+
+		if (MIDIEventFIFO_GetCount(&EchoEvents))
+		  Fuzz_Fail("echo FIFO has extra events", &EchoEvents.Events[0], Offset);
+
+		if (RealTimeEvents != (Fuzz_IsRealTime(Data[Offset]) ? 1 : 0))
+		  Fuzz_Fail("Real Time byte not passed on exactly once", &Event, Offset);
+	}
+
+	return 0;
+}
@@ -0,0 +1,320 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Unit tests of the serial MIDI stream parser in Lib/MIDIParser.c, checking the USB-MIDI event packets it
+ *  queues for each kind of message, for running status, for interleaved Real Time messages, for SysEx streaming
+ *  and for malformed input.
+ */
+
+#include "HostTest.h"
+
+#include "../Lib/MIDIParser.h"
+
+/** Parser under test, along with its main and echo event FIFOs. */
+static MIDIParser_t    Parser;
+static MIDIEventFIFO_t Events;
+static MIDIEventFIFO_t EchoEvents;
+
+/** Starts each test with a fresh parser and empty FIFOs. */
+static void Reset(void)
+{
+	MIDIParser_Init(&Parser);
+	MIDIEventFIFO_Init(&Events);
+	MIDIEventFIFO_Init(&EchoEvents);
+}
+
+/** Feeds a run of bytes into the parser, queueing its events into \ref Events only. */
+static void Feed(const uint8_t* const Bytes,
+                 const uint8_t Length)
+{
+	for (uint8_t i = 0; i < Length; i++)
+	  MIDIParser_ProcessByte(&Parser, &Events, NULL, Bytes[i]);
+}
+
+#define FEED(...)  Feed((const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}))
+
+/** Checks that the next queued event is the given one, and removes it. */
+#define EXPECT_EVENT(CIN, Byte1, Byte2, Byte3)                                 \
+	do                                                                         \
+	{                                                                          \
+		MIDI_EventPacket_t Event = {0};                                        \
+		TEST_ASSERT(MIDIEventFIFO_Pop(&Events, &Event));                       \
+		TEST_ASSERT_EQUAL((CIN),   Event.Event);                               \
+		TEST_ASSERT_EQUAL((Byte1), Event.Data1);                               \
+		TEST_ASSERT_EQUAL((Byte2), Event.Data2);                               \
+		TEST_ASSERT_EQUAL((Byte3), Event.Data3);                               \
+	} while (0)
+
+/** Checks that no more events are queued. */
+#define EXPECT_NO_EVENT()  TEST_ASSERT_EQUAL(0, MIDIEventFIFO_GetCount(&Events))
+
+static void Test_ChannelMessages(void)
+{
+	Reset();
+	FEED(0x90, 0x40, 0x7F, 0x81, 0x40, 0x00, 0xA2, 0x40, 0x10, 0xB3, 0x07, 0x64,
+	     0xC4, 0x05, 0xD5, 0x20, 0xE6, 0x00, 0x40);
+
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+	EXPECT_EVENT(0x08, 0x81, 0x40, 0x00);
+	EXPECT_EVENT(0x0A, 0xA2, 0x40, 0x10);
+	EXPECT_EVENT(0x0B, 0xB3, 0x07, 0x64);
+	EXPECT_EVENT(0x0C, 0xC4, 0x05, 0x00);
+	EXPECT_EVENT(0x0D, 0xD5, 0x20, 0x00);
+	EXPECT_EVENT(0x0E, 0xE6, 0x00, 0x40);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_RunningStatus(void)
+{
+	Reset();
+	FEED(0x90, 0x40, 0x7F, 0x41, 0x7F, 0x42, 0x00, 0xC0, 0x01, 0x02);
+
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+	EXPECT_EVENT(0x09, 0x90, 0x41, 0x7F);
+	EXPECT_EVENT(0x09, 0x90, 0x42, 0x00);
+	EXPECT_EVENT(0x0C, 0xC0, 0x01, 0x00);
+	EXPECT_EVENT(0x0C, 0xC0, 0x02, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_RealTimeInterleaved(void)
+{
+	Reset();
+	FEED(0x90, 0xF8, 0x40, 0xFA, 0x7F, 0x41, 0xFE, 0x7F, 0xFB, 0xFC, 0xFF);
+
+	EXPECT_EVENT(0x0F, 0xF8, 0x00, 0x00);
+	EXPECT_EVENT(0x0F, 0xFA, 0x00, 0x00);
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+	EXPECT_EVENT(0x0F, 0xFE, 0x00, 0x00);
+	EXPECT_EVENT(0x09, 0x90, 0x41, 0x7F);
+	EXPECT_EVENT(0x0F, 0xFB, 0x00, 0x00);
+	EXPECT_EVENT(0x0F, 0xFC, 0x00, 0x00);
+	EXPECT_EVENT(0x0F, 0xFF, 0x00, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_UndefinedRealTime(void)
+{
+	Reset();
+	FEED(0x90, 0x40, 0xF9, 0xFD, 0x7F);
+
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_SystemCommon(void)
+{
+	Reset();
+	FEED(0xF1, 0x10, 0xF2, 0x01, 0x02, 0xF3, 0x05, 0xF6);
+
+	EXPECT_EVENT(0x02, 0xF1, 0x10, 0x00);
+	EXPECT_EVENT(0x03, 0xF2, 0x01, 0x02);
+	EXPECT_EVENT(0x02, 0xF3, 0x05, 0x00);
+	EXPECT_EVENT(0x05, 0xF6, 0x00, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_SystemCommonCancelsRunningStatus(void)
+{
+	Reset();
+	FEED(0x90, 0x40, 0x7F, 0xF6, 0x41, 0x7F);
+
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+	EXPECT_EVENT(0x05, 0xF6, 0x00, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_SysExStreamed(void)
+{
+	Reset();
+	FEED(0xF0, 0x01, 0x02, 0x03, 0x04, 0xF7);
+
+	EXPECT_EVENT(0x04, 0xF0, 0x01, 0x02);
+	EXPECT_EVENT(0x07, 0x03, 0x04, 0xF7);
+	EXPECT_NO_EVENT();
+
+	FEED(0xF0, 0x01, 0x02, 0xF7);
+
+	EXPECT_EVENT(0x04, 0xF0, 0x01, 0x02);
+	EXPECT_EVENT(0x05, 0xF7, 0x00, 0x00);
+	EXPECT_NO_EVENT();
+
+	FEED(0xF0, 0x01, 0x02, 0x03, 0xF7);
+
+	EXPECT_EVENT(0x04, 0xF0, 0x01, 0x02);
+	EXPECT_EVENT(0x06, 0x03, 0xF7, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_SysExShort(void)
+{
+	Reset();
+	FEED(0xF0, 0xF7, 0xF0, 0x7E, 0xF7);
+
+	EXPECT_EVENT(0x06, 0xF0, 0xF7, 0x00);
+	EXPECT_EVENT(0x07, 0xF0, 0x7E, 0xF7);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_SysExRealTimeInterleaved(void)
+{
+	Reset();
+	FEED(0xF0, 0x01, 0xF8, 0x02, 0x03, 0xF7);
+
+	EXPECT_EVENT(0x0F, 0xF8, 0x00, 0x00);
+	EXPECT_EVENT(0x04, 0xF0, 0x01, 0x02);
+	EXPECT_EVENT(0x06, 0x03, 0xF7, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_SysExEndedByStatus(void)
+{
+	Reset();
+	FEED(0xF0, 0x01, 0x90, 0x40, 0x7F);
+
+	/* The EOX the SysEx lacks is supplied in its end packet */
+	EXPECT_EVENT(0x07, 0xF0, 0x01, 0xF7);
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+	EXPECT_NO_EVENT();
+
+	/* One cut short on a packet boundary is ended by a lone EOX */
+	FEED(0xF0, 0x01, 0x02, 0xC0, 0x05);
+
+	EXPECT_EVENT(0x04, 0xF0, 0x01, 0x02);
+	EXPECT_EVENT(0x05, 0xF7, 0x00, 0x00);
+	EXPECT_EVENT(0x0C, 0xC0, 0x05, 0x00);
+	EXPECT_NO_EVENT();
+
+	/* And so is one cut short by a System Common message */
+	FEED(0xF0, 0x01, 0x02, 0x03, 0x04, 0xF6);
+
+	EXPECT_EVENT(0x04, 0xF0, 0x01, 0x02);
+	EXPECT_EVENT(0x07, 0x03, 0x04, 0xF7);
+	EXPECT_EVENT(0x05, 0xF6, 0x00, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_MalformedInput(void)
+{
+	Reset();
+
+	/* Data bytes with no status to apply them to */
+	FEED(0x40, 0x7F);
+	EXPECT_NO_EVENT();
+
+	/* Undefined status bytes, and a stray EOX, cancel the running status */
+	FEED(0x90, 0x40, 0x7F, 0xF4, 0x41, 0x7F, 0xF5, 0xF7, 0x42);
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+	EXPECT_NO_EVENT();
+
+	/* An incomplete message is abandoned by the next status byte */
+	FEED(0x90, 0x40, 0x80, 0x41, 0x00);
+	EXPECT_EVENT(0x08, 0x80, 0x41, 0x00);
+	EXPECT_NO_EVENT();
+}
+
+static void Test_FIFOOverflow(void)
+{
+	Reset();
+
+	for (uint8_t i = 0; i < (MIDI_EVENT_FIFO_SIZE + 3); i++)
+	  FEED(0xF8);
+
+	TEST_ASSERT_EQUAL(MIDI_EVENT_FIFO_SIZE, MIDIEventFIFO_GetCount(&Events));
+	TEST_ASSERT_EQUAL(3, Events.Overflows);
+}
+
+static void Test_EchoFIFO(void)
+{
+	Reset();
+
+	/* Both FIFOs take every event, and each drops events independently once full */
+	for (uint8_t i = 0; i < MIDI_EVENT_FIFO_SIZE; i++)
+	  MIDIParser_ProcessByte(&Parser, &Events, NULL, 0xF8);
+
+	const uint8_t Bytes[] = {0x90, 0x40, 0x7F, 0xF0, 0x01, 0xF7};
+
+	for (uint8_t i = 0; i < sizeof(Bytes); i++)
+	  MIDIParser_ProcessByte(&Parser, &Events, &EchoEvents, Bytes[i]);
+
+	TEST_ASSERT_EQUAL(2, Events.Overflows);
+	TEST_ASSERT_EQUAL(2, MIDIEventFIFO_GetCount(&EchoEvents));
+	TEST_ASSERT_EQUAL(0, EchoEvents.Overflows);
+
+	MIDI_EventPacket_t Event = {0};
+
+	TEST_ASSERT(MIDIEventFIFO_Pop(&EchoEvents, &Event));
+	TEST_ASSERT_EQUAL(0x09, Event.Event);
+	TEST_ASSERT(MIDIEventFIFO_Pop(&EchoEvents, &Event));
+	TEST_ASSERT_EQUAL(0x07, Event.Event);
+
+	/* Without a main FIFO, events only go to the echo FIFO */
+	MIDIParser_ProcessByte(&Parser, NULL, &EchoEvents, 0xFA);
+	TEST_ASSERT_EQUAL(1, MIDIEventFIFO_GetCount(&EchoEvents));
+
+	/* And with neither, they are only parsed */
+	MIDIParser_ProcessByte(&Parser, NULL, NULL, 0xFC);
+	TEST_ASSERT_EQUAL(1, MIDIEventFIFO_GetCount(&EchoEvents));
+}
+
+static void Test_ReInit(void)
+{
+	Reset();
+	FEED(0x90, 0x40, 0x7F, 0xF0, 0x01);
+	EXPECT_EVENT(0x09, 0x90, 0x40, 0x7F);
+
+	/* A re-initialized parser forgets the SysEx and the running status */
+	MIDIParser_Init(&Parser);
+	FEED(0x02, 0x41, 0x7F);
+	EXPECT_NO_EVENT();
+}
+
+int main(void)
+{
+	RUN_TEST(Test_ChannelMessages);
+	RUN_TEST(Test_RunningStatus);
+	RUN_TEST(Test_RealTimeInterleaved);
+	RUN_TEST(Test_UndefinedRealTime);
+	RUN_TEST(Test_SystemCommon);
+	RUN_TEST(Test_SystemCommonCancelsRunningStatus);
+	RUN_TEST(Test_SysExStreamed);
+	RUN_TEST(Test_SysExShort);
+	RUN_TEST(Test_SysExRealTimeInterleaved);
+	RUN_TEST(Test_SysExEndedByStatus);
+	RUN_TEST(Test_MalformedInput);
+	RUN_TEST(Test_FIFOOverflow);
+	RUN_TEST(Test_EchoFIFO);
+	RUN_TEST(Test_ReInit);
+
+	return HostTest_Finish("MIDIParserTest");
+}
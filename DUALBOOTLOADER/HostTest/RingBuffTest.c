@@ -0,0 +1,277 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Unit tests of the lock-free ring buffer in Lib/LightweightRingBuff.h and of the MIDI event FIFO in
+ *  Lib/MIDIEventFIFO.h, including the wrap of their free running counters and the bulk span accessors.
+ */
+
+#include "HostTest.h"
+
+#include "../Lib/LightweightRingBuff.h"
+#include "../Lib/MIDIEventFIFO.h"
+
+/* A buffer of each valid size, with the insert and remove test for it */
+#define RINGBUFF_TEST_BUFFER(Size)                                                                            \
+	RINGBUFF_DEFINE(Buffer##Size, Size)                                                                       \
+                                                                                                              \
+	static void Test_InsertRemove##Size(void)                                                                 \
+	{                                                                                                         \
+		Buffer##Size##_Init();                                                                                \
+                                                                                                              \
+		TEST_ASSERT(Buffer##Size##_IsEmpty());                                                                \
+		TEST_ASSERT_EQUAL(Size, Buffer##Size##_GetFreeCount());                                               \
+                                                                                                              \
+		/* Enough rounds for the counters to wrap past 255 several times at every size */                     \
+		uint8_t NextIn  = 0;                                                                                  \
+		uint8_t NextOut = 0;                                                                                  \
+                                                                                                              \
+		for (uint16_t Round = 0; Round < 1000; Round++)                                                       \
+		{                                                                                                     \
+			while (!(Buffer##Size##_IsFull()))                                                                \
+			  Buffer##Size##_Insert(NextIn++);                                                                \
+                                                                                                              \
+			TEST_ASSERT_EQUAL(Size, Buffer##Size##_GetCount());                                               \
+			TEST_ASSERT_EQUAL(0, Buffer##Size##_GetFreeCount());                                              \
+                                                                                                              \
+			/* Leave a different number of elements behind each round, so that every alignment is covered */  \
+			uint8_t Keep = (Round % Size);                                                                    \
+                                                                                                              \
+			while (Buffer##Size##_GetCount() > Keep)                                                          \
+			  TEST_ASSERT_EQUAL(NextOut++, Buffer##Size##_Remove());                                          \
+		}                                                                                                     \
+                                                                                                              \
+		while (!(Buffer##Size##_IsEmpty()))                                                                   \
+		  TEST_ASSERT_EQUAL(NextOut++, Buffer##Size##_Remove());                                              \
+                                                                                                              \
+		TEST_ASSERT_EQUAL(NextIn, NextOut);                                                                   \
+	}
+
+RINGBUFF_TEST_BUFFER(2)
+RINGBUFF_TEST_BUFFER(4)
+RINGBUFF_TEST_BUFFER(8)
+RINGBUFF_TEST_BUFFER(16)
+RINGBUFF_TEST_BUFFER(32)
+RINGBUFF_TEST_BUFFER(64)
+RINGBUFF_TEST_BUFFER(128)
+
+/* A buffer defined within a union, with its accessors reaching it through a macro */
+static union
+{
+	RINGBUFF_STRUCT(8) Bytes;
+	uint32_t           Words[4];
+} SharedStorage;
+
+#define SharedBuffer  SharedStorage.Bytes
+
+RINGBUFF_DEFINE_ACCESSORS(SharedBuffer, 8)
+
+static void Test_InsertRemove(void)
+{
+	Test_InsertRemove2();
+	Test_InsertRemove4();
+	Test_InsertRemove8();
+	Test_InsertRemove16();
+	Test_InsertRemove32();
+	Test_InsertRemove64();
+	Test_InsertRemove128();
+}
+
+static void Test_Spans(void)
+{
+	Buffer16_Init();
+
+	RingBuff_Data_t* Span;
+	uint8_t          NextIn  = 0;
+	uint8_t          NextOut = 0;
+
+	for (uint16_t Round = 0; Round < 500; Round++)
+	{
+		/* Write in bulk up to a varying amount, never past the end of the storage */
+		uint8_t Wanted = ((Round * 7) % 17);
+
+		while (Wanted)
+		{
+			uint8_t Length = Buffer16_GetWriteSpan(&Span);
+
+			TEST_ASSERT((Span >= Buffer16.Data) && ((Span + Length) <= &Buffer16.Data[16]));
+
+			if (!(Length))
+			  break;
+
+			Length = MIN(Length, Wanted);
+
+			for (uint8_t i = 0; i < Length; i++)
+			  Span[i] = NextIn++;
+
+			Buffer16_CommitWrite(Length);
+			Wanted -= Length;
+		}
+
+		TEST_ASSERT_EQUAL((uint8_t)(NextIn - NextOut), Buffer16_GetCount());
+
+		/* Then read back in bulk, a varying amount at a time */
+		uint8_t ToRead = ((Round * 5) % 13);
+
+		while (ToRead)
+		{
+			uint8_t Length = Buffer16_GetReadSpan(&Span);
+
+			TEST_ASSERT((Span >= Buffer16.Data) && ((Span + Length) <= &Buffer16.Data[16]));
+
+			if (!(Length))
+			  break;
+
+			Length = MIN(Length, ToRead);
+
+			for (uint8_t i = 0; i < Length; i++)
+			  TEST_ASSERT_EQUAL(NextOut++, Span[i]);
+
+			Buffer16_CommitRead(Length);
+			ToRead -= Length;
+		}
+	}
+
+	while (!(Buffer16_IsEmpty()))
+	  TEST_ASSERT_EQUAL(NextOut++, Buffer16_Remove());
+
+	TEST_ASSERT_EQUAL(NextIn, NextOut);
+}
+
+static void Test_SpansAtEnds(void)
+{
+	Buffer8_Init();
+
+	RingBuff_Data_t* Span;
+
+	/* Empty and full buffers have no span to read or write respectively */
+	TEST_ASSERT_EQUAL(0, Buffer8_GetReadSpan(&Span));
+	TEST_ASSERT_EQUAL(8, Buffer8_GetWriteSpan(&Span));
+
+	for (uint8_t i = 0; i < 8; i++)
+	  Buffer8_Insert(i);
+
+	TEST_ASSERT_EQUAL(0, Buffer8_GetWriteSpan(&Span));
+	TEST_ASSERT_EQUAL(8, Buffer8_GetReadSpan(&Span));
+
+	/* Once wrapped, each span stops at the end of the storage */
+	for (uint8_t i = 0; i < 6; i++)
+	  Buffer8_Remove();
+
+	for (uint8_t i = 0; i < 4; i++)
+	  Buffer8_Insert(i);
+
+	TEST_ASSERT_EQUAL(2, Buffer8_GetReadSpan(&Span));
+	TEST_ASSERT(Span == &Buffer8.Data[6]);
+	TEST_ASSERT_EQUAL(2, Buffer8_GetWriteSpan(&Span));
+	TEST_ASSERT(Span == &Buffer8.Data[4]);
+}
+
+static void Test_SizeCheck(void)
+{
+	TEST_ASSERT(RINGBUFF_SIZE_VALID(2));
+	TEST_ASSERT(RINGBUFF_SIZE_VALID(64));
+	TEST_ASSERT(RINGBUFF_SIZE_VALID(128));
+	TEST_ASSERT(!(RINGBUFF_SIZE_VALID(1)));
+	TEST_ASSERT(!(RINGBUFF_SIZE_VALID(96)));
+	TEST_ASSERT(!(RINGBUFF_SIZE_VALID(256)));
+}
+
+static void Test_SharedStorage(void)
+{
+	SharedBuffer_Init();
+
+	for (uint8_t i = 0; i < 8; i++)
+	  SharedBuffer_Insert(i);
+
+	TEST_ASSERT(SharedBuffer_IsFull());
+	TEST_ASSERT_EQUAL(8, SharedStorage.Bytes.Head);
+	TEST_ASSERT_EQUAL(0, SharedBuffer_Remove());
+	TEST_ASSERT_EQUAL(7, SharedBuffer_GetCount());
+}
+
+static void Test_EventFIFO(void)
+{
+	static MIDIEventFIFO_t FIFO;
+	MIDI_EventPacket_t     Event   = {0};
+	uint8_t                NextIn  = 0;
+	uint8_t                NextOut = 0;
+
+	MIDIEventFIFO_Init(&FIFO);
+
+	TEST_ASSERT(!(MIDIEventFIFO_Peek(&FIFO, &Event)));
+	TEST_ASSERT(!(MIDIEventFIFO_Pop(&FIFO, &Event)));
+
+	for (uint16_t Round = 0; Round < 1000; Round++)
+	{
+		for (;;)
+		{
+			Event.Data1 = NextIn;
+
+			if (!(MIDIEventFIFO_Push(&FIFO, &Event)))
+			  break;
+
+			NextIn++;
+		}
+
+		TEST_ASSERT_EQUAL(MIDI_EVENT_FIFO_SIZE, MIDIEventFIFO_GetCount(&FIFO));
+
+		uint8_t Keep = (Round % MIDI_EVENT_FIFO_SIZE);
+
+		while (MIDIEventFIFO_GetCount(&FIFO) > Keep)
+		{
+			TEST_ASSERT(MIDIEventFIFO_Peek(&FIFO, &Event));
+			TEST_ASSERT_EQUAL(NextOut, Event.Data1);
+			TEST_ASSERT(MIDIEventFIFO_Pop(&FIFO, &Event));
+			TEST_ASSERT_EQUAL(NextOut++, Event.Data1);
+		}
+	}
+
+	/* Each round ends with one refused push */
+	TEST_ASSERT_EQUAL(1000, FIFO.Overflows);
+
+	MIDIEventFIFO_Init(&FIFO);
+	TEST_ASSERT_EQUAL(0, MIDIEventFIFO_GetCount(&FIFO));
+	TEST_ASSERT_EQUAL(0, FIFO.Overflows);
+}
+
+int main(void)
+{
+	RUN_TEST(Test_InsertRemove);
+	RUN_TEST(Test_Spans);
+	RUN_TEST(Test_SpansAtEnds);
+	RUN_TEST(Test_SizeCheck);
+	RUN_TEST(Test_SharedStorage);
+	RUN_TEST(Test_EventFIFO);
+
+	return HostTest_Finish("RingBuffTest");
+}
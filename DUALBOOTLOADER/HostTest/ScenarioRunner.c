@@ -0,0 +1,1473 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Traffic scenarios for the firmware, run through FirmwareHarness.h on a simulated timeline and reported as
+ *  JSON. Each scenario streams messages through the firmware in one direction at the line rate of its baud
+ *  rate, with the main loop passing at a fixed simulated period, the 1ms tick running and the host collecting
+ *  every IN packet and refilling the OUT endpoint between passes, or polling for IN packets at a set interval. The
+ *  report gives the USB packing, how much of the OUT bank each main loop pass takes, the drops and the latency of
+ *  each message through the device, in simulated time. The upload scenario runs avrdude's upload of a 32KB image
+ *  to an STK500 bootloader on the target through the serial mode, from the DTR reset to the last verified page.
+ *
+ *  This stands in for running the firmware image under an AVR simulator: the logic and the buffering are the
+ *  firmware's own, and the CPU time is modelled around them. Each interrupt takes the CPU for a fixed number of
+ *  cycles, one at a time in the AVR's priority order, and stretches the main loop pass it lands in. The main loop
+ *  holds interrupts off for a while once per pass, as its atomic blocks do. The USART receiver holds two bytes in
+ *  its buffer and a third in its shift register, and loses the next one to an overrun if the receive ISR has not
+ *  read one by the time it is in. The cycle figures are parameters of the model, as is the main loop period: the
+ *  defaults are estimates rather than measurements, and the report says which figures were given on the command
+ *  line. Figures measured on the device with the ENABLE_PROFILING build (see \ref Sec_VendorRequests) are of the
+ *  ISR bodies, so the cost of entering and leaving the ISR must be added to them. After the scenarios, the serial
+ *  and MIDI receive scenarios are swept over a range of baud rates to find the highest one the device takes
+ *  without an overrun. The upload scenario keeps the plain timeline, with interrupts taking no time.
+ *
+ *  Usage: ScenarioRunner [-loop-us N] [-serial-rx-cycles N] [-midi-rx-cycles N] [-udre-cycles N]
+ *                        [-tick-cycles N] [-atomic-cycles N] [scenario or upload names...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FirmwareHarness.h"
+
+/** Simulated main loop period used unless given on the command line, in microseconds. */
+#define DEFAULT_LOOP_PERIOD_US   50
+
+/** Cycle model figures used unless given on the command line, in CPU cycles. These are estimates from the work
+ *  each ISR does, including the entry and exit, not measurements; see \ref CycleModel_t.
+ */
+#define DEFAULT_SERIAL_RX_CYCLES 120
+#define DEFAULT_MIDI_RX_CYCLES   200
+#define DEFAULT_UDRE_CYCLES      70
+#define DEFAULT_TICK_CYCLES      60
+#define DEFAULT_ATOMIC_CYCLES    60
+
+/** Number of received bytes the USART holds before the next one overruns it, two in its receive buffer and one
+ *  in its shift register.
+ */
+#define USART_RX_HOLD_BYTES      3
+
+/** Largest number of messages in a scenario. */
+#define MAX_SCENARIO_MESSAGES    65536
+
+/** Simulated time allowed after the last message goes in for the rest to come out, in nanoseconds. */
+#define SCENARIO_DRAIN_TIME_NS   1000000000ULL
+
+/** Enum for the figures of the cycle model, as bits of \ref CycleModel_t::Given. */
+enum CycleModel_Figures_t
+{
+	CYCLE_SerialRX = (1 << 0), /**< Receive ISR in serial mode */
+	CYCLE_MIDIRX   = (1 << 1), /**< Receive ISR in MIDI mode */
+	CYCLE_UDRE     = (1 << 2), /**< Data register empty ISR */
+	CYCLE_Tick     = (1 << 3), /**< 1ms tick ISR */
+	CYCLE_Atomic   = (1 << 4), /**< Interrupts held off by the main loop */
+	CYCLE_Loop     = (1 << 5), /**< Main loop pass */
+};
+
+/** Type define for the CPU time the cycle model charges for each interrupt, and holds interrupts off for once
+ *  per main loop pass, in CPU cycles. Each ISR figure covers the whole interrupt, from the vector jump to the
+ *  return.
+ */
+typedef struct
+{
+	uint16_t SerialRXCycles; /**< Receive ISR in serial mode, which may write the byte straight into the IN endpoint bank */
+	uint16_t MIDIRXCycles; /**< Receive ISR in MIDI mode, which runs the byte through the parser */
+	uint16_t UDRECycles; /**< Data register empty ISR */
+	uint16_t TickCycles; /**< 1ms tick ISR */
+	uint16_t AtomicCycles; /**< Interrupts held off by the main loop's atomic blocks, once per pass */
+	uint8_t  Given; /**< Mask of the \ref CycleModel_Figures_t given on the command line, the rest being the defaults */
+} CycleModel_t;
+
+/** Enum for the direction a scenario streams its messages in. */
+enum Scenario_Directions_t
+{
+	SCENARIO_ToHost   = 0, /**< Messages are received from the target and sent to the host */
+	SCENARIO_ToTarget = 1, /**< Messages are sent by the host and transmitted to the target */
+};
+
+/** Type define for a traffic scenario. */
+typedef struct
+{
+	const char* Name; /**< Name of the scenario in the report */
+	uint8_t     Mode; /**< Device mode, one of the \ref DeviceModes_t values */
+	uint8_t     Direction; /**< Direction of the traffic, one of the \ref Scenario_Directions_t values */
+	uint32_t    BaudRate; /**< Baud rate of the serial line, in bits per second */
+	uint32_t    Messages; /**< Number of messages to stream */
+	uint32_t    INPollUS; /**< Interval at which the host collects IN packets in microseconds, or zero to collect each one
+	                       *   as soon as it is sent */
+
+	/** Generates one message of the scenario, as the bytes the target sends for messages to the host, and as the
+	 *  USB data the host sends for messages to the target.
+	 *
+	 *  \param[in]  Index  Index of the message in the scenario
+	 *  \param[out] Bytes  Location where the bytes of the message are to be stored, up to four
+	 *
+	 *  \return Number of bytes in the message
+	 */
+	uint8_t (*Generate)(const uint32_t Index, uint8_t* const Bytes);
+} Scenario_t;
+
+/** Type define for the results of a scenario run. */
+typedef struct
+{
+	uint64_t EndTime; /**< Simulated time the last message went in, in nanoseconds */
+	uint64_t LastDelivery; /**< Simulated time the last message came out, in nanoseconds */
+	uint64_t RunTime; /**< Simulated time the last message went in or came out or the last USART interrupt returned, in nanoseconds */
+	uint32_t MessagesIn; /**< Messages taken in from the source */
+	uint32_t MessagesOut; /**< Messages delivered at the destination */
+	uint32_t Mismatches; /**< Messages delivered with different contents than expected */
+	uint32_t BytesIn; /**< Bytes taken in from the source */
+	uint32_t BytesOut; /**< Bytes delivered at the destination */
+	uint32_t StatusBytesSaved; /**< Status bytes left out of the messages sent to the target under running status */
+	uint32_t DirectBytes; /**< Serial bytes the receive ISR wrote straight into the IN endpoint bank */
+	uint32_t INPackets; /**< Data IN packets sent to the host */
+	uint32_t OUTPackets; /**< Data OUT packets sent by the host */
+	uint32_t OUTTakingPasses; /**< Main loop passes which took bytes from the OUT endpoint bank */
+	uint32_t OUTTakenBytes; /**< Bytes taken from the OUT endpoint bank by those passes */
+	uint16_t OUTTakenMax; /**< Most bytes taken from the OUT endpoint bank by one pass */
+	uint32_t OverrunBytes; /**< Bytes lost because the receive ISR did not read the USART in time */
+	uint32_t LoopPasses; /**< Main loop passes run */
+	uint64_t LoopTimeTotal; /**< Sum of the times between main loop passes, in nanoseconds */
+	uint64_t LoopTimeMax; /**< Longest time between two main loop passes, in nanoseconds */
+	uint64_t ISRTime; /**< Time the CPU spent in interrupts until the last USART interrupt returned, in nanoseconds */
+	uint64_t LatencyTotal; /**< Sum of the latencies of the delivered messages, in nanoseconds */
+	uint64_t LatencyMax; /**< Largest latency of a delivered message, in nanoseconds */
+	double   HostSeconds; /**< Wall clock time the run took on the host */
+} Scenario_Results_t;
+
+/** Generates a single byte of bulk serial data. */
+static uint8_t Generate_SerialBulk(const uint32_t Index,
+                                   uint8_t* const Bytes)
+{
+	Bytes[0] = (uint8_t)((Index * 7) + (Index >> 8));
+	return 1;
+}
+
+/** Generates alternating Note On and Note Off messages, each sent with its status byte. */
+static uint8_t Generate_NoteFlood(const uint32_t Index,
+                                  uint8_t* const Bytes)
+{
+	Bytes[0] = (((Index & 1) ? NoteOff : NoteOn) | ((Index >> 1) & 0x0F));
+	Bytes[1] = ((Index >> 1) & 0x7F);
+	Bytes[2] = 0x64;
+	return 3;
+}
+
+/** Generates Note On messages, with a velocity of zero for every other to end the note, under running status. */
+static uint8_t Generate_RunningStatus(const uint32_t Index,
+                                      uint8_t* const Bytes)
+{
+	uint8_t Length = 0;
+
+	if (!(Index))
+	  Bytes[Length++] = NoteOn;
+
+	Bytes[Length++] = ((Index >> 1) & 0x7F);
+	Bytes[Length++] = ((Index & 1) ? 0x00 : 0x64);
+	return Length;
+}
+
+/** Generates Note On messages under running status, with a Timing Clock every eighth message. */
+static uint8_t Generate_ClockAndNotes(const uint32_t Index,
+                                      uint8_t* const Bytes)
+{
+	uint8_t Length = 0;
+
+	if ((Index % 8) == 7)
+	{
+		Bytes[Length++] = Clock;
+		return Length;
+	}
+
+	if (!(Index))
+	  Bytes[Length++] = NoteOn;
+
+	Bytes[Length++] = (Index & 0x7F);
+	Bytes[Length++] = ((Index & 1) ? 0x00 : 0x64);
+	return Length;
+}
+
+/** Generates Timing Clock messages back to back, as a clock source running far faster than any tempo would. */
+static uint8_t Generate_ClockFlood(const uint32_t Index,
+                                   uint8_t* const Bytes)
+{
+	Bytes[0] = Clock;
+	return 1;
+}
+
+/** Generates USB-MIDI Note On events on one channel, with a velocity of zero for every other to end the note. */
+static uint8_t Generate_NoteEvents(const uint32_t Index,
+                                   uint8_t* const Bytes)
+{
+	Bytes[0] = (NoteOn >> 4);
+	Bytes[1] = NoteOn;
+	Bytes[2] = ((Index >> 1) & 0x7F);
+	Bytes[3] = ((Index & 1) ? 0x00 : 0x64);
+	return 4;
+}
+
+/** Generates USB-MIDI events as a sequencer track plays them, notes and controller changes on two channels with
+ *  a Timing Clock every sixth event.
+ */
+static uint8_t Generate_MixedEvents(const uint32_t Index,
+                                    uint8_t* const Bytes)
+{
+	uint8_t Step    = (Index % 12);
+	uint8_t Channel = ((Index / 12) & 0x01);
+
+	if ((Step % 6) == 5)
+	{
+		Bytes[0] = 0x0F;
+		Bytes[1] = Clock;
+		Bytes[2] = 0x00;
+		Bytes[3] = 0x00;
+	}
+	else if (Step == 4)
+	{
+		Bytes[0] = (ControlChange >> 4);
+		Bytes[1] = (ControlChange | Channel);
+		Bytes[2] = 0x07;
+		Bytes[3] = (Index & 0x7F);
+	}
+	else
+	{
+		Bytes[0] = (NoteOn >> 4);
+		Bytes[1] = (NoteOn | (Channel ^ (Step >= 6)));
+		Bytes[2] = ((Index >> 1) & 0x7F);
+		Bytes[3] = ((Index & 1) ? 0x00 : 0x64);
+	}
+
+	return 4;
+}
+
+/** Scenarios run when none are named on the command line. */
+static const Scenario_t Scenarios[] =
+	{
+		{"serial_to_host_115200",    MODE_Serial, SCENARIO_ToHost,   115200,  20000, 0,    Generate_SerialBulk},
+		{"serial_to_host_1M",        MODE_Serial, SCENARIO_ToHost,   1000000, 65536, 0,    Generate_SerialBulk},
+		{"serial_to_target_115200",  MODE_Serial, SCENARIO_ToTarget, 115200,  20000, 0,    Generate_SerialBulk},
+		{"serial_to_target_1M",      MODE_Serial, SCENARIO_ToTarget, 1000000, 65536, 0,    Generate_SerialBulk},
+		{"midi_note_flood",          MODE_MIDI,   SCENARIO_ToHost,   31250,   4000,  0,    Generate_NoteFlood},
+		{"midi_running_status",      MODE_MIDI,   SCENARIO_ToHost,   31250,   4000,  0,    Generate_RunningStatus},
+		{"midi_clock_and_notes",     MODE_MIDI,   SCENARIO_ToHost,   31250,   4000,  0,    Generate_ClockAndNotes},
+		{"midi_notes_to_target",     MODE_MIDI,   SCENARIO_ToTarget, 31250,   4000,  0,    Generate_NoteEvents},
+		{"midi_mixed_to_target",     MODE_MIDI,   SCENARIO_ToTarget, 31250,   4800,  0,    Generate_MixedEvents},
+		{"midi_clock_flood_polled",  MODE_MIDI,   SCENARIO_ToHost,   31250,   4000,  1000, Generate_ClockFlood},
+	};
+
+/** Baud rates the receive scenarios are swept over, for the highest one taken without an overrun. */
+static const uint32_t SweepBaudRates[] = {115200, 230400, 250000, 460800, 500000, 1000000, 2000000};
+
+/** Receive scenarios swept over \ref SweepBaudRates, at the baud rate of each in turn. */
+static const Scenario_t SweepScenarios[] =
+	{
+		{"serial_to_host",           MODE_Serial, SCENARIO_ToHost,   0,       20000, 0,    Generate_SerialBulk},
+		{"midi_note_flood",          MODE_MIDI,   SCENARIO_ToHost,   0,       4000,  0,    Generate_NoteFlood},
+	};
+
+/** Time each message of the running scenario went in, in simulated nanoseconds. */
+static uint64_t MessageTimes[MAX_SCENARIO_MESSAGES];
+
+/** Bytes expected at the destination for the message being delivered, and how many of them have arrived. */
+static uint8_t ExpectedBytes[4];
+static uint8_t ExpectedLength;
+static uint8_t ExpectedPosition;
+
+/** Running status of the message stream at the destination, for rebuilding the expected bytes. */
+static uint8_t ExpectedStatus;
+
+/** Whether the message being delivered has differed from the expected bytes so far. */
+static bool    ExpectedMismatch;
+
+/** Status bytes expected to be left out of the messages to the target so far, under running status. */
+static uint32_t ExpectedStatusSaved;
+
+/** Returns the current monotonic time in seconds. */
+static double Scenario_Now(void)
+{
+	struct timespec Now;
+
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+
+	return (Now.tv_sec + (Now.tv_nsec / 1e9));
+}
+
+/** Retrieves the number of data bytes following a MIDI status byte. */
+static uint8_t Scenario_DataLength(const uint8_t Status)
+{
+	switch (Status & 0xF0)
+	{
+		case 0xC0:
+		case 0xD0:
+			return 1;
+		case 0xF0:
+			return 0;
+		default:
+			return 2;
+	}
+}
+
+/** Builds the bytes the given message arrives at its destination as, into \ref ExpectedBytes. Serial data
+ *  arrives as it was sent, MIDI messages arrive at the host as one USB-MIDI event each and at the target as the
+ *  message alone, its status byte left out when it repeats the previous one and running status is on. Real Time
+ *  messages are sent whole and leave the running status as it was.
+ */
+static void Scenario_Expect(const Scenario_t* const Scenario,
+                            const uint32_t Index)
+{
+	uint8_t Message[4];
+	uint8_t Length = Scenario->Generate(Index, Message);
+
+	ExpectedPosition = 0;
+	ExpectedMismatch = false;
+
+	if (Scenario->Mode == MODE_Serial)
+	{
+		memcpy(ExpectedBytes, Message, Length);
+		ExpectedLength = Length;
+	}
+	else if (Scenario->Direction == SCENARIO_ToHost)
+	{
+		const uint8_t* Data   = Message;
+		uint8_t        Status = ExpectedStatus;
+
+		if (Message[0] & 0x80)
+		{
+			Status = *(Data++);
+			Length--;
+		}
+
+		if (Status < Clock)
+		  ExpectedStatus = Status;
+
+		ExpectedBytes[0] = ((Status >= Clock) ? 0x0F : (Status >> 4));
+		ExpectedBytes[1] = Status;
+		ExpectedBytes[2] = ((Length > 0) ? Data[0] : 0);
+		ExpectedBytes[3] = ((Length > 1) ? Data[1] : 0);
+		ExpectedLength   = sizeof(MIDI_EventPacket_t);
+	}
+	else
+	{
+		uint8_t Status = Message[1];
+
+		#if defined(NO_MIDI_TX_RUNNING_STATUS)
+		bool RunningStatus = false;
+		#else
+		bool RunningStatus = MIDI_TX_RunningStatus;
+		#endif
+
+		ExpectedLength = 0;
+
+		if (Status >= Clock)
+		{
+			ExpectedBytes[ExpectedLength++] = Status;
+			return;
+		}
+
+		if (RunningStatus && (Status == ExpectedStatus))
+		  ExpectedStatusSaved++;
+		else
+		  ExpectedBytes[ExpectedLength++] = Status;
+
+		for (uint8_t i = 0; i < Scenario_DataLength(Status); i++)
+		  ExpectedBytes[ExpectedLength++] = Message[2 + i];
+
+		ExpectedStatus = ((Status < 0xF0) ? Status : 0);
+	}
+}
+
+/** Takes one byte arriving at the destination, recording the delivery of its message once the last of its bytes
+ *  is in.
+ */
+static void Scenario_Deliver(const Scenario_t* const Scenario,
+                             Scenario_Results_t* const Results,
+                             const uint8_t Byte,
+                             const uint64_t Now)
+{
+	Results->BytesOut++;
+
+	if (Results->MessagesOut == Results->MessagesIn)
+	{
+		Results->Mismatches++;
+		return;
+	}
+
+	if (!(ExpectedPosition))
+	  Scenario_Expect(Scenario, Results->MessagesOut);
+
+	if (Byte != ExpectedBytes[ExpectedPosition++])
+	  ExpectedMismatch = true;
+
+	if (ExpectedPosition == ExpectedLength)
+	{
+		uint64_t Latency = (Now - MessageTimes[Results->MessagesOut++]);
+
+		Results->LatencyTotal += Latency;
+		Results->LastDelivery  = Now;
+
+		if (Latency > Results->LatencyMax)
+		  Results->LatencyMax = Latency;
+
+		if (ExpectedMismatch)
+		  Results->Mismatches++;
+
+		ExpectedPosition = 0;
+	}
+}
+
+/** Retrieves the number of bytes of the packet in an OUT endpoint which the firmware has yet to read. */
+static uint16_t Scenario_OUTBankBytes(const uint8_t Address)
+{
+	HostShim_Endpoint_t* Endpoint = &HostShim_Endpoints[Address & (HOST_SHIM_ENDPOINTS - 1)];
+
+	return (Endpoint->OUTReceived ? (Endpoint->Length - Endpoint->Position) : 0);
+}
+
+/** Converts a number of CPU cycles to simulated time, in nanoseconds. */
+static uint64_t Scenario_CyclesToNS(const uint16_t Cycles)
+{
+	return (((Cycles * 1000000000ULL) + (F_CPU / 2)) / F_CPU);
+}
+
+/** Runs one scenario on the simulated timeline, under the cycle model.
+ *
+ *  \param[in]  Scenario      Scenario to run
+ *  \param[in]  LoopPeriodNS  Simulated time a main loop pass takes when no interrupt lands in it, in nanoseconds
+ *  \param[in]  Model         Cycle model to charge the interrupts by
+ *  \param[out] Results       Location where the results are to be stored
+ */
+static void Scenario_Run(const Scenario_t* const Scenario,
+                         const uint64_t LoopPeriodNS,
+                         const CycleModel_t* const Model,
+                         Scenario_Results_t* const Results)
+{
+	/* Each byte on the line takes a start bit, eight data bits and a stop bit */
+	const uint64_t ByteTimeNS = (10000000000ULL / Scenario->BaudRate);
+
+	const uint8_t  INAddress     = ((Scenario->Mode == MODE_Serial) ? CDC_TX_EPADDR : MIDI_STREAM_IN_EPADDR);
+	const uint8_t  OUTAddress    = ((Scenario->Mode == MODE_Serial) ? CDC_RX_EPADDR : MIDI_STREAM_OUT_EPADDR);
+	const uint16_t OUTPacketSize = ((Scenario->Mode == MODE_Serial) ? CDC_TXRX_EPSIZE : MIDI_STREAM_EPSIZE);
+
+	const uint64_t RXISRNS   = Scenario_CyclesToNS((Scenario->Mode == MODE_Serial) ? Model->SerialRXCycles
+	                                                                                 : Model->MIDIRXCycles);
+	const uint64_t UDREISRNS = Scenario_CyclesToNS(Model->UDRECycles);
+	const uint64_t TickISRNS = Scenario_CyclesToNS(Model->TickCycles);
+	const uint64_t AtomicNS  = Scenario_CyclesToNS(Model->AtomicCycles);
+
+	uint8_t  Message[4];
+	uint8_t  MessageLength   = 0;
+	uint8_t  MessagePosition = 0;
+
+	uint8_t  OUTPacket[HOST_SHIM_BANK_SIZE];
+	uint16_t OUTLength = 0;
+	uint8_t  INData[HOST_SHIM_IN_LOG_SIZE];
+
+	/* Bytes held by the USART receiver for the receive ISR, and whether one was lost before the oldest */
+	uint8_t  RXHeld[USART_RX_HOLD_BYTES];
+	uint8_t  RXHeldCount = 0;
+	bool     RXOverrun   = false;
+
+	uint64_t Now      = 0;
+	uint64_t NextRX   = ByteTimeNS;
+	uint64_t NextTick = 1000000;
+	uint64_t NextLoop = LoopPeriodNS;
+	uint64_t NextPoll = (Scenario->INPollUS * 1000ULL);
+	uint64_t TXFreeAt = 0;
+	uint64_t LastLoop = 0;
+
+	/* Interrupts wait for the one running to return, and for the main loop to enable them again */
+	uint64_t ISRFreeAt        = 0;
+	uint64_t InterruptsOnFrom = 0;
+	uint64_t USARTISRDone     = 0;
+	uint64_t ISRTimeTotal     = 0;
+
+	memset(Results, 0, sizeof(*Results));
+
+	ExpectedPosition    = 0;
+	ExpectedStatus      = 0;
+	ExpectedStatusSaved = 0;
+
+	Harness_Reset(Scenario->Mode);
+
+	if (Scenario->Mode == MODE_Serial)
+	  Harness_OpenSerialPort(Scenario->BaudRate);
+
+	/* A host polling at intervals leaves each IN packet in the endpoint until it comes for it */
+	HostShim_HoldIN = (Scenario->INPollUS != 0);
+
+	double HostStart = Scenario_Now();
+
+	/* Run until every message has gone in and come out, or the rest can be taken as lost */
+	while ((Results->MessagesIn < Scenario->Messages) || (Results->MessagesOut < Results->MessagesIn) || OUTLength ||
+	       RXHeldCount)
+	{
+		if (Results->EndTime && (Now > (Results->EndTime + SCENARIO_DRAIN_TIME_NS)))
+		  break;
+
+		bool RXActive = ((Scenario->Direction == SCENARIO_ToHost) && (Results->MessagesIn < Scenario->Messages));
+		bool TXActive = (UCSR1B & (1 << UDRIE1));
+
+		/* The next interrupt is the earliest one raised, run once the CPU can take it. The transmitter is free
+		 * straight away when armed after being idle */
+		uint64_t NextISR = NextTick;
+
+		if (RXHeldCount)
+		  NextISR = Now;
+
+		if (TXActive)
+		  NextISR = MIN(NextISR, MAX(TXFreeAt, Now));
+
+		NextISR = MAX(NextISR, MAX(ISRFreeAt, InterruptsOnFrom));
+
+		/* Advance to the next event on the timeline, then run everything due at that time */
+		uint64_t Next = MIN(NextISR, NextLoop);
+
+		if (RXActive)
+		  Next = MIN(Next, NextRX);
+
+		if (Scenario->INPollUS)
+		  Next = MIN(Next, NextPoll);
+
+		Now = Next;
+
+		/* The byte on the line is in, and is held for the receive ISR unless the receiver is already full */
+		if (RXActive && (Now >= NextRX))
+		{
+			if (MessagePosition == MessageLength)
+			{
+				MessageLength   = Scenario->Generate(Results->MessagesIn, Message);
+				MessagePosition = 0;
+			}
+
+			if (RXHeldCount < USART_RX_HOLD_BYTES)
+			{
+				RXHeld[RXHeldCount++] = Message[MessagePosition];
+			}
+			else
+			{
+				RXOverrun = true;
+				Results->OverrunBytes++;
+			}
+
+			MessagePosition++;
+			Results->BytesIn++;
+			NextRX += ByteTimeNS;
+
+			if (MessagePosition == MessageLength)
+			{
+				MessageTimes[Results->MessagesIn++] = Now;
+
+				if (Results->MessagesIn == Scenario->Messages)
+				  Results->EndTime = Now;
+			}
+		}
+
+		/* One interrupt runs at a time, the tick first, then the receiver and then the transmitter as in the AVR's
+		 * vector order, and the main loop pass it lands in is stretched by the time it takes */
+		if (Now >= NextISR)
+		{
+			uint64_t ISRTime = 0;
+
+			if (Now >= NextTick)
+			{
+				TIMER0_COMPA_vect();
+				NextTick += 1000000;
+				ISRTime   = TickISRNS;
+			}
+			else if (RXHeldCount)
+			{
+				uint8_t  Queued  = USARTtoUSB_Buffer_GetCount();
+				uint16_t Dropped = DeviceStats.DroppedBytes;
+
+				/* An overrun is flagged with the byte read before the lost one */
+				UCSR1A = (RXOverrun ? (UCSR1A | (1 << DOR1)) : (UCSR1A & ~(1 << DOR1)));
+				UDR1   = RXHeld[0];
+				memmove(&RXHeld[0], &RXHeld[1], --RXHeldCount);
+				RXOverrun = false;
+
+				USART1_RX_vect();
+
+				UCSR1A &= ~(1 << DOR1);
+
+				/* A serial byte neither queued nor dropped went straight into the IN endpoint bank */
+				if ((Scenario->Mode == MODE_Serial) && (USARTtoUSB_Buffer_GetCount() == Queued) &&
+				    (DeviceStats.DroppedBytes == Dropped))
+				{
+					Results->DirectBytes++;
+				}
+
+				ISRTime      = RXISRNS;
+				USARTISRDone = (Now + ISRTime);
+			}
+			else if (TXActive)
+			{
+				/* The transmitter takes a new byte once the previous one is on the line, the ISR disarms itself
+				 * when it finds nothing left to send */
+				bool BytePending = !(USBtoUSART_Buffer_IsEmpty());
+
+				USART1_UDRE_vect();
+
+				if (BytePending)
+				{
+					Scenario_Deliver(Scenario, Results, UDR1, (Now + ByteTimeNS));
+					TXFreeAt = (Now + ByteTimeNS);
+				}
+
+				ISRTime      = UDREISRNS;
+				USARTISRDone = (Now + ISRTime);
+			}
+
+			ISRFreeAt     = (Now + ISRTime);
+			NextLoop     += ISRTime;
+			ISRTimeTotal += ISRTime;
+
+			if (USARTISRDone == ISRFreeAt)
+			  Results->ISRTime = ISRTimeTotal;
+		}
+
+		if (Now >= NextLoop)
+		{
+			/* The host keeps the OUT endpoint full, one packet of whole messages at a time */
+			if ((Scenario->Direction == SCENARIO_ToTarget) && !(OUTLength))
+			{
+				while (Results->MessagesIn < Scenario->Messages)
+				{
+					uint8_t Length = Scenario->Generate(Results->MessagesIn, Message);
+
+					if ((OUTLength + Length) > OUTPacketSize)
+					  break;
+
+					memcpy(&OUTPacket[OUTLength], Message, Length);
+					OUTLength       += Length;
+					Results->BytesIn += Length;
+
+					MessageTimes[Results->MessagesIn++] = Now;
+				}
+
+				if ((Results->MessagesIn == Scenario->Messages) && !(Results->EndTime))
+				  Results->EndTime = Now;
+			}
+
+			if (OUTLength && HostShim_SendOUT(OUTAddress, OUTPacket, OUTLength))
+			{
+				OUTLength = 0;
+				Results->OUTPackets++;
+			}
+
+			uint16_t OUTBankBytes = Scenario_OUTBankBytes(OUTAddress);
+
+			Harness_MainLoopPass();
+
+			uint16_t OUTTaken = (OUTBankBytes - Scenario_OUTBankBytes(OUTAddress));
+
+			if (OUTTaken)
+			{
+				Results->OUTTakingPasses++;
+				Results->OUTTakenBytes += OUTTaken;
+				Results->OUTTakenMax    = MAX(Results->OUTTakenMax, OUTTaken);
+			}
+
+			/* Unless polling at intervals, the host collects each IN packet as soon as it is sent */
+			if (!(Scenario->INPollUS))
+			{
+				uint16_t INLength = HostShim_TakeIN(INAddress, INData, sizeof(INData));
+
+				for (uint16_t i = 0; i < INLength; i++)
+				  Scenario_Deliver(Scenario, Results, INData[i], Now);
+			}
+
+			Results->LoopTimeTotal += (Now - LastLoop);
+			Results->LoopTimeMax    = MAX(Results->LoopTimeMax, (Now - LastLoop));
+			Results->LoopPasses++;
+
+			InterruptsOnFrom = (Now + AtomicNS);
+			LastLoop         = Now;
+			NextLoop         = (Now + LoopPeriodNS);
+		}
+
+		if (Scenario->INPollUS && (Now >= NextPoll))
+		{
+			uint16_t INLength = HostShim_TakeIN(INAddress, INData, sizeof(INData));
+
+			for (uint16_t i = 0; i < INLength; i++)
+			  Scenario_Deliver(Scenario, Results, INData[i], Now);
+
+			NextPoll += (Scenario->INPollUS * 1000ULL);
+		}
+	}
+
+	Results->RunTime          = MAX(MAX(Results->EndTime, Results->LastDelivery), USARTISRDone);
+	Results->INPackets        = HostShim_Endpoints[INAddress & (HOST_SHIM_ENDPOINTS - 1)].INPackets;
+	Results->StatusBytesSaved = ExpectedStatusSaved;
+	Results->HostSeconds      = (Scenario_Now() - HostStart);
+}
+
+/** Reads the traffic and error counters of the firmware, as the host does with \ref VENDOR_REQ_GetDeviceStats.
+ *
+ *  \param[out] Stats  Counters as returned to the host
+ */
+static void Scenario_GetDeviceStats(DeviceStats_t* const Stats)
+{
+	HostShim_ControlRequest(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE, VENDOR_REQ_GetDeviceStats, 0, 0,
+	                        Stats, sizeof(DeviceStats_t));
+}
+
+/** Writes the results of a scenario as one JSON object. */
+static void Scenario_Report(const Scenario_t* const Scenario,
+                            const Scenario_Results_t* const Results,
+                            const uint32_t LoopPeriodUS,
+                            const bool Last)
+{
+	uint64_t SimulatedTime  = MAX(Results->EndTime, Results->LastDelivery);
+	uint32_t LineBytes      = ((Scenario->Direction == SCENARIO_ToHost) ? Results->BytesIn : Results->BytesOut);
+	double   LineTime       = (LineBytes * (10e9 / Scenario->BaudRate));
+	uint32_t Delivered      = MAX(Results->MessagesOut, 1);
+	uint32_t Packets        = ((Scenario->Direction == SCENARIO_ToHost) ? Results->INPackets : Results->OUTPackets);
+	uint32_t PacketBytes    = ((Scenario->Direction == SCENARIO_ToHost) ? Results->BytesOut : Results->BytesIn);
+	DeviceStats_t Stats;
+
+	Scenario_GetDeviceStats(&Stats);
+
+	printf("    {\n");
+	printf("      \"name\": \"%s\",\n", Scenario->Name);
+	printf("      \"mode\": \"%s\",\n", ((Scenario->Mode == MODE_Serial) ? "serial" : "midi"));
+	printf("      \"direction\": \"%s\",\n", ((Scenario->Direction == SCENARIO_ToHost) ? "to_host" : "to_target"));
+	printf("      \"baud_rate\": %u,\n", Scenario->BaudRate);
+	printf("      \"loop_period_us\": %u,\n", LoopPeriodUS);
+	printf("      \"simulated_ms\": %.3f,\n", (SimulatedTime / 1e6));
+	printf("      \"messages_in\": %u,\n", Results->MessagesIn);
+	printf("      \"messages_out\": %u,\n", Results->MessagesOut);
+	printf("      \"messages_lost\": %u,\n", (Results->MessagesIn - Results->MessagesOut));
+	printf("      \"mismatches\": %u,\n", Results->Mismatches);
+	printf("      \"bytes_in\": %u,\n", Results->BytesIn);
+	printf("      \"bytes_out\": %u,\n", Results->BytesOut);
+	printf("      \"usb_in_poll_us\": %u,\n", Scenario->INPollUS);
+	printf("      \"usb_endpoint_size\": %u,\n", ((Scenario->Mode == MODE_Serial) ? CDC_TXRX_EPSIZE : MIDI_STREAM_EPSIZE));
+	printf("      \"usb_packets\": %u,\n", Packets);
+	printf("      \"usb_bytes_per_packet\": %.2f,\n", (Packets ? ((double)PacketBytes / Packets) : 0.0));
+	printf("      \"out_bank_bytes_per_pass_mean\": %.2f,\n",
+	       (Results->OUTTakingPasses ? ((double)Results->OUTTakenBytes / Results->OUTTakingPasses) : 0.0));
+	printf("      \"out_bank_bytes_per_pass_max\": %u,\n", Results->OUTTakenMax);
+	printf("      \"line_utilisation\": %.3f,\n", (SimulatedTime ? (LineTime / SimulatedTime) : 0.0));
+	printf("      \"isr_cpu_share\": %.3f,\n", (Results->RunTime ? ((double)Results->ISRTime / Results->RunTime) : 0.0));
+	printf("      \"loop_period_mean_us\": %.1f,\n", (Results->LoopTimeTotal / (MAX(Results->LoopPasses, 1) * 1e3)));
+	printf("      \"loop_period_max_us\": %.1f,\n", (Results->LoopTimeMax / 1e3));
+	printf("      \"latency_mean_us\": %.1f,\n", (Results->LatencyTotal / (Delivered * 1e3)));
+	printf("      \"latency_max_us\": %.1f,\n", (Results->LatencyMax / 1e3));
+	printf("      \"running_status_bytes_saved\": %u,\n", Results->StatusBytesSaved);
+	printf("      \"direct_to_endpoint_bytes\": %u,\n", Results->DirectBytes);
+	printf("      \"overrun_bytes\": %u,\n", Results->OverrunBytes);
+	printf("      \"overrun_errors\": %u,\n", Stats.OverrunErrors);
+	printf("      \"dropped_bytes\": %u,\n", Stats.DroppedBytes);
+	printf("      \"dropped_midi_events\": %u,\n", Stats.DroppedMIDIEvents);
+	printf("      \"usart_to_usb_high_water\": %u,\n", Stats.USARTtoUSBHighWater);
+	printf("      \"usb_to_usart_high_water\": %u,\n", Stats.USBtoUSARTHighWater);
+	printf("      \"host_ns_per_byte\": %.1f\n", ((Results->HostSeconds * 1e9) / MAX(Results->BytesIn, 1)));
+	printf("    }%s\n", (Last ? "" : ","));
+}
+
+/** Writes the cycle model as one JSON object, giving each figure with whether it was given on the command line
+ *  or assumed.
+ */
+static void CycleModel_Report(const CycleModel_t* const Model,
+                              const uint32_t LoopPeriodUS)
+{
+	const struct
+	{
+		const char* Name;
+		uint32_t    Cycles;
+		uint8_t     Figure;
+	} Figures[] =
+		{
+			{"serial_rx_isr",  Model->SerialRXCycles,                    CYCLE_SerialRX},
+			{"midi_rx_isr",    Model->MIDIRXCycles,                      CYCLE_MIDIRX},
+			{"udre_isr",       Model->UDRECycles,                        CYCLE_UDRE},
+			{"tick_isr",       Model->TickCycles,                        CYCLE_Tick},
+			{"atomic",         Model->AtomicCycles,                      CYCLE_Atomic},
+			{"loop_pass",      (LoopPeriodUS * (F_CPU / 1000000UL)),     CYCLE_Loop},
+		};
+
+	printf("  \"cycle_model\": {\n");
+	printf("    \"cpu_hz\": %lu,\n", (unsigned long)F_CPU);
+
+	for (uint8_t i = 0; i < (sizeof(Figures) / sizeof(Figures[0])); i++)
+	{
+		printf("    \"%s_cycles\": {\"cycles\": %u, \"source\": \"%s\"}%s\n", Figures[i].Name, Figures[i].Cycles,
+		       ((Model->Given & Figures[i].Figure) ? "given" : "assumed"),
+		       ((i == ((sizeof(Figures) / sizeof(Figures[0])) - 1)) ? "" : ","));
+	}
+
+	printf("  },\n");
+}
+
+/** Runs a receive scenario at each of the \ref SweepBaudRates, writing the results at each rate and the highest
+ *  rates taken without an overrun and without any loss as one JSON object. Rates above the first to overrun do not
+ *  count, even if they happen not to.
+ *
+ *  \param[in] Base          Scenario to sweep, its baud rate being ignored
+ *  \param[in] LoopPeriodNS  Simulated time a main loop pass takes when no interrupt lands in it, in nanoseconds
+ *  \param[in] Model         Cycle model to charge the interrupts by
+ *  \param[in] Last          Whether this is the last object in its array
+ */
+static void Sweep_Run(const Scenario_t* const Base,
+                      const uint64_t LoopPeriodNS,
+                      const CycleModel_t* const Model,
+                      const bool Last)
+{
+	uint32_t MaxWithoutOverrun = 0;
+	uint32_t MaxWithoutLoss    = 0;
+	bool     Overrun           = false;
+	bool     Lost              = false;
+
+	printf("    {\n");
+	printf("      \"name\": \"%s\",\n", Base->Name);
+	printf("      \"mode\": \"%s\",\n", ((Base->Mode == MODE_Serial) ? "serial" : "midi"));
+	printf("      \"rates\": [\n");
+
+	for (uint8_t i = 0; i < (sizeof(SweepBaudRates) / sizeof(SweepBaudRates[0])); i++)
+	{
+		Scenario_t         Scenario = *Base;
+		Scenario_Results_t Results;
+		DeviceStats_t      Stats;
+
+		Scenario.BaudRate = SweepBaudRates[i];
+		Scenario_Run(&Scenario, LoopPeriodNS, Model, &Results);
+		Scenario_GetDeviceStats(&Stats);
+
+		uint32_t MessagesLost = (Results.MessagesIn - Results.MessagesOut);
+
+		Overrun |= (Results.OverrunBytes != 0);
+		Lost    |= (Overrun || MessagesLost || Results.Mismatches);
+
+		if (!(Overrun))
+		  MaxWithoutOverrun = Scenario.BaudRate;
+
+		if (!(Lost))
+		  MaxWithoutLoss = Scenario.BaudRate;
+
+		printf("        {\"baud_rate\": %u, \"overrun_bytes\": %u, \"messages_lost\": %u, \"dropped_bytes\": %u, "
+		       "\"dropped_midi_events\": %u, \"isr_cpu_share\": %.3f, \"loop_period_max_us\": %.1f}%s\n",
+		       Scenario.BaudRate, Results.OverrunBytes, MessagesLost, Stats.DroppedBytes,
+		       Stats.DroppedMIDIEvents, (Results.RunTime ? ((double)Results.ISRTime / Results.RunTime) : 0.0),
+		       (Results.LoopTimeMax / 1e3), ((i == ((sizeof(SweepBaudRates) / sizeof(SweepBaudRates[0])) - 1)) ? "" : ","));
+	}
+
+	printf("      ],\n");
+	printf("      \"max_baud_without_overrun\": %u,\n", MaxWithoutOverrun);
+	printf("      \"max_baud_without_loss\": %u\n", MaxWithoutLoss);
+	printf("    }%s\n", (Last ? "" : ","));
+
+	fprintf(stderr, "%-24s %s highest baud rate without overrun %u, without loss %u\n", "ScenarioRunner", Base->Name,
+	        MaxWithoutOverrun, MaxWithoutLoss);
+}
+
+/** Size of the image uploaded by the upload scenario, in bytes. */
+#define UPLOAD_IMAGE_SIZE        32768
+
+/** Flash page size of the target, the unit of the bootloader's page writes and reads, in bytes. */
+#define UPLOAD_PAGE_SIZE         128
+
+/** Baud rate of the target's bootloader, that of the optiboot bootloader of an ATmega328P board. */
+#define UPLOAD_BAUD_RATE         115200
+
+/** Time the target's bootloader takes to write a flash page before replying, in nanoseconds. */
+#define UPLOAD_PAGE_WRITE_NS     4500000ULL
+
+/** Time the uploader waits after asserting DTR before its first command, as avrdude's arduino programmer does,
+ *  in nanoseconds.
+ */
+#define UPLOAD_SETTLE_NS         50000000ULL
+
+/** Simulated time after which an upload is given up on, in nanoseconds. */
+#define UPLOAD_TIMEOUT_NS        60000000000ULL
+
+/** STK500 protocol bytes used by the upload scenario. */
+#define STK_OK                   0x10
+#define STK_INSYNC               0x14
+#define STK_CRC_EOP              0x20
+#define STK_GET_SYNC             0x30
+#define STK_LEAVE_PROGMODE       0x51
+#define STK_LOAD_ADDRESS         0x55
+#define STK_PROG_PAGE            0x64
+#define STK_READ_PAGE            0x74
+
+/** Type define for the results of an upload run. */
+typedef struct
+{
+	uint64_t StartTime; /**< Simulated time of the first command, in nanoseconds */
+	uint64_t VerifyTime; /**< Simulated time of the first command of the verification, in nanoseconds */
+	uint64_t EndTime; /**< Simulated time the last reply arrived, in nanoseconds */
+	uint32_t Commands; /**< Commands completed */
+	uint32_t BytesToTarget; /**< Bytes sent on the line to the target */
+	uint32_t BytesToHost; /**< Bytes received by the host */
+	uint32_t StaleBytes; /**< Bytes reaching the bootloader which the host did not send it after the reset */
+	uint32_t VerifyErrors; /**< Bytes read back differently from the uploaded image */
+	uint32_t ProtocolErrors; /**< Replies not framed as expected */
+	uint64_t ReplyWaitTotal; /**< Sum of the times from each command reaching the target to its whole reply reaching the host, in nanoseconds */
+	uint64_t ReplyWaitMax; /**< Longest time from a command reaching the target to its whole reply reaching the host, in nanoseconds */
+	bool     ResetPulsed; /**< Whether the target's reset line was pulsed */
+	double   HostSeconds; /**< Wall clock time the run took on the host */
+} Upload_Results_t;
+
+/** Returns the byte of the uploaded image at the given address. */
+static uint8_t Upload_ImageByte(const uint16_t Address)
+{
+	return (uint8_t)((Address * 13) ^ (Address >> 7));
+}
+
+/** Builds the given command of the upload, as avrdude sends them to an STK500 version 1 bootloader: a sync, a
+ *  load address and program page pair for each page, a load address and read page pair for each page to verify,
+ *  and a leave programming mode command.
+ *
+ *  \param[in]  Index        Index of the command
+ *  \param[out] Command      Location where the command is to be stored
+ *  \param[out] ReplyLength  Location where the length of its expected reply is to be stored
+ *
+ *  \return Length of the command in bytes, zero once past the last command
+ */
+static uint16_t Upload_Command(const uint32_t Index,
+                               uint8_t* const Command,
+                               uint16_t* const ReplyLength)
+{
+	const uint32_t Pages  = (UPLOAD_IMAGE_SIZE / UPLOAD_PAGE_SIZE);
+	uint16_t       Length = 0;
+
+	*ReplyLength = 2;
+
+	if (!(Index))
+	{
+		Command[Length++] = STK_GET_SYNC;
+	}
+	else if (Index <= (4 * Pages))
+	{
+		uint32_t Step    = (Index - 1);
+		uint16_t Address = (((Step / 2) % Pages) * UPLOAD_PAGE_SIZE);
+		bool     Verify  = (Step >= (2 * Pages));
+
+		if (!(Step & 1))
+		{
+			/* Addresses are given in words */
+			Command[Length++] = STK_LOAD_ADDRESS;
+			Command[Length++] = ((Address >> 1) & 0xFF);
+			Command[Length++] = (Address >> 9);
+		}
+		else
+		{
+			Command[Length++] = (Verify ? STK_READ_PAGE : STK_PROG_PAGE);
+			Command[Length++] = (UPLOAD_PAGE_SIZE >> 8);
+			Command[Length++] = (UPLOAD_PAGE_SIZE & 0xFF);
+			Command[Length++] = 'F';
+
+			if (Verify)
+			{
+				*ReplyLength += UPLOAD_PAGE_SIZE;
+			}
+			else
+			{
+				for (uint16_t i = 0; i < UPLOAD_PAGE_SIZE; i++)
+				  Command[Length++] = Upload_ImageByte(Address + i);
+			}
+		}
+	}
+	else if (Index == ((4 * Pages) + 1))
+	{
+		Command[Length++] = STK_LEAVE_PROGMODE;
+	}
+	else
+	{
+		return 0;
+	}
+
+	Command[Length++] = STK_CRC_EOP;
+	return Length;
+}
+
+/** Runs the upload of a 32KB image through the firmware in serial mode on the simulated timeline, with the host
+ *  playing avrdude and the target an STK500 version 1 bootloader which only listens once the firmware has pulsed
+ *  its reset line. Both ends of the bridge hold stale bytes when the host asserts DTR.
+ *
+ *  \param[in]  LoopPeriodNS  Simulated main loop period, in nanoseconds
+ *  \param[out] Results       Location where the results are to be stored
+ */
+static void Upload_Run(const uint64_t LoopPeriodNS,
+                       Upload_Results_t* const Results)
+{
+	const uint64_t ByteTimeNS = (10000000000ULL / UPLOAD_BAUD_RATE);
+
+	/* The host's side: the command being sent, how much of it has gone, and the reply so far */
+	uint8_t  Command[UPLOAD_PAGE_SIZE + 8];
+	uint16_t CommandLength;
+	uint16_t CommandSent = 0;
+	uint16_t ReplyLength;
+	uint16_t ReplyReceived = 0;
+	uint32_t CommandIndex  = 0;
+	uint16_t HostAddress   = 0;
+	uint64_t CommandEnd    = 0;
+	uint8_t  INData[HOST_SHIM_IN_LOG_SIZE];
+
+	/* The target's side: the command being received, and the reply being sent */
+	uint8_t  TargetCommand[UPLOAD_PAGE_SIZE + 8];
+	uint16_t TargetReceived = 0;
+	uint16_t TargetAddress  = 0;
+	uint8_t  TargetReply[UPLOAD_PAGE_SIZE + 2];
+	uint16_t TargetReplyLength   = 0;
+	uint16_t TargetReplyPosition = 0;
+	bool     TargetListening     = false;
+
+	uint64_t Now      = 0;
+	uint64_t NextRX   = 0;
+	uint64_t NextTick = 1000000;
+	uint64_t NextLoop = LoopPeriodNS;
+	uint64_t TXFreeAt = 0;
+
+	memset(Results, 0, sizeof(*Results));
+
+	Harness_Reset(MODE_Serial);
+	Harness_OpenSerialPort(UPLOAD_BAUD_RATE);
+
+	/* Leave a sketch's output waiting to go to the host, and the tail of earlier host data waiting to go out */
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		UDR1 = ('0' + (i % 10));
+		USART1_RX_vect();
+	}
+
+	memset(Command, 'x', CDC_TXRX_EPSIZE);
+
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		HostShim_SendOUT(CDC_RX_EPADDR, Command, CDC_TXRX_EPSIZE);
+		Serial_To_Arduino();
+	}
+
+	Harness_SetControlLines(CDC_CONTROL_LINE_OUT_DTR | CDC_CONTROL_LINE_OUT_RTS);
+
+	CommandLength = Upload_Command(CommandIndex, Command, &ReplyLength);
+
+	double HostStart = Scenario_Now();
+
+	while (CommandLength && (Now < UPLOAD_TIMEOUT_NS))
+	{
+		bool InReset  = !(AVR_RESET_LINE_PORT & AVR_RESET_LINE_MASK);
+		bool TXActive = (UCSR1B & (1 << UDRIE1));
+		bool RXActive = (TargetReplyPosition < TargetReplyLength);
+
+		uint64_t Next = MIN(NextTick, NextLoop);
+
+		if (RXActive)
+		  Next = MIN(Next, NextRX);
+
+		if (TXActive)
+		  Next = MIN(Next, MAX(TXFreeAt, Now));
+
+		Now = Next;
+
+		if (InReset)
+		{
+			Results->ResetPulsed = true;
+			TargetListening      = false;
+			TargetReceived       = 0;
+		}
+		else if (Results->ResetPulsed)
+		{
+			TargetListening = true;
+		}
+
+		/* The bootloader sends its reply a byte at a time once it is ready */
+		if (RXActive && (Now >= NextRX))
+		{
+			UDR1 = TargetReply[TargetReplyPosition++];
+			USART1_RX_vect();
+
+			NextRX += ByteTimeNS;
+		}
+
+		if (TXActive && (Now >= TXFreeAt))
+		{
+			bool BytePending = !(USBtoUSART_Buffer_IsEmpty());
+
+			USART1_UDRE_vect();
+
+			if (BytePending)
+			{
+				uint8_t  Byte    = UDR1;
+				uint64_t Arrival = (Now + ByteTimeNS);
+
+				TXFreeAt = Arrival;
+
+				/* Anything reaching the bootloader before the host has sent a command since the reset is stale */
+				if (TargetListening && !(Results->StartTime))
+				  Results->StaleBytes++;
+				else if (TargetListening && (TargetReceived < sizeof(TargetCommand)))
+				  TargetCommand[TargetReceived++] = Byte;
+
+				if (Results->StartTime)
+				  Results->BytesToTarget++;
+
+				if (TargetReceived && (Byte == STK_CRC_EOP))
+				{
+					uint8_t  ExpectedLength = 2;
+					uint64_t ReplyDelay     = 0;
+
+					switch (TargetCommand[0])
+					{
+						case STK_LOAD_ADDRESS:
+							ExpectedLength = 4;
+							break;
+						case STK_PROG_PAGE:
+						case STK_READ_PAGE:
+							ExpectedLength = 5 + ((TargetCommand[0] == STK_PROG_PAGE) ? UPLOAD_PAGE_SIZE : 0);
+							break;
+					}
+
+					if (TargetReceived == ExpectedLength)
+					{
+						TargetReplyLength   = 0;
+						TargetReplyPosition = 0;
+
+						TargetReply[TargetReplyLength++] = STK_INSYNC;
+
+						if (TargetCommand[0] == STK_LOAD_ADDRESS)
+						{
+							TargetAddress = ((TargetCommand[1] | (TargetCommand[2] << 8)) << 1);
+						}
+						else if (TargetCommand[0] == STK_PROG_PAGE)
+						{
+							ReplyDelay = UPLOAD_PAGE_WRITE_NS;
+						}
+						else if (TargetCommand[0] == STK_READ_PAGE)
+						{
+							for (uint16_t i = 0; i < UPLOAD_PAGE_SIZE; i++)
+							  TargetReply[TargetReplyLength++] = Upload_ImageByte(TargetAddress + i);
+						}
+
+						TargetReply[TargetReplyLength++] = STK_OK;
+						TargetReceived = 0;
+
+						/* The reply's first byte is on the line one byte time after the bootloader starts it */
+						CommandEnd = Arrival;
+						NextRX     = (Arrival + ReplyDelay + ByteTimeNS);
+					}
+				}
+			}
+		}
+
+		if (Now >= NextTick)
+		{
+			TIMER0_COMPA_vect();
+			NextTick += 1000000;
+		}
+
+		if (Now >= NextLoop)
+		{
+			/* After the settling time, the host sends each command in packets and waits for its reply */
+			if ((Now >= UPLOAD_SETTLE_NS) && (CommandSent < CommandLength))
+			{
+				uint16_t PacketLength = MIN((uint16_t)(CommandLength - CommandSent), (uint16_t)CDC_TXRX_EPSIZE);
+
+				if (!(Results->StartTime))
+				  Results->StartTime = Now;
+
+				if (HostShim_SendOUT(CDC_RX_EPADDR, &Command[CommandSent], PacketLength))
+				  CommandSent += PacketLength;
+			}
+
+			Harness_MainLoopPass();
+
+			uint16_t INLength = HostShim_TakeIN(CDC_TX_EPADDR, INData, sizeof(INData));
+
+			/* The host drains anything received before its first command, as avrdude does */
+			if (!(Results->StartTime))
+			  INLength = 0;
+
+			Results->BytesToHost += INLength;
+
+			for (uint16_t i = 0; (i < INLength) && CommandLength; i++)
+			{
+				uint8_t Byte = INData[i];
+
+				if (ReplyReceived == 0)
+				{
+					if (Byte != STK_INSYNC)
+					  Results->ProtocolErrors++;
+				}
+				else if (ReplyReceived == (ReplyLength - 1))
+				{
+					if (Byte != STK_OK)
+					  Results->ProtocolErrors++;
+				}
+				else if (Byte != Upload_ImageByte(HostAddress + ReplyReceived - 1))
+				{
+					Results->VerifyErrors++;
+				}
+
+				if (++ReplyReceived < ReplyLength)
+				  continue;
+
+				/* The whole reply is in, so the command is done */
+				uint64_t Wait = (Now - CommandEnd);
+
+				Results->ReplyWaitTotal += Wait;
+				Results->ReplyWaitMax    = MAX(Results->ReplyWaitMax, Wait);
+				Results->Commands++;
+
+				CommandIndex++;
+				CommandLength    = Upload_Command(CommandIndex, Command, &ReplyLength);
+				CommandSent      = 0;
+				ReplyReceived    = 0;
+				Results->EndTime = Now;
+
+				if (Command[0] == STK_LOAD_ADDRESS)
+				  HostAddress = ((Command[1] | (Command[2] << 8)) << 1);
+				else if ((Command[0] == STK_READ_PAGE) && !(Results->VerifyTime))
+				  Results->VerifyTime = Now;
+			}
+
+			NextLoop += LoopPeriodNS;
+		}
+
+	}
+
+	Results->HostSeconds   = (Scenario_Now() - HostStart);
+}
+
+/** Writes the results of an upload as one JSON object. */
+static void Upload_Report(const Upload_Results_t* const Results,
+                          const uint32_t LoopPeriodUS)
+{
+	uint64_t UploadTime = (Results->EndTime - Results->StartTime);
+	double   LineTime   = ((Results->BytesToTarget + Results->BytesToHost) * (10e9 / UPLOAD_BAUD_RATE));
+
+	printf("    {\n");
+	printf("      \"name\": \"upload_32k_115200\",\n");
+	printf("      \"image_bytes\": %u,\n", UPLOAD_IMAGE_SIZE);
+	printf("      \"page_bytes\": %u,\n", UPLOAD_PAGE_SIZE);
+	printf("      \"baud_rate\": %u,\n", UPLOAD_BAUD_RATE);
+	printf("      \"loop_period_us\": %u,\n", LoopPeriodUS);
+	printf("      \"latency_timer_ms\": %u,\n", DEFAULT_LATENCY_TIMER_MS);
+	printf("      \"reset_pulsed\": %s,\n", (Results->ResetPulsed ? "true" : "false"));
+	printf("      \"stale_bytes_to_bootloader\": %u,\n", Results->StaleBytes);
+	printf("      \"commands\": %u,\n", Results->Commands);
+	printf("      \"protocol_errors\": %u,\n", Results->ProtocolErrors);
+	printf("      \"verify_errors\": %u,\n", Results->VerifyErrors);
+	printf("      \"bytes_to_target\": %u,\n", Results->BytesToTarget);
+	printf("      \"bytes_to_host\": %u,\n", Results->BytesToHost);
+	printf("      \"upload_ms\": %.1f,\n", (UploadTime / 1e6));
+	printf("      \"write_ms\": %.1f,\n", ((Results->VerifyTime - Results->StartTime) / 1e6));
+	printf("      \"verify_ms\": %.1f,\n", ((Results->EndTime - Results->VerifyTime) / 1e6));
+	printf("      \"line_time_ms\": %.1f,\n", (LineTime / 1e6));
+	printf("      \"reply_wait_mean_us\": %.1f,\n", (Results->ReplyWaitTotal / (MAX(Results->Commands, 1) * 1e3)));
+	printf("      \"reply_wait_max_us\": %.1f,\n", (Results->ReplyWaitMax / 1e3));
+	printf("      \"host_ms\": %.1f\n", (Results->HostSeconds * 1e3));
+	printf("    }\n");
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t LoopPeriodUS = DEFAULT_LOOP_PERIOD_US;
+	bool     Selected[sizeof(Scenarios) / sizeof(Scenarios[0])];
+	bool     UploadSelected = false;
+	bool     SweepSelected  = false;
+	bool     AnySelected    = false;
+	uint8_t  Failed         = 0;
+
+	CycleModel_t Model =
+		{
+			.SerialRXCycles = DEFAULT_SERIAL_RX_CYCLES,
+			.MIDIRXCycles   = DEFAULT_MIDI_RX_CYCLES,
+			.UDRECycles     = DEFAULT_UDRE_CYCLES,
+			.TickCycles     = DEFAULT_TICK_CYCLES,
+			.AtomicCycles   = DEFAULT_ATOMIC_CYCLES,
+		};
+
+	const struct
+	{
+		const char* Option;
+		uint16_t*   Cycles;
+		uint8_t     Figure;
+	} CycleOptions[] =
+		{
+			{"-serial-rx-cycles", &Model.SerialRXCycles, CYCLE_SerialRX},
+			{"-midi-rx-cycles",   &Model.MIDIRXCycles,   CYCLE_MIDIRX},
+			{"-udre-cycles",      &Model.UDRECycles,     CYCLE_UDRE},
+			{"-tick-cycles",      &Model.TickCycles,     CYCLE_Tick},
+			{"-atomic-cycles",    &Model.AtomicCycles,   CYCLE_Atomic},
+		};
+
+	memset(Selected, 0, sizeof(Selected));
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool Found = false;
+
+		if (!(strcmp(argv[i], "-loop-us")) && ((i + 1) < argc))
+		{
+			LoopPeriodUS = strtoul(argv[++i], NULL, 0);
+			Model.Given |= CYCLE_Loop;
+			continue;
+		}
+
+		for (uint8_t j = 0; j < (sizeof(CycleOptions) / sizeof(CycleOptions[0])); j++)
+		{
+			if (!(strcmp(argv[i], CycleOptions[j].Option)) && ((i + 1) < argc))
+			{
+				*CycleOptions[j].Cycles = strtoul(argv[++i], NULL, 0);
+				Model.Given |= CycleOptions[j].Figure;
+				Found        = true;
+			}
+		}
+
+		if (Found)
+		  continue;
+
+		Found = !(strcmp(argv[i], "upload_32k_115200"));
+		UploadSelected |= Found;
+
+		if (!(strcmp(argv[i], "max_baud")))
+		{
+			SweepSelected = true;
+			Found         = true;
+		}
+
+		for (uint8_t j = 0; j < (sizeof(Scenarios) / sizeof(Scenarios[0])); j++)
+		{
+			if (!(strcmp(argv[i], Scenarios[j].Name)))
+			{
+				Selected[j] = true;
+				Found       = true;
+			}
+		}
+
+		if (!(Found))
+		{
+			fprintf(stderr, "Usage: %s [-loop-us N] [-serial-rx-cycles N] [-midi-rx-cycles N] [-udre-cycles N]\n"
+			                "       [-tick-cycles N] [-atomic-cycles N] [scenario, upload or max_baud names...]\n",
+			        argv[0]);
+			return 2;
+		}
+
+		AnySelected = true;
+	}
+
+	if (!(LoopPeriodUS))
+	{
+		fprintf(stderr, "The main loop pass cannot take no time\n");
+		return 2;
+	}
+
+	uint8_t Remaining = 0;
+
+	for (uint8_t j = 0; j < (sizeof(Scenarios) / sizeof(Scenarios[0])); j++)
+	{
+		Selected[j] |= !(AnySelected);
+		Remaining   += Selected[j];
+	}
+
+	UploadSelected |= !(AnySelected);
+	SweepSelected  |= !(AnySelected);
+
+	printf("{\n");
+	CycleModel_Report(&Model, LoopPeriodUS);
+	printf("  \"scenarios\": [\n");
+
+	for (uint8_t j = 0; j < (sizeof(Scenarios) / sizeof(Scenarios[0])); j++)
+	{
+		Scenario_Results_t Results;
+
+		if (!(Selected[j]))
+		  continue;
+
+		Scenario_Run(&Scenarios[j], (LoopPeriodUS * 1000ULL), &Model, &Results);
+		Scenario_Report(&Scenarios[j], &Results, LoopPeriodUS, !(--Remaining));
+
+		/* At these rates the device keeps up, so every message must come through intact */
+		if ((Results.MessagesOut != Results.MessagesIn) || Results.Mismatches)
+		{
+			fprintf(stderr, "%s: %u of %u messages delivered, %u mismatched\n", Scenarios[j].Name,
+			        Results.MessagesOut, Results.MessagesIn, Results.Mismatches);
+			Failed++;
+		}
+
+		/* With room in the USART transmit buffer, a pass takes a whole OUT packet at once */
+		if ((Scenarios[j].Direction == SCENARIO_ToTarget) && (Results.OUTTakenMax < CDC_TXRX_EPSIZE))
+		{
+			fprintf(stderr, "%s: at most %u bytes taken from the OUT bank in a pass\n", Scenarios[j].Name,
+			        Results.OUTTakenMax);
+			Failed++;
+		}
+
+		/* Events arriving faster than the host polls must share the IN packets, rather than one per packet */
+		if (Scenarios[j].INPollUS && (Scenarios[j].Mode == MODE_MIDI) && (Scenarios[j].Direction == SCENARIO_ToHost) &&
+		    (Results.BytesOut <= (Results.INPackets * sizeof(MIDI_EventPacket_t))))
+		{
+			fprintf(stderr, "%s: %u events in %u IN packets, none packed together\n", Scenarios[j].Name,
+			        Results.MessagesOut, Results.INPackets);
+			Failed++;
+		}
+	}
+
+	printf("  ],\n  \"max_baud\": [\n");
+
+	if (SweepSelected)
+	{
+		for (uint8_t j = 0; j < (sizeof(SweepScenarios) / sizeof(SweepScenarios[0])); j++)
+		{
+			Sweep_Run(&SweepScenarios[j], (LoopPeriodUS * 1000ULL), &Model,
+			          (j == ((sizeof(SweepScenarios) / sizeof(SweepScenarios[0])) - 1)));
+		}
+	}
+
+	printf("  ],\n  \"uploads\": [\n");
+
+	if (UploadSelected)
+	{
+		Upload_Results_t Results;
+
+		Upload_Run((LoopPeriodUS * 1000ULL), &Results);
+		Upload_Report(&Results, LoopPeriodUS);
+
+		/* Every command must have had its reply, with the image read back as it was written */
+		if (!(Results.ResetPulsed) || Results.StaleBytes || Results.ProtocolErrors || Results.VerifyErrors ||
+		    (Results.Commands != ((4 * (UPLOAD_IMAGE_SIZE / UPLOAD_PAGE_SIZE)) + 2)))
+		{
+			fprintf(stderr, "upload_32k_115200: %u commands, %u stale bytes, %u protocol and %u verify errors\n",
+			        Results.Commands, Results.StaleBytes, Results.ProtocolErrors, Results.VerifyErrors);
+			Failed++;
+		}
+	}
+
+	printf("  ]\n}\n");
+
+	return (Failed ? 1 : 0);
+}
@@ -0,0 +1,410 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Host shims of the AVR registers and of the LUFA USB device stack, so that the firmware can be built and run
+ *  natively. Registers are plain globals, ISRs are called directly by the tests, and each endpoint is modelled by
+ *  a single bank which the tests fill and drain in the role of the USB host.
+ */
+
+#include "HostShims.h"
+
+#include <string.h>
+
+/* Registers */
+volatile uint8_t  DDRB, PORTB, PINB, DDRC, PORTC, PINC, DDRD, PORTD, PIND;
+volatile uint8_t  MCUSR, GPIOR0, UENUM;
+volatile uint8_t  TCCR0A, TCCR0B, OCR0A, TIFR0, TIMSK0, TCNT0;
+volatile uint8_t  TCCR1A, TCCR1B, TIFR1, TIMSK1;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t  UCSR1A, UCSR1B, UCSR1C, UDR1;
+volatile uint16_t UBRR1;
+
+/* USB device stack state */
+volatile uint8_t     USB_DeviceState;
+USB_Request_Header_t USB_ControlRequest;
+
+/** Model of each endpoint, indexed by endpoint number. */
+HostShim_Endpoint_t HostShim_Endpoints[HOST_SHIM_ENDPOINTS];
+
+/** Data stage of the last control request, written by the host for OUT requests and by the firmware for IN ones. */
+uint8_t  HostShim_ControlData[HOST_SHIM_CONTROL_SIZE];
+uint16_t HostShim_ControlLength;
+
+/** Whether the firmware took the last control request, by clearing its SETUP packet. */
+bool HostShim_ControlHandled;
+
+/** Baud rate last given to the LUFA serial driver. */
+uint32_t HostShim_SerialBaud;
+
+/** Whether each IN packet keeps its endpoint busy until the host collects it with \ref HostShim_TakeIN(), rather
+ *  than being taken as soon as it is sent.
+ */
+bool HostShim_HoldIN;
+
+/** Whether the device is attached to the bus. */
+bool HostShim_Attached;
+
+/** Milliseconds the firmware has spent in Delay_MS() since the last reset. Nothing waits, the time is only added up. */
+uint32_t HostShim_DelayedMS;
+
+/** Number of the endpoint selected by the firmware, including the direction bit. */
+static uint8_t SelectedEndpoint;
+
+/** Event handler of the firmware for control requests, called by \ref HostShim_ControlRequest(). */
+void EVENT_USB_Device_ControlRequest(void);
+
+/** Retrieves the model of the endpoint selected by the firmware.
+ *
+ *  \return Pointer to the selected endpoint's model
+ */
+static HostShim_Endpoint_t* HostShim_Selected(void)
+{
+	return &HostShim_Endpoints[SelectedEndpoint & (HOST_SHIM_ENDPOINTS - 1)];
+}
+
+/** Returns every register, endpoint and the USB state to their power on values, with the device configured. */
+void HostShim_Reset(void)
+{
+	DDRB  = 0; PORTB = 0; PINB = 0; DDRC = 0; PORTC = 0; PINC = 0; DDRD = 0; PORTD = 0; PIND = 0;
+	MCUSR = 0; GPIOR0 = 0; UENUM = 0;
+	TCCR0A = 0; TCCR0B = 0; OCR0A = 0; TIFR0 = 0; TIMSK0 = 0; TCNT0 = 0;
+	TCCR1A = 0; TCCR1B = 0; TIFR1 = 0; TIMSK1 = 0; TCNT1 = 0; OCR1A = 0;
+	UCSR1A = (1 << UDRE1); UCSR1B = 0; UCSR1C = 0; UDR1 = 0; UBRR1 = 0;
+
+	memset(HostShim_Endpoints, 0, sizeof(HostShim_Endpoints));
+	memset(&USB_ControlRequest, 0, sizeof(USB_ControlRequest));
+
+	HostShim_ControlLength  = 0;
+	HostShim_ControlHandled = false;
+	HostShim_SerialBaud     = 0;
+	HostShim_HoldIN         = false;
+	HostShim_Attached       = true;
+	HostShim_DelayedMS      = 0;
+	SelectedEndpoint        = 0;
+	USB_DeviceState         = DEVICE_STATE_Configured;
+}
+
+/** Loads a packet from the host into an OUT endpoint, as long as the firmware has cleared the previous one.
+ *
+ *  \param[in] Address  Address of the OUT endpoint
+ *  \param[in] Data     Data of the packet
+ *  \param[in] Length   Length of the packet in bytes, up to \ref HOST_SHIM_BANK_SIZE
+ *
+ *  \return Boolean \c true if the packet was loaded, \c false if the endpoint was still full
+ */
+bool HostShim_SendOUT(const uint8_t Address,
+                      const void* const Data,
+                      const uint16_t Length)
+{
+	HostShim_Endpoint_t* Endpoint = &HostShim_Endpoints[Address & (HOST_SHIM_ENDPOINTS - 1)];
+
+	if (Endpoint->OUTReceived || (Length > HOST_SHIM_BANK_SIZE))
+	  return false;
+
+	memcpy(Endpoint->Bank, Data, Length);
+	Endpoint->Length      = Length;
+	Endpoint->Position    = 0;
+	Endpoint->OUTReceived = true;
+
+	return true;
+}
+
+/** Collects the data sent through an IN endpoint since the last call, clearing its log and freeing the endpoint
+ *  for the next packet.
+ *
+ *  \param[in]  Address    Address of the IN endpoint
+ *  \param[out] Buffer     Location where the data is to be stored
+ *  \param[in]  MaxLength  Size of \c Buffer in bytes
+ *
+ *  \return Number of bytes stored
+ */
+uint16_t HostShim_TakeIN(const uint8_t Address,
+                         void* const Buffer,
+                         const uint16_t MaxLength)
+{
+	HostShim_Endpoint_t* Endpoint = &HostShim_Endpoints[Address & (HOST_SHIM_ENDPOINTS - 1)];
+	uint16_t             Length   = MIN(Endpoint->INLogLength, MaxLength);
+
+	memcpy(Buffer, Endpoint->INLog, Length);
+	memmove(Endpoint->INLog, &Endpoint->INLog[Length], (Endpoint->INLogLength - Length));
+	Endpoint->INLogLength -= Length;
+	Endpoint->INBusy       = false;
+
+	return Length;
+}
+
+/** Passes a control request from the host to the firmware, with its data stage.
+ *
+ *  \param[in]     bmRequestType  Request type, direction and recipient
+ *  \param[in]     bRequest       Request number
+ *  \param[in]     wValue         Request value
+ *  \param[in]     wIndex         Request index
+ *  \param[in,out] Data           Data stage, sent for host to device requests and returned for device to host ones
+ *  \param[in]     Length         Length of the data stage in bytes, up to \ref HOST_SHIM_CONTROL_SIZE
+ *
+ *  \return Boolean \c true if the firmware handled the request, \c false if it would have been stalled
+ */
+bool HostShim_ControlRequest(const uint8_t bmRequestType,
+                             const uint8_t bRequest,
+                             const uint16_t wValue,
+                             const uint16_t wIndex,
+                             void* const Data,
+                             const uint16_t Length)
+{
+	USB_ControlRequest = (USB_Request_Header_t)
+		{
+			.bmRequestType = bmRequestType,
+			.bRequest      = bRequest,
+			.wValue        = wValue,
+			.wIndex        = wIndex,
+			.wLength       = Length,
+		};
+
+	HostShim_ControlHandled = false;
+	HostShim_ControlLength  = 0;
+
+	if (!(bmRequestType & REQDIR_DEVICETOHOST) && Length)
+	{
+		memcpy(HostShim_ControlData, Data, Length);
+		HostShim_ControlLength = Length;
+	}
+
+	EVENT_USB_Device_ControlRequest();
+
+	if ((bmRequestType & REQDIR_DEVICETOHOST) && Length)
+	  memcpy(Data, HostShim_ControlData, MIN(Length, HostShim_ControlLength));
+
+	return HostShim_ControlHandled;
+}
+
+void USB_Init(void)
+{
+	HostShim_Attached = true;
+}
+
+void USB_Disable(void)
+{
+	HostShim_Attached = false;
+	USB_DeviceState   = DEVICE_STATE_Unattached;
+}
+
+void USB_USBTask(void)
+{
+}
+
+void Delay_MS(uint16_t Milliseconds)
+{
+	HostShim_DelayedMS += Milliseconds;
+}
+
+void Endpoint_SelectEndpoint(const uint8_t Address)
+{
+	SelectedEndpoint = Address;
+}
+
+uint8_t Endpoint_GetCurrentEndpoint(void)
+{
+	return SelectedEndpoint;
+}
+
+bool Endpoint_ConfigureEndpoint(const uint8_t Address,
+                                const uint8_t Type,
+                                const uint16_t Size,
+                                const uint8_t Banks)
+{
+	return (((Address & ENDPOINT_EPNUM_MASK) < HOST_SHIM_ENDPOINTS) && (Size <= HOST_SHIM_BANK_SIZE) &&
+	        (Banks >= 1) && (Banks <= 2) && (Type <= EP_TYPE_INTERRUPT));
+}
+
+bool Endpoint_IsINReady(void)
+{
+	return !(HostShim_Selected()->INBusy);
+}
+
+bool Endpoint_IsOUTReceived(void)
+{
+	return HostShim_Selected()->OUTReceived;
+}
+
+uint16_t Endpoint_BytesInEndpoint(void)
+{
+	HostShim_Endpoint_t* Endpoint = HostShim_Selected();
+
+	if (SelectedEndpoint & ENDPOINT_DIR_IN)
+	  return Endpoint->Length;
+	else
+	  return (Endpoint->Length - Endpoint->Position);
+}
+
+void Endpoint_ClearIN(void)
+{
+	HostShim_Endpoint_t* Endpoint = HostShim_Selected();
+	uint16_t             Room     = (HOST_SHIM_IN_LOG_SIZE - Endpoint->INLogLength);
+	uint16_t             Length   = MIN(Endpoint->Length, Room);
+
+	memcpy(&Endpoint->INLog[Endpoint->INLogLength], Endpoint->Bank, Length);
+	Endpoint->INLogLength += Length;
+	Endpoint->INPackets++;
+	Endpoint->Length = 0;
+	Endpoint->INBusy = HostShim_HoldIN;
+}
+
+void Endpoint_ClearOUT(void)
+{
+	HostShim_Endpoint_t* Endpoint = HostShim_Selected();
+
+	if (SelectedEndpoint == ENDPOINT_CONTROLEP)
+	  return;
+
+	Endpoint->OUTReceived = false;
+	Endpoint->Length      = 0;
+	Endpoint->Position    = 0;
+	Endpoint->OUTPackets++;
+}
+
+void Endpoint_ClearSETUP(void)
+{
+	HostShim_ControlHandled = true;
+}
+
+void Endpoint_ClearStatusStage(void)
+{
+}
+
+uint8_t Endpoint_Read_8(void)
+{
+	HostShim_Endpoint_t* Endpoint = HostShim_Selected();
+
+	return (Endpoint->Position < Endpoint->Length) ? Endpoint->Bank[Endpoint->Position++] : 0;
+}
+
+void Endpoint_Write_8(const uint8_t Data)
+{
+	HostShim_Endpoint_t* Endpoint = HostShim_Selected();
+
+	if (Endpoint->Length < HOST_SHIM_BANK_SIZE)
+	  Endpoint->Bank[Endpoint->Length++] = Data;
+}
+
+uint8_t Endpoint_Read_Stream_LE(void* const Buffer,
+                                uint16_t Length,
+                                uint16_t* const BytesProcessed)
+{
+	for (uint16_t i = 0; i < Length; i++)
+	  ((uint8_t*)Buffer)[i] = Endpoint_Read_8();
+
+	if (BytesProcessed)
+	  *BytesProcessed += Length;
+
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t Endpoint_Write_Stream_LE(const void* const Buffer,
+                                 uint16_t Length,
+                                 uint16_t* const BytesProcessed)
+{
+	for (uint16_t i = 0; i < Length; i++)
+	  Endpoint_Write_8(((const uint8_t*)Buffer)[i]);
+
+	if (BytesProcessed)
+	  *BytesProcessed += Length;
+
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t Endpoint_Write_Control_Stream_LE(const void* const Buffer,
+                                         uint16_t Length)
+{
+	HostShim_ControlLength = MIN(Length, HOST_SHIM_CONTROL_SIZE);
+	memcpy(HostShim_ControlData, Buffer, HostShim_ControlLength);
+
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+bool CDC_Device_ConfigureEndpoints(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
+{
+	return (Endpoint_ConfigureEndpoint(CDCInterfaceInfo->Config.DataINEndpoint.Address, EP_TYPE_BULK,
+	                                   CDCInterfaceInfo->Config.DataINEndpoint.Size,
+	                                   CDCInterfaceInfo->Config.DataINEndpoint.Banks) &&
+	        Endpoint_ConfigureEndpoint(CDCInterfaceInfo->Config.DataOUTEndpoint.Address, EP_TYPE_BULK,
+	                                   CDCInterfaceInfo->Config.DataOUTEndpoint.Size,
+	                                   CDCInterfaceInfo->Config.DataOUTEndpoint.Banks) &&
+	        Endpoint_ConfigureEndpoint(CDCInterfaceInfo->Config.NotificationEndpoint.Address, EP_TYPE_INTERRUPT,
+	                                   CDCInterfaceInfo->Config.NotificationEndpoint.Size,
+	                                   CDCInterfaceInfo->Config.NotificationEndpoint.Banks));
+}
+
+void CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
+{
+	(void)CDCInterfaceInfo;
+}
+
+void CDC_Device_USBTask(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
+{
+	(void)CDCInterfaceInfo;
+}
+
+void CDC_Device_SendControlLineStateChange(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
+{
+	/* SerialState notification, with the line states in its two byte data stage */
+	const uint8_t Notification[] =
+		{
+			(REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE), CDC_NOTIF_SerialState,
+			0, 0, 0, 0, 2, 0,
+			CDCInterfaceInfo->State.ControlLineStates.DeviceToHost, 0
+		};
+
+	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.NotificationEndpoint.Address);
+	Endpoint_Write_Stream_LE(Notification, sizeof(Notification), NULL);
+	Endpoint_ClearIN();
+}
+
+void Serial_Init(const uint32_t BaudRate,
+                 const bool DoubleSpeed)
+{
+	(void)DoubleSpeed;
+
+	HostShim_SerialBaud = BaudRate;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* Address)
+{
+	/* Each EEMEM variable stands in for its own EEPROM cell */
+	return *Address;
+}
+
+void eeprom_update_byte(uint8_t* Address,
+                        uint8_t Value)
+{
+	*Address = Value;
+}
@@ -0,0 +1,94 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+
+/** \file
+ *
+ *  Header file for HostShims.c.
+ */
+
+#ifndef _HOST_SHIMS_H_
+#define _HOST_SHIMS_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+
+		#include <LUFA/Drivers/USB/USB.h>
+
+	/* Macros: */
+		/** Number of endpoint numbers modelled, enough for every endpoint of the largest supported part. */
+		#define HOST_SHIM_ENDPOINTS        8
+
+		/** Size in bytes of the bank of each modelled endpoint. */
+		#define HOST_SHIM_BANK_SIZE        64
+
+		/** Size in bytes of the log of the data sent through each IN endpoint. */
+		#define HOST_SHIM_IN_LOG_SIZE      4096
+
+		/** Size in bytes of the data stage buffer of the control endpoint. */
+		#define HOST_SHIM_CONTROL_SIZE     64
+
+	/* Type Defines: */
+		/** Type define for the model of one endpoint. An OUT endpoint holds a packet loaded by the simulated host
+		 *  until the firmware clears it, an IN endpoint holds the packet the firmware is filling in, and appends
+		 *  it to its log once cleared.
+		 */
+		typedef struct
+		{
+			uint8_t  Bank[HOST_SHIM_BANK_SIZE]; /**< Data of the packet in the endpoint bank */
+			uint16_t Length; /**< Number of bytes in the bank */
+			uint16_t Position; /**< Number of bytes of an OUT packet already read by the firmware */
+			bool     OUTReceived; /**< Whether an OUT packet waits to be read and cleared */
+			bool     INBusy; /**< Whether the host has yet to collect the previous IN packet */
+			uint8_t  INLog[HOST_SHIM_IN_LOG_SIZE]; /**< Data of the IN packets sent so far */
+			uint16_t INLogLength; /**< Number of bytes in \c INLog */
+			uint32_t INPackets; /**< Number of IN packets sent, including zero length packets */
+			uint32_t OUTPackets; /**< Number of OUT packets cleared by the firmware */
+		} HostShim_Endpoint_t;
+
+	/* External Variables: */
+		extern HostShim_Endpoint_t HostShim_Endpoints[HOST_SHIM_ENDPOINTS];
+		extern uint8_t             HostShim_ControlData[HOST_SHIM_CONTROL_SIZE];
+		extern uint16_t            HostShim_ControlLength;
+		extern bool                HostShim_ControlHandled;
+		extern uint32_t            HostShim_SerialBaud;
+		extern bool                HostShim_HoldIN;
+		extern bool                HostShim_Attached;
+		extern uint32_t            HostShim_DelayedMS;
+
+	/* Function Prototypes: */
+		void     HostShim_Reset(void);
+		bool     HostShim_SendOUT(const uint8_t Address, const void* const Data, const uint16_t Length);
+		uint16_t HostShim_TakeIN(const uint8_t Address, void* const Buffer, const uint16_t MaxLength);
+		bool     HostShim_ControlRequest(const uint8_t bmRequestType, const uint8_t bRequest, const uint16_t wValue,
+		                                 const uint16_t wIndex, void* const Data, const uint16_t Length);
+
+#endif
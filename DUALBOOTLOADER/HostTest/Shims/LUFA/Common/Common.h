@@ -0,0 +1,53 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the LUFA common definitions used by the firmware.
+ */
+
+#ifndef _HOST_SHIM_LUFA_COMMON_H_
+#define _HOST_SHIM_LUFA_COMMON_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+		#include <stddef.h>
+		#include <string.h>
+
+		#if defined(USE_LUFA_CONFIG_HEADER)
+			#include "LUFAConfig.h"
+		#endif
+
+	/* Macros: */
+		#define ATTR_WARN_UNUSED_RESULT
+		#define ATTR_NON_NULL_PTR_ARG(...)
+		#define ATTR_ALWAYS_INLINE
+		#define ATTR_PACKED                   __attribute__((packed))
+
+		#define MIN(x, y)                     (((x) < (y)) ? (x) : (y))
+		#define MAX(x, y)                     (((x) > (y)) ? (x) : (y))
+
+		#define GCC_MEMORY_BARRIER()          __asm__ __volatile__ ("" ::: "memory")
+		#define STATIC_ASSERT(Condition, Message)  _Static_assert(Condition, Message)
+
+		#define CPU_TO_LE16(x)                (x)
+		#define LE16_TO_CPU(x)                (x)
+		#define VERSION_BCD(Major, Minor, Revision)  (((Major) << 8) | ((Minor) << 4) | (Revision))
+
+		#define GlobalInterruptEnable()       do { } while (0)
+		#define GlobalInterruptDisable()      do { } while (0)
+
+	/* Type Defines: */
+		typedef uint8_t uint_reg_t;
+
+	/* Inline Functions: */
+		static inline uint_reg_t GetGlobalInterruptMask(void) { return 0; }
+		static inline void SetGlobalInterruptMask(const uint_reg_t GlobalIntState) { (void)GlobalIntState; }
+
+#endif
@@ -0,0 +1,34 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the LUFA board LED driver, which takes the project's own board LED driver as LUFA does with
+ *  BOARD = USER.
+ */
+
+#ifndef _HOST_SHIM_LUFA_LEDS_H_
+#define _HOST_SHIM_LUFA_LEDS_H_
+
+	/* Includes: */
+		#include <LUFA/Common/Common.h>
+
+		#define INCLUDE_FROM_LEDS_H
+		#include <Board/LEDs.h>
+
+	/* Preprocessor Checks: */
+		/* Boards with fewer LEDs leave the rest undefined, which LUFA maps to no LED at all */
+		#if !defined(LEDS_LED3)
+			#define LEDS_LED3    0
+		#endif
+
+		#if !defined(LEDS_LED4)
+			#define LEDS_LED4    0
+		#endif
+
+#endif
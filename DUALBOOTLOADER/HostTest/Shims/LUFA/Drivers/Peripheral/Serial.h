@@ -0,0 +1,28 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the LUFA USART driver.
+ */
+
+#ifndef _HOST_SHIM_LUFA_SERIAL_H_
+#define _HOST_SHIM_LUFA_SERIAL_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+
+	/* Macros: */
+		#define SERIAL_UBBRVAL(Baud)      ((((F_CPU / 16) + (Baud / 2)) / (Baud)) - 1)
+		#define SERIAL_2X_UBBRVAL(Baud)   ((((F_CPU / 8) + (Baud / 2)) / (Baud)) - 1)
+
+	/* Function Prototypes: */
+		void Serial_Init(const uint32_t BaudRate, const bool DoubleSpeed);
+
+#endif
@@ -0,0 +1,402 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the parts of the LUFA USB stack and its CDC and MIDI class drivers used by the firmware. The
+ *  descriptor types and constants follow LUFA, while the endpoint functions are implemented in HostShims.c on
+ *  top of a simple model of each endpoint's bank, see \ref HostShim_Endpoint_t.
+ */
+
+#ifndef _HOST_SHIM_LUFA_USB_H_
+#define _HOST_SHIM_LUFA_USB_H_
+
+	/* Includes: */
+		#include <LUFA/Common/Common.h>
+		#include <avr/io.h>
+		#include <avr/pgmspace.h>
+
+	/* Macros: */
+		#if !defined(ENDPOINT_TOTAL_ENDPOINTS)
+			#if (defined(__AVR_ATmega16U4__) || defined(__AVR_ATmega32U4__))
+				#define ENDPOINT_TOTAL_ENDPOINTS     7
+			#else
+				#define ENDPOINT_TOTAL_ENDPOINTS     5
+			#endif
+		#endif
+
+		#define ENDPOINT_DIR_IN                      0x80
+		#define ENDPOINT_DIR_OUT                     0x00
+		#define ENDPOINT_EPNUM_MASK                  0x0F
+		#define ENDPOINT_CONTROLEP                   0
+
+		#define EP_TYPE_CONTROL                      0x00
+		#define EP_TYPE_ISOCHRONOUS                  0x01
+		#define EP_TYPE_BULK                         0x02
+		#define EP_TYPE_INTERRUPT                    0x03
+
+		#define ENDPOINT_ATTR_NO_SYNC                (0 << 2)
+		#define ENDPOINT_USAGE_DATA                  (0 << 4)
+
+		#define ENDPOINT_READYWAIT_NoError           0
+		#define ENDPOINT_RWSTREAM_NoError            0
+
+		#define REQDIR_HOSTTODEVICE                  (0 << 7)
+		#define REQDIR_DEVICETOHOST                  (1 << 7)
+		#define REQTYPE_STANDARD                     (0 << 5)
+		#define REQTYPE_CLASS                        (1 << 5)
+		#define REQTYPE_VENDOR                       (2 << 5)
+		#define REQREC_DEVICE                        (0 << 0)
+		#define REQREC_INTERFACE                     (1 << 0)
+		#define REQREC_ENDPOINT                      (2 << 0)
+
+		#define CONTROL_REQTYPE_DIRECTION            0x80
+		#define CONTROL_REQTYPE_TYPE                 0x60
+		#define CONTROL_REQTYPE_RECIPIENT            0x1F
+
+		#define NO_DESCRIPTOR                        0
+		#define USE_INTERNAL_SERIAL                  0xDC
+		#define LANGUAGE_ID_ENG                      0x0409
+
+		#define USB_CONFIG_POWER_MA(mA)              ((mA) >> 1)
+		#define USB_CONFIG_ATTR_RESERVED             0x80
+		#define USB_CONFIG_ATTR_SELFPOWERED          0x40
+
+		#define USB_CSCP_NoDeviceClass               0x00
+		#define USB_CSCP_NoDeviceSubclass            0x00
+		#define USB_CSCP_NoDeviceProtocol            0x00
+		#define USB_CSCP_IADDeviceClass              0xEF
+		#define USB_CSCP_IADDeviceSubclass           0x02
+		#define USB_CSCP_IADDeviceProtocol           0x01
+
+		#define USB_STRING_DESCRIPTOR(String)        { .Header = {.Size = sizeof(USB_Descriptor_Header_t) + (sizeof(String) - 2), .Type = DTYPE_String}, .UnicodeString = String }
+		#define USB_STRING_DESCRIPTOR_ARRAY(...)     { .Header = {.Size = sizeof(USB_Descriptor_Header_t) + sizeof((uint16_t[]){__VA_ARGS__}), .Type = DTYPE_String}, .UnicodeString = {__VA_ARGS__} }
+
+		#define CDC_CSCP_CDCClass                    0x02
+		#define CDC_CSCP_NoSpecificSubclass          0x00
+		#define CDC_CSCP_NoSpecificProtocol          0x00
+		#define CDC_CSCP_ACMSubclass                 0x02
+		#define CDC_CSCP_ATCommandProtocol           0x01
+		#define CDC_CSCP_CDCDataClass                0x0A
+		#define CDC_CSCP_NoDataSubclass              0x00
+		#define CDC_CSCP_NoDataProtocol              0x00
+
+		#define CDC_DSUBTYPE_CSInterface_Header      0x00
+		#define CDC_DSUBTYPE_CSInterface_ACM         0x02
+		#define CDC_DSUBTYPE_CSInterface_Union       0x06
+
+		#define CDC_CONTROL_LINE_OUT_DTR             (1 << 0)
+		#define CDC_CONTROL_LINE_OUT_RTS             (1 << 1)
+		#define CDC_CONTROL_LINE_IN_DCD              (1 << 0)
+		#define CDC_CONTROL_LINE_IN_DSR              (1 << 1)
+		#define CDC_CONTROL_LINE_IN_BREAK            (1 << 2)
+		#define CDC_CONTROL_LINE_IN_RING             (1 << 3)
+		#define CDC_CONTROL_LINE_IN_FRAMEERROR       (1 << 4)
+		#define CDC_CONTROL_LINE_IN_PARITYERROR      (1 << 5)
+		#define CDC_CONTROL_LINE_IN_OVERRUNERROR     (1 << 6)
+
+		#define CDC_NOTIF_SerialState                0x20
+
+		#define AUDIO_CSCP_AudioClass                0x01
+		#define AUDIO_CSCP_ControlSubclass           0x01
+		#define AUDIO_CSCP_ControlProtocol           0x00
+		#define AUDIO_CSCP_MIDIStreamingSubclass     0x03
+		#define AUDIO_CSCP_StreamingProtocol         0x00
+
+		#define AUDIO_DSUBTYPE_CSInterface_Header         0x01
+		#define AUDIO_DSUBTYPE_CSInterface_General        0x01
+		#define AUDIO_DSUBTYPE_CSInterface_InputTerminal  0x02
+		#define AUDIO_DSUBTYPE_CSInterface_OutputTerminal 0x03
+		#define AUDIO_DSUBTYPE_CSEndpoint_General         0x01
+
+		#define MIDI_JACKTYPE_Embedded               0x01
+		#define MIDI_JACKTYPE_External               0x02
+
+		#define MIDI_COMMAND_SYSEX_START_3BYTE       0x40
+		#define MIDI_COMMAND_SYSEX_1BYTE             0x50
+		#define MIDI_COMMAND_SYSEX_END_1BYTE         0x50
+		#define MIDI_COMMAND_SYSEX_END_2BYTE         0x60
+		#define MIDI_COMMAND_SYSEX_END_3BYTE         0x70
+
+		#define MIDI_EVENT(VirtualCable, Command)    (((VirtualCable) << 4) | ((Command) >> 4))
+
+	/* Enums: */
+		enum USB_Device_States_t
+		{
+			DEVICE_STATE_Unattached = 0,
+			DEVICE_STATE_Powered,
+			DEVICE_STATE_Default,
+			DEVICE_STATE_Addressed,
+			DEVICE_STATE_Configured,
+			DEVICE_STATE_Suspended,
+		};
+
+		enum USB_DescriptorTypes_t
+		{
+			DTYPE_Device                = 0x01,
+			DTYPE_Configuration         = 0x02,
+			DTYPE_String                = 0x03,
+			DTYPE_Interface             = 0x04,
+			DTYPE_Endpoint              = 0x05,
+			DTYPE_InterfaceAssociation  = 0x0B,
+			DTYPE_CSInterface           = 0x24,
+			DTYPE_CSEndpoint            = 0x25,
+		};
+
+		enum CDC_LineEncodingFormats_t
+		{
+			CDC_LINEENCODING_OneStopBit          = 0,
+			CDC_LINEENCODING_OneAndAHalfStopBits = 1,
+			CDC_LINEENCODING_TwoStopBits         = 2,
+		};
+
+		enum CDC_LineEncodingParity_t
+		{
+			CDC_PARITY_None  = 0,
+			CDC_PARITY_Odd   = 1,
+			CDC_PARITY_Even  = 2,
+			CDC_PARITY_Mark  = 3,
+			CDC_PARITY_Space = 4,
+		};
+
+	/* Type Defines: */
+		typedef struct
+		{
+			uint8_t Size;
+			uint8_t Type;
+		} ATTR_PACKED USB_Descriptor_Header_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint16_t USBSpecification;
+			uint8_t  Class;
+			uint8_t  SubClass;
+			uint8_t  Protocol;
+			uint8_t  Endpoint0Size;
+			uint16_t VendorID;
+			uint16_t ProductID;
+			uint16_t ReleaseNumber;
+			uint8_t  ManufacturerStrIndex;
+			uint8_t  ProductStrIndex;
+			uint8_t  SerialNumStrIndex;
+			uint8_t  NumberOfConfigurations;
+		} ATTR_PACKED USB_Descriptor_Device_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint16_t TotalConfigurationSize;
+			uint8_t  TotalInterfaces;
+			uint8_t  ConfigurationNumber;
+			uint8_t  ConfigurationStrIndex;
+			uint8_t  ConfigAttributes;
+			uint8_t  MaxPowerConsumption;
+		} ATTR_PACKED USB_Descriptor_Configuration_Header_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t InterfaceNumber;
+			uint8_t AlternateSetting;
+			uint8_t TotalEndpoints;
+			uint8_t Class;
+			uint8_t SubClass;
+			uint8_t Protocol;
+			uint8_t InterfaceStrIndex;
+		} ATTR_PACKED USB_Descriptor_Interface_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t FirstInterfaceIndex;
+			uint8_t TotalInterfaces;
+			uint8_t Class;
+			uint8_t SubClass;
+			uint8_t Protocol;
+			uint8_t IADStrIndex;
+		} ATTR_PACKED USB_Descriptor_Interface_Association_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t  EndpointAddress;
+			uint8_t  Attributes;
+			uint16_t EndpointSize;
+			uint8_t  PollingIntervalMS;
+		} ATTR_PACKED USB_Descriptor_Endpoint_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint16_t UnicodeString[];
+		} ATTR_PACKED USB_Descriptor_String_t;
+
+		typedef struct
+		{
+			uint8_t  bmRequestType;
+			uint8_t  bRequest;
+			uint16_t wValue;
+			uint16_t wIndex;
+			uint16_t wLength;
+		} ATTR_PACKED USB_Request_Header_t;
+
+		typedef struct
+		{
+			uint8_t  Address;
+			uint16_t Size;
+			uint8_t  Type;
+			uint8_t  Banks;
+		} USB_Endpoint_Table_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t  Subtype;
+			uint16_t CDCSpecification;
+		} ATTR_PACKED USB_CDC_Descriptor_FunctionalHeader_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t Subtype;
+			uint8_t Capabilities;
+		} ATTR_PACKED USB_CDC_Descriptor_FunctionalACM_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t Subtype;
+			uint8_t MasterInterfaceNumber;
+			uint8_t SlaveInterfaceNumber;
+		} ATTR_PACKED USB_CDC_Descriptor_FunctionalUnion_t;
+
+		typedef struct
+		{
+			struct
+			{
+				uint8_t              ControlInterfaceNumber;
+				USB_Endpoint_Table_t DataINEndpoint;
+				USB_Endpoint_Table_t DataOUTEndpoint;
+				USB_Endpoint_Table_t NotificationEndpoint;
+			} Config;
+
+			struct
+			{
+				struct
+				{
+					uint16_t HostToDevice;
+					uint16_t DeviceToHost;
+				} ControlLineStates;
+
+				struct
+				{
+					uint32_t BaudRateBPS;
+					uint8_t  CharFormat;
+					uint8_t  ParityType;
+					uint8_t  DataBits;
+				} LineEncoding;
+			} State;
+		} USB_ClassInfo_CDC_Device_t;
+
+		typedef struct
+		{
+			uint8_t Event;
+			uint8_t Data1;
+			uint8_t Data2;
+			uint8_t Data3;
+		} ATTR_PACKED MIDI_EventPacket_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t  Subtype;
+			uint16_t ACSpecification;
+			uint16_t TotalLength;
+			uint8_t  InCollection;
+			uint8_t  InterfaceNumber;
+		} ATTR_PACKED USB_Audio_Descriptor_Interface_AC_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t  Subtype;
+			uint16_t AudioSpecification;
+			uint16_t TotalLength;
+		} ATTR_PACKED USB_MIDI_Descriptor_AudioInterface_AS_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t Subtype;
+			uint8_t JackType;
+			uint8_t JackID;
+			uint8_t JackStrIndex;
+		} ATTR_PACKED USB_MIDI_Descriptor_InputJack_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t Subtype;
+			uint8_t JackType;
+			uint8_t JackID;
+			uint8_t NumberOfPins;
+			uint8_t SourceJackID[1];
+			uint8_t SourcePinID[1];
+			uint8_t JackStrIndex;
+		} ATTR_PACKED USB_MIDI_Descriptor_OutputJack_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Endpoint_t Endpoint;
+			uint8_t Refresh;
+			uint8_t SyncEndpointNumber;
+		} ATTR_PACKED USB_Audio_Descriptor_StreamEndpoint_Std_t;
+
+		typedef struct
+		{
+			USB_Descriptor_Header_t Header;
+			uint8_t Subtype;
+			uint8_t TotalEmbeddedJacks;
+			uint8_t AssociatedJackID[1];
+		} ATTR_PACKED USB_MIDI_Descriptor_Jack_Endpoint_t;
+
+	/* External Variables: */
+		extern volatile uint8_t     USB_DeviceState;
+		extern USB_Request_Header_t USB_ControlRequest;
+
+	/* Function Prototypes: */
+		void     USB_Init(void);
+		void     USB_Disable(void);
+		void     USB_USBTask(void);
+
+		void     Endpoint_SelectEndpoint(const uint8_t Address);
+		uint8_t  Endpoint_GetCurrentEndpoint(void);
+		bool     Endpoint_ConfigureEndpoint(const uint8_t Address, const uint8_t Type, const uint16_t Size,
+		                                    const uint8_t Banks);
+		bool     Endpoint_IsINReady(void);
+		bool     Endpoint_IsOUTReceived(void);
+		uint16_t Endpoint_BytesInEndpoint(void);
+		void     Endpoint_ClearIN(void);
+		void     Endpoint_ClearOUT(void);
+		void     Endpoint_ClearSETUP(void);
+		void     Endpoint_ClearStatusStage(void);
+		uint8_t  Endpoint_Read_8(void);
+		void     Endpoint_Write_8(const uint8_t Data);
+		uint8_t  Endpoint_Read_Stream_LE(void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed);
+		uint8_t  Endpoint_Write_Stream_LE(const void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed);
+		uint8_t  Endpoint_Write_Control_Stream_LE(const void* const Buffer, uint16_t Length);
+
+		bool     CDC_Device_ConfigureEndpoints(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+		void     CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+		void     CDC_Device_USBTask(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+		void     CDC_Device_SendControlLineStateChange(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+
+		void     Delay_MS(uint16_t Milliseconds);
+
+#endif
@@ -0,0 +1,17 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the LUFA platform drivers, none of which the firmware uses on the host.
+ */
+
+#ifndef _HOST_SHIM_LUFA_PLATFORM_H_
+#define _HOST_SHIM_LUFA_PLATFORM_H_
+
+#endif
@@ -0,0 +1,27 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the AVR EEPROM access functions, with each EEMEM variable standing in for its own EEPROM cell.
+ */
+
+#ifndef _HOST_SHIM_AVR_EEPROM_H_
+#define _HOST_SHIM_AVR_EEPROM_H_
+
+	/* Includes: */
+		#include <stdint.h>
+
+	/* Macros: */
+		#define EEMEM
+
+	/* Function Prototypes: */
+		uint8_t eeprom_read_byte(const uint8_t* Address);
+		void    eeprom_update_byte(uint8_t* Address, uint8_t Value);
+
+#endif
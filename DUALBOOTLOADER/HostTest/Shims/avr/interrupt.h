@@ -0,0 +1,27 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the AVR interrupt macros. Each ISR becomes an ordinary function named after its vector, which
+ *  tests call directly to simulate the interrupt.
+ */
+
+#ifndef _HOST_SHIM_AVR_INTERRUPT_H_
+#define _HOST_SHIM_AVR_INTERRUPT_H_
+
+	/* Macros: */
+		#define ISR_BLOCK
+		#define ISR_NOBLOCK
+		#define ISR(Vector, ...)   void Vector(void); void Vector(void)
+
+	/* Inline Functions: */
+		static inline void sei(void) {}
+		static inline void cli(void) {}
+
+#endif
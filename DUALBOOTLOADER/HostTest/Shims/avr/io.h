@@ -0,0 +1,58 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the AVR register definitions used by the firmware. Each register is a plain global defined in
+ *  HostShims.c, so that tests can preset inputs such as UDR1 and PINB and inspect outputs such as PORTD.
+ */
+
+#ifndef _HOST_SHIM_AVR_IO_H_
+#define _HOST_SHIM_AVR_IO_H_
+
+	/* Includes: */
+		#include <stdint.h>
+
+	/* Macros: */
+		#define ARCH_AVR8               0
+		#define ARCH                    ARCH_AVR8
+
+		#if !defined(__AVR_ATmega8U2__) && !defined(__AVR_ATmega16U4__) && !defined(__AVR_ATmega32U4__)
+			#define __AVR_ATmega8U2__
+		#endif
+
+		#define _BV(Bit)                (1 << (Bit))
+
+		#define HOST_SHIM_REG(Name)     extern volatile uint8_t Name
+		#define HOST_SHIM_REG16(Name)   extern volatile uint16_t Name
+
+	/* Registers: */
+		HOST_SHIM_REG(DDRB);   HOST_SHIM_REG(PORTB);  HOST_SHIM_REG(PINB);
+		HOST_SHIM_REG(DDRC);   HOST_SHIM_REG(PORTC);  HOST_SHIM_REG(PINC);
+		HOST_SHIM_REG(DDRD);   HOST_SHIM_REG(PORTD);  HOST_SHIM_REG(PIND);
+		HOST_SHIM_REG(MCUSR);  HOST_SHIM_REG(GPIOR0); HOST_SHIM_REG(UENUM);
+		HOST_SHIM_REG(TCCR0A); HOST_SHIM_REG(TCCR0B); HOST_SHIM_REG(OCR0A);
+		HOST_SHIM_REG(TIFR0);  HOST_SHIM_REG(TIMSK0); HOST_SHIM_REG(TCNT0);
+		HOST_SHIM_REG(TCCR1A); HOST_SHIM_REG(TCCR1B); HOST_SHIM_REG(TIFR1);
+		HOST_SHIM_REG(TIMSK1); HOST_SHIM_REG16(TCNT1); HOST_SHIM_REG16(OCR1A);
+		HOST_SHIM_REG(UCSR1A); HOST_SHIM_REG(UCSR1B); HOST_SHIM_REG(UCSR1C);
+		HOST_SHIM_REG(UDR1);   HOST_SHIM_REG16(UBRR1);
+
+	/* Register Bits: */
+		enum
+		{
+			PB0 = 0, PB1, PB2, PB3, PB4, PB5, PB6, PB7,
+			WDRF   = 3,
+			CS00   = 0, CS01 = 1, CS02 = 2, WGM01 = 1, OCF0A = 1, OCIE0A = 1, TOV0 = 0,
+			CS10   = 0, CS11 = 1, CS12 = 2, WGM12 = 3, OCF1A = 1, OCIE1A = 1,
+			RXCIE1 = 7, TXCIE1 = 6, UDRIE1 = 5, RXEN1 = 4, TXEN1 = 3,
+			UPM11  = 5, UPM10 = 4, USBS1 = 3, UCSZ11 = 2, UCSZ10 = 1,
+			RXC1   = 7, TXC1 = 6, UDRE1 = 5, FE1 = 4, DOR1 = 3, UPE1 = 2, U2X1 = 1,
+		};
+
+#endif
@@ -0,0 +1,25 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the AVR program memory access macros. Flash data is ordinary constant data on the host.
+ */
+
+#ifndef _HOST_SHIM_AVR_PGMSPACE_H_
+#define _HOST_SHIM_AVR_PGMSPACE_H_
+
+	/* Includes: */
+		#include <stdint.h>
+
+	/* Macros: */
+		#define PROGMEM
+		#define pgm_read_byte(Address)   (*(const uint8_t*)(Address))
+		#define pgm_read_word(Address)   (*(const uint16_t*)(Address))
+
+#endif
@@ -0,0 +1,23 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the AVR clock prescaler control.
+ */
+
+#ifndef _HOST_SHIM_AVR_POWER_H_
+#define _HOST_SHIM_AVR_POWER_H_
+
+	/* Macros: */
+		#define clock_div_1   0
+
+	/* Inline Functions: */
+		static inline void clock_prescale_set(const int Prescaler) { (void)Prescaler; }
+
+#endif
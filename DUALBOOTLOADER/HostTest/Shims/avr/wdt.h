@@ -0,0 +1,20 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the AVR watchdog control.
+ */
+
+#ifndef _HOST_SHIM_AVR_WDT_H_
+#define _HOST_SHIM_AVR_WDT_H_
+
+	/* Inline Functions: */
+		static inline void wdt_disable(void) {}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/** \file
+ *
+ *  Host shim of the AVR atomic block macros. The host tests are single threaded and run the ISRs by calling
+ *  them, so an atomic block is simply run once.
+ */
+
+#ifndef _HOST_SHIM_UTIL_ATOMIC_H_
+#define _HOST_SHIM_UTIL_ATOMIC_H_
+
+	/* Macros: */
+		#define ATOMIC_RESTORESTATE   0
+		#define ATOMIC_FORCEON        0
+		#define ATOMIC_BLOCK(Type)    for (int HostShim_Atomic = 1; HostShim_Atomic; HostShim_Atomic = 0)
+
+#endif
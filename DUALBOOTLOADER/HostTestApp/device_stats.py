@@ -0,0 +1,110 @@
+#!/usr/bin/env python
+
+#             LUFA Library
+#     Copyright (C) Dean Camera, 2017.
+#
+#  dean [at] fourwalledcubicle [dot] com
+#           www.lufa-lib.org
+
+"""
+    Traffic and error counter reader for the USBtoSerial project. This script
+    polls the device's statistics vendor request, and prints the counters
+    along with the change since the previous poll. Requires the pyusb module
+    (https://github.com/pyusb/pyusb), and permission to access the device.
+
+    Usage: device_stats.py [--clear] [--interval SECONDS] [--device VID:PID]
+"""
+
+import sys
+import struct
+import argparse
+from time import sleep
+import usb.core
+
+# Vendor and product IDs of the serial and MIDI modes of the device. Composite
+# mode builds set their own product ID, which is given with --device
+device_ids = [(0x03EB, 0x204B), (0x04D8, 0xED67)]
+
+VENDOR_REQ_GET_DEVICE_STATS   = 0x44
+VENDOR_REQ_CLEAR_DEVICE_STATS = 0x45
+
+# Layout of the DeviceStats_t structure returned by the device
+stats_format = "<IIIIHHHHHBB"
+stats_fields = ["BytesToHost", "BytesFromHost", "INPackets", "OUTPackets",
+                "OverrunErrors", "FramingErrors", "ParityErrors",
+                "DroppedBytes", "DroppedMIDIEvents",
+                "USARTtoUSBHighWater", "USBtoUSARTHighWater"]
+
+
+def parse_id(text):
+    (vid, pid) = text.split(":")
+    return (int(vid, 16), int(pid, 16))
+
+
+def get_device(extra_ids=()):
+    for (vid, pid) in list(device_ids) + list(extra_ids):
+        device = usb.core.find(idVendor=vid, idProduct=pid)
+        if device is not None:
+            return device
+
+    return None
+
+
+def read_stats(device):
+    data = device.ctrl_transfer(0xC0, VENDOR_REQ_GET_DEVICE_STATS, 0, 0,
+                                struct.calcsize(stats_format))
+    return dict(zip(stats_fields, struct.unpack(stats_format, bytes(data))))
+
+
+def clear_stats(device):
+    device.ctrl_transfer(0x40, VENDOR_REQ_CLEAR_DEVICE_STATS, 0, 0)
+
+
+def print_stats(stats, previous):
+    for field in stats_fields:
+        line = "%-20s %10d" % (field, stats[field])
+
+        if previous is not None and not field.endswith("HighWater"):
+            line += "  (+%d)" % (stats[field] - previous[field])
+
+        print(line)
+
+    if stats["INPackets"]:
+        print("%-20s %10.1f" % ("BytesPerINPacket", float(stats["BytesToHost"]) / stats["INPackets"]))
+
+    if stats["OUTPackets"]:
+        print("%-20s %10.1f" % ("BytesPerOUTPacket", float(stats["BytesFromHost"]) / stats["OUTPackets"]))
+
+    print("")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Reads the USBtoSerial traffic and error counters.")
+    parser.add_argument("--clear", action="store_true", help="clear the counters before reading them")
+    parser.add_argument("--interval", type=float, default=0, help="keep polling every INTERVAL seconds")
+    parser.add_argument("--device", type=parse_id, action="append", default=[], metavar="VID:PID",
+                        help="also look for a device with these hexadecimal IDs, such as a composite mode build")
+    args = parser.parse_args()
+
+    device = get_device(args.device)
+    if device is None:
+        print("No USBtoSerial device found.")
+        sys.exit(1)
+
+    if args.clear:
+        clear_stats(device)
+
+    previous = None
+    while True:
+        stats = read_stats(device)
+        print_stats(stats, previous)
+
+        if args.interval <= 0:
+            break
+
+        previous = stats
+        sleep(args.interval)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,124 @@
+#!/usr/bin/env python
+
+#             LUFA Library
+#     Copyright (C) Dean Camera, 2017.
+#
+#  dean [at] fourwalledcubicle [dot] com
+#           www.lufa-lib.org
+
+"""
+    Tests for device_stats.py against a simulated device, so that they run
+    without pyusb or any hardware. A stand-in usb.core module is installed
+    before the script is imported, and answers the statistics vendor requests
+    the way the firmware does.
+
+    Usage: test_device_stats.py
+"""
+
+import io
+import sys
+import types
+import struct
+import unittest
+from contextlib import redirect_stdout
+
+
+class SimulatedDevice(object):
+    """Device answering the traffic and error counter vendor requests."""
+
+    def __init__(self, vid, pid, stats):
+        self.idVendor = vid
+        self.idProduct = pid
+        self.stats = list(stats)
+        self.requests = []
+
+    def ctrl_transfer(self, bmRequestType, bRequest, wValue=0, wIndex=0, data_or_wLength=None):
+        self.requests.append((bmRequestType, bRequest, wValue, wIndex, data_or_wLength))
+
+        if (bmRequestType, bRequest) == (0xC0, 0x44):
+            data = struct.pack("<IIIIHHHHHBB", *self.stats)
+            return bytearray(data[:data_or_wLength])
+
+        if (bmRequestType, bRequest) == (0x40, 0x45):
+            self.stats = [0] * len(self.stats)
+            return 0
+
+        raise ValueError("Unexpected request 0x%02X/0x%02X" % (bmRequestType, bRequest))
+
+
+attached_devices = []
+
+
+def find(idVendor=None, idProduct=None):
+    for device in attached_devices:
+        if (device.idVendor, device.idProduct) == (idVendor, idProduct):
+            return device
+
+    return None
+
+
+usb_module = types.ModuleType("usb")
+usb_module.core = types.ModuleType("usb.core")
+usb_module.core.find = find
+sys.modules["usb"] = usb_module
+sys.modules["usb.core"] = usb_module.core
+
+import device_stats
+
+
+class DeviceStatsTest(unittest.TestCase):
+    stats = [1200, 400, 30, 10, 1, 2, 3, 4, 5, 60, 70]
+
+    def tearDown(self):
+        del attached_devices[:]
+
+    def test_finds_each_mode(self):
+        for (vid, pid) in device_stats.device_ids:
+            attached_devices[:] = [SimulatedDevice(vid, pid, self.stats)]
+            self.assertIs(device_stats.get_device(), attached_devices[0])
+
+    def test_finds_composite_mode(self):
+        attached_devices[:] = [SimulatedDevice(0x04D8, 0xED68, self.stats)]
+        self.assertIsNone(device_stats.get_device())
+
+        composite_id = device_stats.parse_id("04d8:ed68")
+        self.assertEqual(composite_id, (0x04D8, 0xED68))
+        self.assertIs(device_stats.get_device([composite_id]), attached_devices[0])
+
+    def test_no_device(self):
+        attached_devices[:] = [SimulatedDevice(0x1234, 0x5678, self.stats)]
+        self.assertIsNone(device_stats.get_device())
+
+    def test_read_stats(self):
+        device = SimulatedDevice(0x03EB, 0x204B, self.stats)
+        stats = device_stats.read_stats(device)
+
+        self.assertEqual([stats[field] for field in device_stats.stats_fields], self.stats)
+        self.assertEqual(device.requests, [(0xC0, 0x44, 0, 0, 28)])
+
+    def test_clear_stats(self):
+        device = SimulatedDevice(0x03EB, 0x204B, self.stats)
+        device_stats.clear_stats(device)
+
+        self.assertEqual(device.requests, [(0x40, 0x45, 0, 0, None)])
+        self.assertEqual(sum(device_stats.read_stats(device).values()), 0)
+
+    def test_print_stats(self):
+        device = SimulatedDevice(0x03EB, 0x204B, self.stats)
+        previous = device_stats.read_stats(device)
+        device.stats[0] += 64
+        device.stats[2] += 1
+
+        output = io.StringIO()
+        with redirect_stdout(output):
+            device_stats.print_stats(device_stats.read_stats(device), previous)
+
+        lines = output.getvalue().splitlines()
+        self.assertIn("BytesToHost                1264  (+64)", lines)
+        self.assertIn("USARTtoUSBHighWater          60", lines)
+        self.assertIn("BytesPerINPacket           40.8", lines)
+        self.assertIn("BytesPerOUTPacket          40.0", lines)
+
+
+if __name__ == '__main__':
+    unittest.main()
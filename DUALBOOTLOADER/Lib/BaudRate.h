@@ -0,0 +1,175 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2010.
+              
+  dean [at] fourwalledcubicle [dot] com
+      www.fourwalledcubicle.com
+*/
+
+/*
+  Copyright 2010  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this 
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in 
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting 
+  documentation, and that the name of the author not be used in 
+  advertising or publicity pertaining to distribution of the 
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Selection of the AVR USART baud rate divisor and speed mode giving the least error for a requested
+ *  baud rate. The calculation is plain C, so that it can also be checked on the host.
+ */
+
+#ifndef _BAUD_RATE_H_
+#define _BAUD_RATE_H_
+
+	/* Includes: */
+		#include <stdint.h>
+		#include <stdbool.h>
+
+	/* Defines: */
+		/** Largest value of the USART's 12-bit baud rate register. */
+		#define BAUD_RATE_MAX_UBRR          4095
+
+		/** Largest baud rate error reported, in units of 0.01%. Errors this large are unusable anyway. */
+		#define BAUD_RATE_MAX_ERROR         9999
+
+	/* Type Defines: */
+		/** Type define for a USART baud rate setting, as chosen by \ref BaudRate_Select(). */
+		typedef struct
+		{
+			uint32_t RequestedBPS; /**< Baud rate asked for, in bits per second */
+			uint32_t ActualBPS; /**< Baud rate the USART really runs at with this setting, in bits per second */
+			int16_t  Error; /**< Error of the actual rate against the requested one, in units of 0.01% */
+			uint16_t UBRR; /**< Value for the USART baud rate register */
+			uint8_t  DoubleSpeed; /**< Non-zero if the USART must run in double speed (U2X) mode */
+		} BaudRate_Setting_t;
+
+	/* Inline Functions: */
+		/** Calculates the difference between two baud rates.
+		 *
+		 *  \param[in] RateA  First baud rate, in bits per second
+		 *  \param[in] RateB  Second baud rate, in bits per second
+		 *
+		 *  \return Difference between the two rates, in bits per second
+		 */
+		static inline uint32_t BaudRate_Difference(const uint32_t RateA,
+		                                           const uint32_t RateB)
+		{
+			return ((RateA > RateB) ? (RateA - RateB) : (RateB - RateA));
+		}
+
+		/** Calculates the baud rate register value for a requested baud rate in one USART speed mode, and the
+		 *  baud rate it actually gives.
+		 *
+		 *  \param[in]  ClockHz    USART clock frequency, in Hz
+		 *  \param[in]  BaudBPS    Requested baud rate, in bits per second
+		 *  \param[in]  Divider    Clock cycles per bit at a baud rate register value of zero, 16 (normal) or 8 (U2X)
+		 *  \param[out] ActualBPS  Location where the baud rate actually given is to be stored
+		 *
+		 *  \return Baud rate register value giving the baud rate nearest to the requested one
+		 */
+		static inline uint16_t BaudRate_Divisor(const uint32_t ClockHz,
+		                                        const uint32_t BaudBPS,
+		                                        const uint8_t Divider,
+		                                        uint32_t* const ActualBPS)
+		{
+			/* The register holds the divisor less one. The divisor rounded down gives the nearest rate at or above
+			 * the requested one, and the next divisor the nearest below it. Rounding the divisor to nearest instead
+			 * does not always pick the nearer of the two, as the rate goes with the inverse of the divisor. */
+			uint32_t UBRR = (ClockHz / ((uint32_t)Divider * BaudBPS));
+
+			if (UBRR)
+			  UBRR--;
+
+			if (UBRR > BAUD_RATE_MAX_UBRR)
+			  UBRR = BAUD_RATE_MAX_UBRR;
+
+			uint32_t Rate = (ClockHz / ((uint32_t)Divider * (UBRR + 1)));
+
+			if (UBRR < BAUD_RATE_MAX_UBRR)
+			{
+				uint32_t SlowerRate = (ClockHz / ((uint32_t)Divider * (UBRR + 2)));
+
+				if (BaudRate_Difference(SlowerRate, BaudBPS) < BaudRate_Difference(Rate, BaudBPS))
+				{
+					UBRR++;
+					Rate = SlowerRate;
+				}
+			}
+
+			*ActualBPS = Rate;
+
+			return UBRR;
+		}
+
+		/** Chooses the USART speed mode and baud rate register value giving the least error for a requested
+		 *  baud rate. Normal speed mode is preferred when both are equally accurate, as the receiver then takes
+		 *  more samples per bit and so copes better with noise.
+		 *
+		 *  \param[in]  ClockHz  USART clock frequency, in Hz
+		 *  \param[in]  BaudBPS  Requested baud rate, in bits per second
+		 *  \param[out] Setting  Location where the chosen setting is to be stored
+		 */
+		static inline void BaudRate_Select(const uint32_t ClockHz,
+		                                   uint32_t BaudBPS,
+		                                   BaudRate_Setting_t* const Setting)
+		{
+			uint32_t NormalBPS;
+			uint32_t DoubleBPS;
+
+			Setting->RequestedBPS = BaudBPS;
+
+			/* A zero rate cannot be set, so fall back to the slowest one the USART can make */
+			if (!(BaudBPS))
+			  BaudBPS = 1;
+
+			uint16_t NormalUBRR = BaudRate_Divisor(ClockHz, BaudBPS, 16, &NormalBPS);
+			uint16_t DoubleUBRR = BaudRate_Divisor(ClockHz, BaudBPS, 8,  &DoubleBPS);
+
+			uint32_t NormalDiff = BaudRate_Difference(NormalBPS, BaudBPS);
+			uint32_t DoubleDiff = BaudRate_Difference(DoubleBPS, BaudBPS);
+
+			bool     DoubleSpeed = (DoubleDiff < NormalDiff);
+			uint32_t Diff        = (DoubleSpeed ? DoubleDiff : NormalDiff);
+
+			Setting->DoubleSpeed = DoubleSpeed;
+			Setting->UBRR        = (DoubleSpeed ? DoubleUBRR : NormalUBRR);
+			Setting->ActualBPS   = (DoubleSpeed ? DoubleBPS  : NormalBPS);
+
+			/* Errors of 100% or more are reported as the largest. Below that the difference is less than the
+			 * requested rate, so scaling it to 0.01% units one decimal digit at a time cannot overflow */
+			uint32_t Error = BAUD_RATE_MAX_ERROR;
+
+			if ((Diff < BaudBPS) && (BaudBPS <= (UINT32_MAX / 10)))
+			{
+				uint32_t Remainder = Diff;
+
+				Error = 0;
+
+				for (uint8_t Digit = 0; Digit < 4; Digit++)
+				{
+					Remainder *= 10;
+					Error      = ((Error * 10) + (Remainder / BaudBPS));
+					Remainder %= BaudBPS;
+				}
+			}
+
+			Setting->Error = ((Setting->ActualBPS < BaudBPS) ? -(int16_t)Error : (int16_t)Error);
+		}
+
+#endif
@@ -30,168 +30,176 @@
 
 /** \file
  *
- *  Ultra lightweight ring buffer, for fast insertion/deletion.
+ *  Ultra lightweight lock-free ring buffers of bytes, for fast insertion/deletion between a single producer
+ *  and a single consumer (typically an ISR and the main program thread).
+ *
+ *  Each buffer is defined with \ref RINGBUFF_DEFINE(), which fixes its size at compile time and generates the
+ *  accessors for it, so that the index mask is a constant and the buffer is addressed directly by each access.
  */
- 
+
 #ifndef _ULW_RING_BUFF_H_
 #define _ULW_RING_BUFF_H_
 
 	/* Includes: */
-		#include <util/atomic.h>
-	
 		#include <stdint.h>
 		#include <stdbool.h>
 
 	/* Defines: */
-		/** Size of each ring buffer, in data elements - must be between 1 and 255. */
-		#define BUFFER_SIZE         128
-		
-		/** Maximum number of data elements to buffer before forcing a flush. 
-		 *  Must be less than BUFFER_SIZE
+		/** Forces the compiler to complete all pending memory accesses before the next one. This orders the
+		 *  data accesses against the head and tail updates seen by the other side of the buffer.
 		 */
-		#define BUFFER_NEARLY_FULL	96
-		
+		#if defined(GCC_MEMORY_BARRIER)
+			#define RingBuff_Barrier()        GCC_MEMORY_BARRIER()
+		#else
+			#define RingBuff_Barrier()        __asm__ __volatile__ ("" ::: "memory")
+		#endif
+
+		/** Checks whether a buffer size is valid, i.e. a power of two between 2 and 128. */
+		#define RINGBUFF_SIZE_VALID(Size)     (((Size) >= 2) && ((Size) <= 128) && !((Size) & ((Size) - 1)))
+
 		/** Type of data to store into the buffer. */
 		#define RingBuff_Data_t     uint8_t
 
 		/** Datatype which may be used to store the count of data stored in a buffer, retrieved
-		 *  via a call to \ref RingBuffer_GetCount().
+		 *  via a call to its \c GetCount() accessor.
 		 */
-		#if (BUFFER_SIZE <= 0xFF)
-			#define RingBuff_Count_t   uint8_t
-		#else
-			#define RingBuff_Count_t   uint16_t
-		#endif
+		#define RingBuff_Count_t    uint8_t
 
-	/* Type Defines: */
-		/** Type define for a new ring buffer object. Buffers should be initialized via a call to
-		 *  \ref RingBuffer_InitBuffer() before use.
-		 */
-		typedef struct
-		{
-			RingBuff_Data_t  Buffer[BUFFER_SIZE]; /**< Internal ring buffer data, referenced by the buffer pointers. */
-			RingBuff_Data_t* In; /**< Current storage location in the circular buffer */
-			RingBuff_Data_t* Out; /**< Current retrieval location in the circular buffer */
-			RingBuff_Count_t Count;
-		} RingBuff_t;
-	
-	/* Inline Functions: */
-		/** Initializes a ring buffer ready for use. Buffers must be initialized via this function
-		 *  before any operations are called upon them. Already initialized buffers may be reset
-		 *  by re-initializing them using this function.
+		/** Defines a ring buffer, with storage for the given number of elements, and the inline accessors for it.
+		 *  The buffer is a static structure of the given name holding the \c Data storage and the \c Head and
+		 *  \c Tail counters. These are free running, each written by only one side of the buffer, and their
+		 *  difference is the number of stored elements, so no lock is needed to insert or remove data.
 		 *
-		 *  \param[out] Buffer  Pointer to a ring buffer structure to initialize
-		 */
-		static inline void RingBuffer_InitBuffer(RingBuff_t* const Buffer)
-		{
-			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-			{
-				Buffer->In  = Buffer->Buffer;
-				Buffer->Out = Buffer->Buffer;
-			}
-		}
-		
-		/** Retrieves the minimum number of bytes stored in a particular buffer. This value is computed
-		 *  by entering an atomic lock on the buffer while the IN and OUT locations are fetched, so that
-		 *  the buffer cannot be modified while the computation takes place. This value should be cached
-		 *  when reading out the contents of the buffer, so that as small a time as possible is spent
-		 *  in an atomic lock.
+		 *  The accessors are named after the buffer, so for a buffer named \c Buffer:
 		 *
-		 *  \note The value returned by this function is guaranteed to only be the minimum number of bytes
-		 *        stored in the given buffer; this value may change as other threads write new data and so
-		 *        the returned number should be used only to determine how many successive reads may safely
-		 *        be performed on the buffer.
+		 *  - <tt>void Buffer_Init(void)</tt> empties the buffer. It must be called before any other accessor, and
+		 *    must not be called while the producer or consumer may be running.
+		 *  - <tt>RingBuff_Count_t Buffer_GetCount(void)</tt> and <tt>Buffer_GetFreeCount(void)</tt> retrieve the
+		 *    number of elements stored and the free space. Each is only a snapshot: the count can only grow when
+		 *    read by the consumer, and only shrink when read by the producer.
+		 *  - <tt>bool Buffer_IsFull(void)</tt> and <tt>bool Buffer_IsEmpty(void)</tt> must be checked before
+		 *    inserting or removing an element respectively.
+		 *  - <tt>void Buffer_Insert(const RingBuff_Data_t Data)</tt> stores an element, only in the producer.
+		 *  - <tt>RingBuff_Data_t Buffer_Remove(void)</tt> retrieves the oldest element, only in the consumer.
+		 *  - <tt>RingBuff_Count_t Buffer_GetWriteSpan(RingBuff_Data_t** const Span)</tt> retrieves the longest
+		 *    contiguous run of free space, so that the producer can copy data straight into the storage, then make
+		 *    it visible to the consumer with <tt>void Buffer_CommitWrite(const RingBuff_Count_t Count)</tt>.
+		 *  - <tt>RingBuff_Count_t Buffer_GetReadSpan(RingBuff_Data_t** const Span)</tt> retrieves the longest
+		 *    contiguous run of stored data, so that the consumer can copy it straight out of the storage, then
+		 *    release it to the producer with <tt>void Buffer_CommitRead(const RingBuff_Count_t Count)</tt>.
 		 *
-		 *  \param[in] Buffer  Pointer to a ring buffer structure whose count is to be computed
+		 *  \param[in] Name  Name of the buffer, and the prefix of its accessors
+		 *  \param[in] Size  Number of elements the buffer holds, which must satisfy \ref RINGBUFF_SIZE_VALID()
 		 */
-		static inline RingBuff_Count_t RingBuffer_GetCount(RingBuff_t* const Buffer)
-		{
-			RingBuff_Count_t Count;
-			
-			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-			{
-				Count = Buffer->Count;
-			}
-			
-			return Count;
-		}
-		
-		/** Atomically determines if the specified ring buffer contains any free space. This should
-		 *  be tested before storing data to the buffer, to ensure that no data is lost due to a
-		 *  buffer overrun.
-		 *
-		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to insert into
-		 *
-		 *  \return Boolean true if the buffer contains no free space, false otherwise
-		 */		 
-		static inline bool RingBuffer_IsFull(RingBuff_t* const Buffer)
-		{
-			return (RingBuffer_GetCount(Buffer) == BUFFER_SIZE);
-		}
-
-		/** Atomically determines if the specified ring buffer contains any data. This should
-		 *  be tested before removing data from the buffer, to ensure that the buffer does not
-		 *  underflow.
-		 *
-		 *  If the data is to be removed in a loop, store the total number of bytes stored in the
-		 *  buffer (via a call to the \ref RingBuffer_GetCount() function) in a temporary variable
-		 *  to reduce the time spent in atomicity locks.
-		 *
-		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to insert into
-		 *
-		 *  \return Boolean true if the buffer contains no free space, false otherwise
-		 */		 
-		static inline bool RingBuffer_IsEmpty(RingBuff_t* const Buffer)
-		{
-			return (RingBuffer_GetCount(Buffer) == 0);
-		}
+		#define RINGBUFF_DEFINE(Name, Size)                                                                         \
+			static RINGBUFF_STRUCT(Size) Name;                                                                      \
+			RINGBUFF_DEFINE_ACCESSORS(Name, Size)
 
-		/** Inserts an element into the ring buffer.
+		/** Type of a ring buffer with storage for the given number of elements, for buffers which are defined as part
+		 *  of another structure or union rather than through \ref RINGBUFF_DEFINE().
 		 *
-		 *  \note Only one execution thread (main program thread or an ISR) may insert into a single buffer
-		 *        otherwise data corruption may occur. Insertion and removal may occur from different execution
-		 *        threads.
-		 *
-		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to insert into
-		 *  \param[in]     Data    Data element to insert into the buffer
+		 *  \param[in] Size  Number of elements the buffer holds, which must satisfy \ref RINGBUFF_SIZE_VALID()
 		 */
-		static inline void RingBuffer_Insert(RingBuff_t* const Buffer,
-		                                     const RingBuff_Data_t Data)
-		{
-			*Buffer->In = Data;
-			
-			if (++Buffer->In == &Buffer->Buffer[BUFFER_SIZE])
-			  Buffer->In = Buffer->Buffer;
-
-			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-			{
-				Buffer->Count++;
+		#define RINGBUFF_STRUCT(Size)                                                                               \
+			struct                                                                                                  \
+			{                                                                                                       \
+				RingBuff_Data_t           Data[Size];                                                               \
+				volatile RingBuff_Count_t Head;                                                                     \
+				volatile RingBuff_Count_t Tail;                                                                     \
 			}
-		}
 
-		/** Removes an element from the ring buffer.
-		 *
-		 *  \note Only one execution thread (main program thread or an ISR) may remove from a single buffer
-		 *        otherwise data corruption may occur. Insertion and removal may occur from different execution
-		 *        threads.
+		/** Defines the inline accessors of a ring buffer whose storage, of type \ref RINGBUFF_STRUCT(), is defined
+		 *  separately. \c Name may expand to the buffer's location within a larger structure or union.
 		 *
-		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to retrieve from
-		 *
-		 *  \return Next data element stored in the buffer
+		 *  \param[in] Name  Name of the buffer, and the prefix of its accessors
+		 *  \param[in] Size  Number of elements the buffer holds, which must satisfy \ref RINGBUFF_SIZE_VALID()
 		 */
-		static inline RingBuff_Data_t RingBuffer_Remove(RingBuff_t* const Buffer)
-		{
-			RingBuff_Data_t Data = *Buffer->Out;
-			
-			if (++Buffer->Out == &Buffer->Buffer[BUFFER_SIZE])
-			  Buffer->Out = Buffer->Buffer;
-
-			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-			{
-				Buffer->Count--;
+		#define RINGBUFF_DEFINE_ACCESSORS(Name, Size)                                                               \
+			typedef char Name##_SizeCheck[RINGBUFF_SIZE_VALID(Size) ? 1 : -1];                                      \
+                                                                                                                    \
+			static inline void Name##_Init(void)                                                                    \
+			{                                                                                                       \
+				Name.Head = 0;                                                                                      \
+				Name.Tail = 0;                                                                                      \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline RingBuff_Count_t Name##_GetCount(void)                                                    \
+			{                                                                                                       \
+				return (RingBuff_Count_t)(Name.Head - Name.Tail);                                                   \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline RingBuff_Count_t Name##_GetFreeCount(void)                                                \
+			{                                                                                                       \
+				return (RingBuff_Count_t)((Size) - Name##_GetCount());                                              \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline bool Name##_IsFull(void)                                                                  \
+			{                                                                                                       \
+				return (Name##_GetCount() >= (Size));                                                               \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline bool Name##_IsEmpty(void)                                                                 \
+			{                                                                                                       \
+				return (Name.Head == Name.Tail);                                                                    \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline void Name##_Insert(const RingBuff_Data_t Data)                                            \
+			{                                                                                                       \
+				RingBuff_Count_t Head = Name.Head;                                                                  \
+                                                                                                                    \
+				Name.Data[Head & ((Size) - 1)] = Data;                                                              \
+                                                                                                                    \
+				/* The element must be stored before the consumer can see the new head */                           \
+				RingBuff_Barrier();                                                                                 \
+				Name.Head = (Head + 1);                                                                             \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline RingBuff_Data_t Name##_Remove(void)                                                       \
+			{                                                                                                       \
+				RingBuff_Count_t Tail = Name.Tail;                                                                  \
+				RingBuff_Data_t  Data = Name.Data[Tail & ((Size) - 1)];                                             \
+                                                                                                                    \
+				/* The element must be read out before the producer can reuse its slot */                           \
+				RingBuff_Barrier();                                                                                 \
+				Name.Tail = (Tail + 1);                                                                             \
+                                                                                                                    \
+				return Data;                                                                                        \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline RingBuff_Count_t Name##_GetWriteSpan(RingBuff_Data_t** const Span)                        \
+			{                                                                                                       \
+				uint8_t          Index = (Name.Head & ((Size) - 1));                                                \
+				RingBuff_Count_t ToEnd = ((Size) - Index);                                                          \
+				RingBuff_Count_t Free  = Name##_GetFreeCount();                                                     \
+                                                                                                                    \
+				*Span = &Name.Data[Index];                                                                          \
+                                                                                                                    \
+				return (Free < ToEnd) ? Free : ToEnd;                                                               \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline void Name##_CommitWrite(const RingBuff_Count_t Count)                                     \
+			{                                                                                                       \
+				/* The elements must be stored before the consumer can see the new head */                          \
+				RingBuff_Barrier();                                                                                 \
+				Name.Head = (Name.Head + Count);                                                                    \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline RingBuff_Count_t Name##_GetReadSpan(RingBuff_Data_t** const Span)                         \
+			{                                                                                                       \
+				uint8_t          Index = (Name.Tail & ((Size) - 1));                                                \
+				RingBuff_Count_t ToEnd = ((Size) - Index);                                                          \
+				RingBuff_Count_t Count = Name##_GetCount();                                                         \
+                                                                                                                    \
+				*Span = &Name.Data[Index];                                                                          \
+                                                                                                                    \
+				return (Count < ToEnd) ? Count : ToEnd;                                                             \
+			}                                                                                                       \
+                                                                                                                    \
+			static inline void Name##_CommitRead(const RingBuff_Count_t Count)                                      \
+			{                                                                                                       \
+				/* The elements must be read out before the producer can reuse their slots */                       \
+				RingBuff_Barrier();                                                                                 \
+				Name.Tail = (Name.Tail + Count);                                                                    \
 			}
-			
-			return Data;
-		}
 
 #endif
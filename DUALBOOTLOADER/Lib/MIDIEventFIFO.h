@@ -0,0 +1,177 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2010.
+              
+  dean [at] fourwalledcubicle [dot] com
+      www.fourwalledcubicle.com
+*/
+
+/*
+  Copyright 2010  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this 
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in 
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting 
+  documentation, and that the name of the author not be used in 
+  advertising or publicity pertaining to distribution of the 
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Lock-free single producer, single consumer FIFO of USB-MIDI event packets, for handing complete
+ *  events from an ISR over to the main program thread without losing any of them under bursts.
+ */
+
+#ifndef _MIDI_EVENT_FIFO_H_
+#define _MIDI_EVENT_FIFO_H_
+
+	/* Includes: */
+		#include <LUFA/Drivers/USB/USB.h>
+
+		#include <stdint.h>
+		#include <stdbool.h>
+
+	/* Defines: */
+		/** Number of events each FIFO can hold - must be a power of two between 2 and 128. */
+		#if !defined(MIDI_EVENT_FIFO_SIZE)
+			#define MIDI_EVENT_FIFO_SIZE    16
+		#endif
+
+		/** Mask which turns one of the free running FIFO counters into an index into the event storage. */
+		#define MIDI_EVENT_FIFO_MASK        (MIDI_EVENT_FIFO_SIZE - 1)
+
+	/* Preprocessor Checks: */
+		#if ((MIDI_EVENT_FIFO_SIZE < 2) || (MIDI_EVENT_FIFO_SIZE > 128) || (MIDI_EVENT_FIFO_SIZE & MIDI_EVENT_FIFO_MASK))
+			#error MIDI_EVENT_FIFO_SIZE must be a power of two between 2 and 128.
+		#endif
+
+	/* Type Defines: */
+		/** Type define for a new MIDI event FIFO object. FIFOs should be initialized via a call to
+		 *  \ref MIDIEventFIFO_Init() before use.
+		 *
+		 *  The head and tail are free running counters, each written by only one side of the FIFO. Their
+		 *  difference is the number of stored events, so no lock is needed to insert or remove an event.
+		 */
+		typedef struct
+		{
+			MIDI_EventPacket_t Events[MIDI_EVENT_FIFO_SIZE]; /**< Internal event storage, indexed by the masked counters. */
+			volatile uint8_t   Head; /**< Total number of events stored, only written by the producer. */
+			volatile uint8_t   Tail; /**< Total number of events retrieved, only written by the consumer. */
+			volatile uint16_t  Overflows; /**< Number of events discarded because the FIFO was full. */
+		} MIDIEventFIFO_t;
+
+	/* Inline Functions: */
+		/** Initializes a MIDI event FIFO ready for use, discarding any stored events and clearing its
+		 *  overflow counter. This must not be called while the producer or consumer may be running.
+		 *
+		 *  \param[out] FIFO  Pointer to a MIDI event FIFO structure to initialize
+		 */
+		static inline void MIDIEventFIFO_Init(MIDIEventFIFO_t* const FIFO)
+		{
+			FIFO->Head      = 0;
+			FIFO->Tail      = 0;
+			FIFO->Overflows = 0;
+		}
+
+		/** Retrieves the number of events stored in a FIFO. The returned count is only a snapshot, and may
+		 *  grow or shrink as the other side of the FIFO runs.
+		 *
+		 *  \param[in] FIFO  Pointer to a MIDI event FIFO structure whose count is to be computed
+		 *
+		 *  \return Number of events stored in the FIFO
+		 */
+		static inline uint8_t MIDIEventFIFO_GetCount(MIDIEventFIFO_t* const FIFO)
+		{
+			return (uint8_t)(FIFO->Head - FIFO->Tail);
+		}
+
+		/** Inserts an event into the FIFO. If the FIFO is full the event is discarded, and the FIFO's
+		 *  overflow counter is incremented instead.
+		 *
+		 *  \note Only one execution thread (main program thread or an ISR) may insert into a single FIFO.
+		 *
+		 *  \param[in,out] FIFO   Pointer to a MIDI event FIFO structure to insert into
+		 *  \param[in]     Event  Pointer to the event to insert
+		 *
+		 *  \return Boolean \c true if the event was stored, \c false if it was discarded
+		 */
+		static inline bool MIDIEventFIFO_Push(MIDIEventFIFO_t* const FIFO,
+		                                      const MIDI_EventPacket_t* const Event)
+		{
+			uint8_t Head = FIFO->Head;
+
+			if ((uint8_t)(Head - FIFO->Tail) == MIDI_EVENT_FIFO_SIZE)
+			{
+				FIFO->Overflows++;
+				return false;
+			}
+
+			FIFO->Events[Head & MIDI_EVENT_FIFO_MASK] = *Event;
+
+			/* The event must be fully stored before the consumer can see the new head */
+			GCC_MEMORY_BARRIER();
+			FIFO->Head = (Head + 1);
+
+			return true;
+		}
+
+		/** Retrieves the oldest event in the FIFO without removing it, if there is one.
+		 *
+		 *  \note Only the execution thread which removes from a FIFO may look at its oldest event.
+		 *
+		 *  \param[in]  FIFO   Pointer to a MIDI event FIFO structure to look into
+		 *  \param[out] Event  Location where the oldest event is to be stored
+		 *
+		 *  \return Boolean \c true if an event was retrieved, \c false if the FIFO was empty
+		 */
+		static inline bool MIDIEventFIFO_Peek(MIDIEventFIFO_t* const FIFO,
+		                                      MIDI_EventPacket_t* const Event)
+		{
+			uint8_t Tail = FIFO->Tail;
+
+			if (Tail == FIFO->Head)
+			  return false;
+
+			*Event = FIFO->Events[Tail & MIDI_EVENT_FIFO_MASK];
+			return true;
+		}
+
+		/** Removes the oldest event from the FIFO, if there is one.
+		 *
+		 *  \note Only one execution thread (main program thread or an ISR) may remove from a single FIFO.
+		 *
+		 *  \param[in,out] FIFO   Pointer to a MIDI event FIFO structure to retrieve from
+		 *  \param[out]    Event  Location where the retrieved event is to be stored
+		 *
+		 *  \return Boolean \c true if an event was retrieved, \c false if the FIFO was empty
+		 */
+		static inline bool MIDIEventFIFO_Pop(MIDIEventFIFO_t* const FIFO,
+		                                     MIDI_EventPacket_t* const Event)
+		{
+			uint8_t Tail = FIFO->Tail;
+
+			if (Tail == FIFO->Head)
+			  return false;
+
+			*Event = FIFO->Events[Tail & MIDI_EVENT_FIFO_MASK];
+
+			/* The event must be fully read out before the producer can reuse its slot */
+			GCC_MEMORY_BARRIER();
+			FIFO->Tail = (Tail + 1);
+
+			return true;
+		}
+
+#endif
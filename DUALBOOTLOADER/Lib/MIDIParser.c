@@ -0,0 +1,227 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Serial MIDI stream parser, turning the bytes received from a MIDI port into USB-MIDI event packets. The
+ *  parser only touches its own state and the event FIFOs it is given, and so may be built for any target.
+ */
+
+#include "MIDIParser.h"
+
+/** Classification of every byte which can be received from the serial port in MIDI mode, so that the USART
+ *  receive ISR needs a single flash read per byte rather than a chain of compares. Each entry holds the USB-MIDI
+ *  CIN and total length of the message started by the byte, along with the \ref MIDI_STATUS_RUNNING and
+ *  \ref MIDI_STATUS_REALTIME flags. Data bytes and undefined status bytes have a zero CIN and length, as does
+ *  the SysEx start (CIN 0x4) whose length is not fixed.
+ */
+static const uint8_t PROGMEM MIDI_StatusTable[256] =
+	{
+		[0x80 ... 0x8F] = MIDI_STATUS_ENTRY(0x8, 3, MIDI_STATUS_RUNNING),
+		[0x90 ... 0x9F] = MIDI_STATUS_ENTRY(0x9, 3, MIDI_STATUS_RUNNING),
+		[0xA0 ... 0xAF] = MIDI_STATUS_ENTRY(0xA, 3, MIDI_STATUS_RUNNING),
+		[0xB0 ... 0xBF] = MIDI_STATUS_ENTRY(0xB, 3, MIDI_STATUS_RUNNING),
+		[0xC0 ... 0xCF] = MIDI_STATUS_ENTRY(0xC, 2, MIDI_STATUS_RUNNING),
+		[0xD0 ... 0xDF] = MIDI_STATUS_ENTRY(0xD, 2, MIDI_STATUS_RUNNING),
+		[0xE0 ... 0xEF] = MIDI_STATUS_ENTRY(0xE, 3, MIDI_STATUS_RUNNING),
+		[SystemExclusive]      = MIDI_STATUS_ENTRY(MIDI_CIN_SYSEX_START, 0, 0),
+		[TimeCodeQuarterFrame] = MIDI_STATUS_ENTRY(0x2, 2, 0),
+		[SongPosition]         = MIDI_STATUS_ENTRY(0x3, 3, 0),
+		[SongSelect]           = MIDI_STATUS_ENTRY(0x2, 2, 0),
+		[TuneRequest]          = MIDI_STATUS_ENTRY(0x5, 1, 0),
+		[Clock]                = MIDI_STATUS_ENTRY(0xF, 1, MIDI_STATUS_REALTIME),
+		[0xF9]                 = MIDI_STATUS_ENTRY(0x0, 0, MIDI_STATUS_REALTIME),
+		[Start]                = MIDI_STATUS_ENTRY(0xF, 1, MIDI_STATUS_REALTIME),
+		[Continue]             = MIDI_STATUS_ENTRY(0xF, 1, MIDI_STATUS_REALTIME),
+		[Stop]                 = MIDI_STATUS_ENTRY(0xF, 1, MIDI_STATUS_REALTIME),
+		[0xFD]                 = MIDI_STATUS_ENTRY(0x0, 0, MIDI_STATUS_REALTIME),
+		[ActiveSensing]        = MIDI_STATUS_ENTRY(0xF, 1, MIDI_STATUS_REALTIME),
+		[SystemReset]          = MIDI_STATUS_ENTRY(0xF, 1, MIDI_STATUS_REALTIME),
+	};
+
+/** Queues a completed USB-MIDI event packet into each of the given event FIFOs. A FIFO which is full drops the
+ *  packet and counts it as an overflow, without affecting the other one.
+ *
+ *  \param[in,out] FIFO      Pointer to the event FIFO to queue the packet into, or \c NULL
+ *  \param[in,out] EchoFIFO  Pointer to a second event FIFO to queue the packet into, or \c NULL
+ *  \param[in]     Event     Pointer to the completed event packet
+ */
+static inline void MIDIParser_PushEvent(MIDIEventFIFO_t* const FIFO,
+                                        MIDIEventFIFO_t* const EchoFIFO,
+                                        const MIDI_EventPacket_t* const Event)
+{
+	if (FIFO)
+	  MIDIEventFIFO_Push(FIFO, Event);
+
+	if (EchoFIFO)
+	  MIDIEventFIFO_Push(EchoFIFO, Event);
+}
+
+/** Queues a USB-MIDI event packet built from the first bytes of the parser's pending message buffer.
+ *
+ *  \param[in]     Parser    Pointer to the parser whose pending message is to be sent
+ *  \param[in,out] FIFO      Pointer to the event FIFO to queue the packet into, or \c NULL
+ *  \param[in,out] EchoFIFO  Pointer to a second event FIFO to queue the packet into, or \c NULL
+ *  \param[in]     CIN       USB-MIDI Code Index Number of the packet
+ *  \param[in]     Length    Number of bytes of the pending message buffer to send, between 1 and 3
+ */
+static inline void MIDIParser_QueueEvent(MIDIParser_t* const Parser,
+                                         MIDIEventFIFO_t* const FIFO,
+                                         MIDIEventFIFO_t* const EchoFIFO,
+                                         const uint8_t CIN,
+                                         const uint8_t Length)
+{
+	MIDI_EventPacket_t Event =
+		{
+			.Event = MIDI_EVENT(0, 0) | CIN,
+			.Data1 = Parser->PendingMessage[0],
+			.Data2 = (Length > 1) ? Parser->PendingMessage[1] : 0,
+			.Data3 = (Length > 2) ? Parser->PendingMessage[2] : 0,
+		};
+
+	MIDIParser_PushEvent(FIFO, EchoFIFO, &Event);
+}
+
+/** Initializes a MIDI parser ready for use, discarding any incomplete message and running status.
+ *
+ *  \param[out] Parser  Pointer to a MIDI parser structure to initialize
+ */
+void MIDIParser_Init(MIDIParser_t* const Parser)
+{
+	Parser->RunningStatus  = InvalidType;
+	Parser->ExpectedLength = 0;
+	Parser->PendingIndex   = 0;
+	Parser->SysExActive    = false;
+}
+
+/** Feeds a byte received from a MIDI port into a parser, queueing each USB-MIDI event packet it completes. This
+ *  is called from the USART receive ISR, once per byte.
+ *
+ *  \param[in,out] Parser        Pointer to the MIDI parser the byte belongs to
+ *  \param[in,out] FIFO          Pointer to the event FIFO completed packets are queued into, or \c NULL
+ *  \param[in,out] EchoFIFO      Pointer to a second event FIFO completed packets are also queued into, or \c NULL
+ *  \param[in]     ReceivedByte  Byte received from the MIDI port
+ */
+void MIDIParser_ProcessByte(MIDIParser_t* const Parser,
+                            MIDIEventFIFO_t* const FIFO,
+                            MIDIEventFIFO_t* const EchoFIFO,
+                            const uint8_t ReceivedByte)
+{
+	const uint8_t Status = pgm_read_byte(&MIDI_StatusTable[ReceivedByte]);
+
+	/* Real Time messages are sent on by themselves wherever they arrive, leaving any message or SysEx they are
+	 * interleaved into untouched */
+	if (Status & MIDI_STATUS_REALTIME)
+	{
+		if (Status & MIDI_STATUS_CIN_MASK)
+		{
+			MIDI_EventPacket_t Event =
+				{
+					.Event = MIDI_EVENT(0, 0) | (Status & MIDI_STATUS_CIN_MASK),
+					.Data1 = ReceivedByte,
+				};
+
+			MIDIParser_PushEvent(FIFO, EchoFIFO, &Event);
+		}
+
+		return;
+	}
+
+	/* System Exclusive data is streamed three bytes at a time as it arrives, so that a message of any length
+	 * passes through using nothing more than the pending message buffer */
+	if (Parser->SysExActive)
+	{
+		if (!(ReceivedByte & 0x80))
+		{
+			Parser->PendingMessage[Parser->PendingIndex++] = ReceivedByte;
+
+			if (Parser->PendingIndex == 3)
+			{
+				MIDIParser_QueueEvent(Parser, FIFO, EchoFIFO, MIDI_CIN_SYSEX_START, 3);
+				Parser->PendingIndex = 0;
+			}
+
+			return;
+		}
+
+		/* Any status byte ends the SysEx, with the EOX being sent as its last byte. A SysEx cut short by another
+		 * status byte is given the EOX it lacks, so that the host never sees an end packet without one */
+		Parser->PendingMessage[Parser->PendingIndex++] = 0xF7;
+
+		MIDIParser_QueueEvent(Parser, FIFO, EchoFIFO,
+		                      (MIDI_CIN_SYSEX_START + Parser->PendingIndex), Parser->PendingIndex);
+
+		Parser->SysExActive  = false;
+		Parser->PendingIndex = 0;
+
+		if (ReceivedByte == 0xF7)
+		  return;
+
+		/* Otherwise the status byte starts a new message of its own */
+	}
+
+	/* Running status handling based on Francois Best's Arduino MIDI Library
+	 * https://github.com/FortySevenEffects/arduino_midi_library */
+	if (ReceivedByte & 0x80)
+	{
+		/* A status byte starts a new message, abandoning any incomplete one. Only channel messages leave a
+		 * running status behind them, all other status bytes cancel it */
+		Parser->PendingMessage[0] = ReceivedByte;
+		Parser->PendingIndex      = 1;
+		Parser->ExpectedLength    = ((Status & MIDI_STATUS_LENGTH_MASK) >> MIDI_STATUS_LENGTH_SHIFT);
+		Parser->RunningStatus     = (Status & MIDI_STATUS_RUNNING) ? ReceivedByte : InvalidType;
+
+		if (!(Parser->ExpectedLength))
+		{
+			/* Only a SysEx start has no fixed length, undefined status bytes are ignored */
+			Parser->SysExActive  = ((Status & MIDI_STATUS_CIN_MASK) == MIDI_CIN_SYSEX_START);
+			Parser->PendingIndex = Parser->SysExActive;
+			return;
+		}
+	}
+	else
+	{
+		/* Data bytes without a status byte or running status to apply them to are ignored */
+		if (!(Parser->PendingIndex))
+		  return;
+
+		Parser->PendingMessage[Parser->PendingIndex++] = ReceivedByte;
+	}
+
+	if (Parser->PendingIndex == Parser->ExpectedLength)
+	{
+		MIDIParser_QueueEvent(Parser, FIFO, EchoFIFO,
+		                      (pgm_read_byte(&MIDI_StatusTable[Parser->PendingMessage[0]]) & MIDI_STATUS_CIN_MASK),
+		                      Parser->ExpectedLength);
+
+		/* Under running status the next data byte starts a new message with the same status byte */
+		Parser->PendingIndex = (Parser->RunningStatus != InvalidType) ? 1 : 0;
+	}
+}
@@ -0,0 +1,116 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2017.
+
+  dean [at] fourwalledcubicle [dot] com
+           www.lufa-lib.org
+*/
+
+/*
+  Copyright 2017  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaims all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Header file for MIDIParser.c.
+ */
+
+#ifndef _MIDI_PARSER_H_
+#define _MIDI_PARSER_H_
+
+	/* Includes: */
+		#include <avr/pgmspace.h>
+
+		#include <stdint.h>
+		#include <stdbool.h>
+
+		#include "MIDIEventFIFO.h"
+
+	/* Macros: */
+		/** Mask for the USB-MIDI Code Index Number held in a MIDI status table entry. */
+		#define MIDI_STATUS_CIN_MASK     0x0F
+
+		/** Shift and mask for the total message length, in bytes, held in a MIDI status table entry. */
+		#define MIDI_STATUS_LENGTH_SHIFT 4
+		#define MIDI_STATUS_LENGTH_MASK  (0x03 << MIDI_STATUS_LENGTH_SHIFT)
+
+		/** MIDI status table flag for a channel message status byte, which may be left out of the messages that
+		 *  follow it (running status).
+		 */
+		#define MIDI_STATUS_RUNNING      (1 << 6)
+
+		/** MIDI status table flag for a System Real Time status byte, which may be interleaved into any message. */
+		#define MIDI_STATUS_REALTIME     (1 << 7)
+
+		/** Builds a MIDI status table entry from its Code Index Number, message length and flags. */
+		#define MIDI_STATUS_ENTRY(CIN, Length, Flags)  ((CIN) | ((Length) << MIDI_STATUS_LENGTH_SHIFT) | (Flags))
+
+		/** USB-MIDI Code Index Number of a packet which starts or continues a SysEx message. */
+		#define MIDI_CIN_SYSEX_START     (MIDI_COMMAND_SYSEX_START_3BYTE >> 4)
+
+	/* Enums: */
+		/** Enum for the MIDI message types, given by the status byte of each message with the channel nibble of
+		 *  channel messages cleared.
+		 */
+		typedef enum
+		{
+			InvalidType           = 0x00,    ///< For notifying errors
+			NoteOff               = 0x80,    ///< Note Off
+			NoteOn                = 0x90,    ///< Note On
+			AfterTouchPoly        = 0xA0,    ///< Polyphonic AfterTouch
+			ControlChange         = 0xB0,    ///< Control Change / Channel Mode
+			ProgramChange         = 0xC0,    ///< Program Change
+			AfterTouchChannel     = 0xD0,    ///< Channel (monophonic) AfterTouch
+			PitchBend             = 0xE0,    ///< Pitch Bend
+			SystemExclusive       = 0xF0,    ///< System Exclusive
+			TimeCodeQuarterFrame  = 0xF1,    ///< System Common - MIDI Time Code Quarter Frame
+			SongPosition          = 0xF2,    ///< System Common - Song Position Pointer
+			SongSelect            = 0xF3,    ///< System Common - Song Select
+			TuneRequest           = 0xF6,    ///< System Common - Tune Request
+			Clock                 = 0xF8,    ///< System Real Time - Timing Clock
+			Start                 = 0xFA,    ///< System Real Time - Start
+			Continue              = 0xFB,    ///< System Real Time - Continue
+			Stop                  = 0xFC,    ///< System Real Time - Stop
+			ActiveSensing         = 0xFE,    ///< System Real Time - Active Sensing
+			SystemReset           = 0xFF,    ///< System Real Time - System Reset
+		} MidiMessageType;
+
+	/* Type Defines: */
+		/** Type define for the state of a MIDI parser, which turns a serial MIDI byte stream into USB-MIDI event
+		 *  packets. Parsers should be initialized via a call to \ref MIDIParser_Init() before use.
+		 */
+		typedef struct
+		{
+			uint8_t RunningStatus; /**< Status byte applied to data bytes which arrive without one, or \ref InvalidType */
+			uint8_t PendingMessage[3]; /**< Bytes of the incomplete message, or of the SysEx data not yet sent */
+			uint8_t ExpectedLength; /**< Total length of the incomplete message, in bytes */
+			uint8_t PendingIndex; /**< Number of bytes stored in \c PendingMessage */
+			bool    SysExActive; /**< Whether a SysEx message is being streamed */
+		} MIDIParser_t;
+
+	/* Function Prototypes: */
+		void MIDIParser_Init(MIDIParser_t* const Parser);
+		void MIDIParser_ProcessByte(MIDIParser_t* const Parser,
+		                            MIDIEventFIFO_t* const FIFO,
+		                            MIDIEventFIFO_t* const EchoFIFO,
+		                            const uint8_t ReceivedByte);
+
+#endif
@@ -34,508 +34,2157 @@
  *  the project and is responsible for the initial application hardware configuration.
  */
 
+#define  INCLUDE_FROM_USBTOSERIAL_C
 #include "USBtoSerial.h"
 
-int mode = 1; //0:Serial --- 1:MIDI
+/** Device personality, one of the \ref DeviceModes_t values. */
+int mode = MODE_MIDI;
 
-uint16_t tx_ticks = 0; 
-uint16_t rx_ticks = 0; 
-const uint16_t TICK_COUNT = 5000; 
+/** Device mode chosen by the host, kept in EEPROM so that it survives a power cycle. */
+static uint8_t EEMEM StoredModeEEPROM = DEFAULT_DEVICE_MODE;
+
+/** Copy of \ref StoredModeEEPROM, the mode used whenever the mode jumper is not fitted. */
+static uint8_t StoredMode;
+
+/** Device mode last requested by the host through \ref VENDOR_REQ_SetDeviceMode, which the main loop switches
+ *  to once the request has completed.
+ */
+static volatile uint8_t RequestedMode;
+
+/** Milliseconds left before the TX and RX activity LEDs go back to their status, counted down by the Timer 0 tick. */
+static volatile uint8_t TxLEDPulseMS;
+static volatile uint8_t RxLEDPulseMS;
+
+/** LEDs lit to show the USB status, one of the LEDMASK_USB_* masks. Boards with few LEDs show the status on the
+ *  activity LEDs too, so a pulse shows as the opposite of the LED's status and ends by restoring it.
+ */
+static volatile uint8_t StatusLEDs;
 
 /** Circular buffer to hold data from the host before it is sent to the device via the serial port. */
-static RingBuffer_t USBtoUSART_Buffer;
+RINGBUFF_DEFINE(USBtoUSART_Buffer, USBTOUSART_BUFFER_SIZE)
+
+#if defined(ENABLE_COMPOSITE_MODE)
+/** Circular buffer to hold data from the serial port before it is sent to the host. */
+RINGBUFF_DEFINE(USARTtoUSB_Buffer, USARTTOUSB_BUFFER_SIZE)
+
+/** FIFO of the MIDI events completed by the USART receive ISR, waiting to be sent to the host. */
+static MIDIEventFIFO_t USARTtoUSB_Events;
+#else
+/** Storage of the data received from the serial port before it is sent to the host. Serial mode only uses the
+ *  byte buffer and MIDI mode only the event FIFO, and both are emptied on a mode change, so they share their RAM.
+ */
+static union
+{
+	RINGBUFF_STRUCT(USARTTOUSB_BUFFER_SIZE) Bytes; /**< Circular buffer of the serial data, in serial mode */
+	MIDIEventFIFO_t                         Events; /**< FIFO of the MIDI events completed by the USART receive ISR */
+} USARTtoUSB_Storage;
+
+#define USARTtoUSB_Buffer  USARTtoUSB_Storage.Bytes
+#define USARTtoUSB_Events  USARTtoUSB_Storage.Events
+
+RINGBUFF_DEFINE_ACCESSORS(USARTtoUSB_Buffer, USARTTOUSB_BUFFER_SIZE)
+#endif
+
+/** Serial mode latency timer period in milliseconds, i.e. the longest time received bytes are held back in the
+ *  IN endpoint bank in the hope of filling a whole packet. Set at runtime through \ref VENDOR_REQ_SetLatencyTimer.
+ */
+static volatile uint8_t LatencyTimerMS = DEFAULT_LATENCY_TIMER_MS;
+
+/** Line errors seen by the USART receive ISR and not yet reported to the host, as a mask of the
+ *  CDC_CONTROL_LINE_IN_* error flags of a CDC SerialState notification.
+ */
+static volatile uint8_t PendingSerialState;
+
+/** Milliseconds left before another SerialState notification may be sent, counted down by the Timer 0 tick. */
+static volatile uint8_t SerialStateTimerRemaining;
+
+/** Number of Timer 0 millisecond ticks since startup, the upper part of the MIDI latency timestamps. */
+static volatile uint16_t TimestampMS;
+
+/** Milliseconds left before the target's reset line is released, counted down by the Timer 0 tick. */
+static volatile uint8_t TargetResetRemaining;
+
+/** Whether the host's DTR control line was asserted when it last changed the control line states. */
+static bool PreviousDTRState;
+
+/** Set when the target has been reset, so that the main loop discards the data still buffered in either
+ *  direction before the target's bootloader starts talking.
+ */
+static volatile bool FlushBuffersPending;
+
+/** Milliseconds left before the bytes held in the IN endpoint bank must be sent to the host, counted down by
+ *  the Timer 0 tick.
+ */
+static volatile uint8_t LatencyTimerRemaining;
+
+/** Whether the last packet sent to the host on the CDC data IN endpoint was full, so that the host sees the transfer
+ *  as still going on until a shorter packet follows. A Zero Length Packet is sent to end it if no more data comes.
+ */
+static bool ZLPPending;
+
+/** Baud rate setting the USART was last configured with, returned by \ref VENDOR_REQ_GetBaudRate. */
+static BaudRate_Setting_t USART_BaudRate;
+
+/** MIDI parser turning the bytes received from the serial port into USB-MIDI events for \ref USARTtoUSB_Events. */
+static MIDIParser_t USARTtoUSB_Parser;
+
+/** Retrieves the number of MIDI events from the serial port dropped because \ref USARTtoUSB_Events was full. No
+ *  MIDI events are received in serial mode, which keeps its received data where the FIFO would be.
+ *
+ *  \return Number of events dropped since the count was last cleared
+ */
+static inline uint16_t MIDI_GetOverflows(void)
+{
+	if (mode == MODE_Serial)
+	  return 0;
+
+	return USARTtoUSB_Events.Overflows;
+}
+
+#if defined(ENABLE_PROFILING)
+/** Worst case timings recorded since startup or since they were last read by the host. */
+static ProfilingStats_t ProfilingStats;
+#endif
+
+/** Status byte of the last channel message sent to the Arduino, which later messages may leave out under
+ *  running status, or \ref InvalidType if there is none.
+ */
+static uint8_t mRunningStatus_TX;
+
+/** Traffic and error counters since startup or since they were last cleared by the host. The MIDI event FIFO
+ *  keeps its own overflow count, which is copied in when the counters are read.
+ */
+static DeviceStats_t DeviceStats;
+
+/** MIDI IN packing counters since startup or since they were last cleared by the host. These are kept apart from
+ *  \ref DeviceStats, which also counts the CDC traffic in composite mode.
+ */
+static MIDI_PackingStats_t MIDIPackingStats;
+
+#if defined(ENABLE_COMPOSITE_MODE)
+/** Number of MIDI bytes still to come in the composite mode frame being received, zero between frames. */
+static uint8_t CompositeRxMIDIBytes;
+
+/** Whether a composite mode frame escape byte has been received, and its length byte is next. */
+static bool CompositeRxEscaped;
+
+/** Number of MIDI bytes still to go out in the composite mode frame being transmitted, zero between frames. */
+static uint8_t CompositeTxMIDIBytes;
+
+/** Whether a composite mode frame escape byte has been transmitted, and its length byte is next. */
+static bool CompositeTxEscaped;
+#endif
+
+#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+/** Whether the host is being held off because \ref USBtoUSART_Buffer reached \ref USBTOUSART_HIGH_WATERMARK,
+ *  until it drains to \ref USBTOUSART_LOW_WATERMARK.
+ */
+static bool USBtoUSART_Throttled;
+#endif
+
+#if !defined(NO_MIDI_TX_RUNNING_STATUS)
+/** Whether running status is used to compress the channel messages sent to the Arduino. Follows
+ *  \ref MIDI_TX_RunningStatusRequested, before the next message is queued.
+ */
+static bool MIDI_TX_RunningStatus = true;
+
+/** Whether running status should be used, as set at runtime through \ref VENDOR_REQ_SetMIDIRunningStatus. The
+ *  request is handled from the control endpoint interrupt, so it is left to the main loop to apply.
+ */
+static volatile bool MIDI_TX_RunningStatusRequested = true;
+#endif
+
+#if defined(ENABLE_MIDI_SOFT_THRU)
+/** Whether the MIDI events received from the serial port are also echoed back to it. Set at runtime through
+ *  \ref VENDOR_REQ_SetMIDISoftThru, off at startup.
+ */
+static volatile bool MIDI_SoftThru;
+
+/** FIFO of the MIDI events completed by the USART receive ISR, waiting to be echoed back to the serial port. */
+static MIDIEventFIFO_t USARTtoUSART_Events;
+
+/** Source of the System Exclusive message being sent to the Arduino, one of the \ref MIDI_TxSources_t values.
+ *  Messages from the other source are held back until it ends, so that the merged stream never splits it.
+ */
+static uint8_t MIDI_TxSysExSource;
+#endif
+
+#if defined(ENABLE_MIDI_LATENCY_STATS)
+/** MIDI latency histograms since startup or since they were last cleared by the host. */
+static MIDI_LatencyStats_t MIDILatencyStats;
+
+/** Timestamps of the events in \ref USARTtoUSB_Events, stored in the slot matching each event's own. */
+static MIDI_Timestamp_t USARTtoUSB_EventTimes[MIDI_EVENT_FIFO_SIZE];
+
+/** Timestamp of the moment the MIDI OUT bank being worked on was first seen, valid while \ref MIDI_OUTBankTimed
+ *  is set.
+ */
+static MIDI_Timestamp_t MIDI_OUTBankTime;
+
+/** Whether the MIDI OUT bank being worked on has been timestamped. */
+static bool MIDI_OUTBankTimed;
+
+/** FIFO of the messages queued for the Arduino whose latency is being tracked, each made of the timestamp of its
+ *  OUT bank and the \ref USBtoUSART_Buffer head count just past its last byte.
+ */
+static MIDI_Timestamp_t MIDI_TxStampTimes[MIDI_LATENCY_TX_STAMPS];
+static uint8_t          MIDI_TxStampEnds[MIDI_LATENCY_TX_STAMPS];
+static volatile uint8_t MIDI_TxStampHead;
+static volatile uint8_t MIDI_TxStampTail;
+#endif
+
+#if defined(ENABLE_MIDI_CLOCK_STATS)
+/** Measurements of the MIDI clock received from the serial port since startup or since they were last cleared by
+ *  the host. The averages, the tempo and the PLL state are filled in when the measurements are read.
+ */
+static MIDI_ClockStats_t MIDIClockStats = { .MinInterval = UINT16_MAX };
+
+/** Running averages of the MIDI clock interval and of each interval's deviation from it, in timestamp ticks
+ *  scaled up by \ref MIDI_CLOCK_AVERAGE_SHIFT bits.
+ */
+static uint32_t MIDIClock_IntervalAverage;
+static uint32_t MIDIClock_JitterAverage;
+
+/** Timestamp and millisecond tick count of the last MIDI clock received. */
+static uint16_t MIDIClock_LastTime;
+static uint16_t MIDIClock_LastMS;
+
+/** Number of MIDI clocks received in a row less than \ref MIDI_CLOCK_MAX_INTERVAL_MS apart, saturating at 255,
+ *  or zero before the first clock.
+ */
+static uint8_t MIDIClock_Run;
+#endif
+
+#if defined(ENABLE_MIDI_CLOCK_PLL)
+/** MIDI clock PLL mode, a mask of \ref MIDI_ClockModes_t flags set through \ref VENDOR_REQ_SetMIDIClockMode. */
+static volatile uint8_t MIDIClock_Mode;
+
+/** Whether the PLL is locked onto the received MIDI clock, and Timer 1 regenerates it. */
+static volatile bool MIDIClock_Locked;
+
+/** Period of the regenerated MIDI clock in Timer 1 counts, following the averaged interval of the received one. */
+static uint16_t MIDIClock_Period;
+
+/** Number of MIDI clocks received less the number regenerated since the PLL locked. */
+static int8_t MIDIClock_Balance;
+
+/** Set when a regenerated MIDI clock could not be written to the busy USART, for its transmit ISR to send next. */
+static volatile bool MIDIClock_TxPending;
+#endif
+
+/** Number of MIDI bytes carried by a USB-MIDI event packet, indexed by the packet's Code Index Number. The
+ *  reserved miscellaneous and cable event CINs carry nothing that can be passed on, and are skipped.
+ */
+static const uint8_t PROGMEM MIDI_CINDataLength[16] =
+	{
+		0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1
+	};
+
+/** LUFA CDC Class driver interface configuration and state information. This structure is
+ *  passed to all CDC Class driver functions, so that multiple instances of the same class
+ *  within a device can be differentiated from one another.
+ */
+USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
+	{
+		.Config =
+			{
+				.ControlInterfaceNumber         = INTERFACE_ID_CDC_CCI,
+				.DataINEndpoint                 =
+					{
+						.Address                = CDC_TX_EPADDR,
+						.Size                   = CDC_TXRX_EPSIZE,
+						.Banks                  = CDC_TXRX_BANKS,
+					},
+				.DataOUTEndpoint                =
+					{
+						.Address                = CDC_RX_EPADDR,
+						.Size                   = CDC_TXRX_EPSIZE,
+						.Banks                  = CDC_TXRX_BANKS,
+					},
+				.NotificationEndpoint           =
+					{
+						.Address                = CDC_NOTIFICATION_EPADDR,
+						.Size                   = CDC_NOTIFICATION_EPSIZE,
+						.Banks                  = 1,
+					},
+			},
+	};
+
+/** Main program entry point. This routine contains the overall program flow, including initial
+ *  setup of all components and the main program loop.
+ */
+int main(void)
+{
+	SetupHardware();
+
+	LEDs_SetStatus(LEDMASK_USB_NOTREADY);
+	GlobalInterruptEnable();
+
+	for (;;)
+	{
+		PROFILE_START(LoopStart);
+
+		switch (mode)
+		{
+			case MODE_Serial:
+				/* Move everything the host has sent so far into the USART transmit buffer */
+				Serial_To_Arduino();
+
+				/* Send the bytes received from the target once the IN packet is due */
+				Serial_To_Host();
+
+				#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+				FlowControl_Task();
+				#endif
+
+				SerialState_Task();
+
+				if (FlushBuffersPending)
+				  Serial_FlushBuffers();
+
+				CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
+				break;
+			case MODE_MIDI:
+				#if defined(ENABLE_MIDI_SOFT_THRU)
+				MIDI_SoftThru_Task();
+				#endif
+
+				MIDI_To_Arduino();
+				MIDI_To_Host();
+				break;
+			#if defined(ENABLE_COMPOSITE_MODE)
+			case MODE_Composite:
+				/* Both interfaces queue whole frames into the shared USART transmit buffer in turn */
+				Serial_To_Arduino();
+
+				#if defined(ENABLE_MIDI_SOFT_THRU)
+				MIDI_SoftThru_Task();
+				#endif
+
+				MIDI_To_Arduino();
+
+				Serial_To_Host();
+				MIDI_To_Host();
+
+				#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+				FlowControl_Task();
+				#endif
+
+				SerialState_Task();
+
+				if (FlushBuffersPending)
+				  Serial_FlushBuffers();
+
+				CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
+				break;
+			#endif
+		}
+
+		USB_USBTask();
+
+		if (RequestedMode != StoredMode)
+		  Mode_Change(RequestedMode);
+
+		PROFILE_END(LoopStart, ProfilingStats.LoopMaxCycles);
+	}
+}
+
+/** Configures the board hardware and chip peripherals for the demo's functionality. */
+void SetupHardware(void)
+{
+	#if (ARCH == ARCH_AVR8)
+		/* Disable watchdog if enabled by bootloader/fuses */
+		MCUSR &= ~(1 << WDRF);
+		wdt_disable();
+
+		/* Disable clock division */
+		clock_prescale_set(clock_div_1);
+	#endif
+
+	/* Mode jumper input, with its pull-up enabled */
+	DDRB  &= ~MODE_JUMPER_MASK;
+	PORTB |=  MODE_JUMPER_MASK;
+
+	/* The mode last chosen by the host is kept in EEPROM, an erased or unknown value selects the default mode */
+	StoredMode = eeprom_read_byte(&StoredModeEEPROM);
+
+	if (!(Mode_IsValid(StoredMode)))
+	  StoredMode = DEFAULT_DEVICE_MODE;
+
+	RequestedMode = StoredMode;
+
+	/* Hardware Initialization */
+	LEDs_Init();
+
+	/* Start the millisecond tick, which times the activity LEDs and the latency timer */
+	TCCR0A = (1 << WGM01);
+	OCR0A  = ((F_CPU / 64 / 1000) - 1);
+	TCCR0B = ((1 << CS01) | (1 << CS00));
+	TIMSK0 = (1 << OCIE0A);
+
+	#if defined(ENABLE_PROFILING)
+	/* Run Timer 1 freely from the CPU clock, as the cycle counter for the profiled sections of code */
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);
+	#endif
+
+	Mode_Setup();
+	USB_Init();
+}
+
+/** Checks whether a value names one of the device modes supported by this build. The value is taken whole, so that
+ *  the 16-bit \c wValue of a request is not truncated into a valid mode first.
+ *
+ *  \param[in] Mode  Device mode to check, one of the \ref DeviceModes_t values
+ *
+ *  \return Boolean \c true if the mode is supported, \c false otherwise
+ */
+static bool Mode_IsValid(const uint16_t Mode)
+{
+	#if defined(ENABLE_COMPOSITE_MODE)
+	if (Mode == MODE_Composite)
+	  return true;
+	#endif
+
+	return ((Mode == MODE_Serial) || (Mode == MODE_MIDI));
+}
+
+/** Selects the device mode from the mode jumper and \ref StoredMode, and sets up the USART and the data buffers
+ *  for it. A fitted jumper (pulling the pin low) forces serial mode, whatever mode the host has chosen.
+ */
+static void Mode_Setup(void)
+{
+	mode = (PINB & MODE_JUMPER_MASK) ? StoredMode : MODE_Serial;
+
+	/* Stop the USART, so that its interrupts do not run on the buffers while they are reset */
+	UCSR1B = 0;
+
+	USBtoUSART_Buffer_Init();
+	USARTtoUSB_Buffer_Init();
+	MIDIEventFIFO_Init(&USARTtoUSB_Events);
+	MIDIParser_Init(&USARTtoUSB_Parser);
+
+	mRunningStatus_TX     = InvalidType;
+	LatencyTimerRemaining = 0;
+	ZLPPending            = false;
+	PendingSerialState    = 0;
+	PreviousDTRState      = false;
+	FlushBuffersPending   = false;
+
+	#if defined(ENABLE_MIDI_LATENCY_STATS)
+	MIDI_TxStampHead  = 0;
+	MIDI_TxStampTail  = 0;
+	MIDI_OUTBankTimed = false;
+	#endif
+
+	#if defined(ENABLE_MIDI_SOFT_THRU)
+	MIDIEventFIFO_Init(&USARTtoUSART_Events);
+	MIDI_TxSysExSource = MIDI_TX_SOURCE_None;
+	#endif
+
+	#if defined(ENABLE_MIDI_CLOCK_STATS)
+	MIDIClock_Run = 0;
+	#endif
+
+	#if defined(ENABLE_MIDI_CLOCK_PLL)
+	MIDIClock_StopPLL();
+	MIDIClock_Balance   = 0;
+	MIDIClock_TxPending = false;
+	#endif
+
+	#if defined(ENABLE_COMPOSITE_MODE)
+	CompositeRxMIDIBytes = 0;
+	CompositeRxEscaped   = false;
+	CompositeTxMIDIBytes = 0;
+	CompositeTxEscaped   = false;
+	#endif
+
+	#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+	USBtoUSART_Throttled = false;
+
+	if (mode != MODE_MIDI)
+	{
+		/* RTS starts deasserted until the host is ready, CTS is pulled up so that the target must assert it */
+		AVR_RTS_LINE_PORT |= AVR_RTS_LINE_MASK;
+		AVR_RTS_LINE_DDR  |= AVR_RTS_LINE_MASK;
+		AVR_CTS_LINE_DDR  &= ~AVR_CTS_LINE_MASK;
+		AVR_CTS_LINE_PORT |= AVR_CTS_LINE_MASK;
+	}
+	else
+	{
+		/* MIDI has no flow control, leave both lines floating */
+		AVR_RTS_LINE_DDR  &= ~AVR_RTS_LINE_MASK;
+		AVR_RTS_LINE_PORT &= ~AVR_RTS_LINE_MASK;
+		AVR_CTS_LINE_PORT &= ~AVR_CTS_LINE_MASK;
+	}
+	#endif
+
+	if (mode != MODE_MIDI)
+	{
+		/* The target's reset line idles high, and is pulsed low when the host asserts DTR */
+		TargetResetRemaining = 0;
+		AVR_RESET_LINE_PORT |= AVR_RESET_LINE_MASK;
+		AVR_RESET_LINE_DDR  |= AVR_RESET_LINE_MASK;
+	}
+	else
+	{
+		AVR_RESET_LINE_DDR  &= ~AVR_RESET_LINE_MASK;
+		AVR_RESET_LINE_PORT &= ~AVR_RESET_LINE_MASK;
+	}
+
+	if (mode == MODE_Serial)
+	{
+		/* The USART is set up once the host sets a line encoding, and the target's /ERASE line is left alone */
+		AVR_ERASE_LINE_DDR  &= ~AVR_ERASE_LINE_MASK;
+		AVR_ERASE_LINE_PORT &= ~AVR_ERASE_LINE_MASK;
+	}
+	else
+	{
+		Serial_Init(31250, false);
+		BaudRate_Select(F_CPU, 31250, &USART_BaudRate);
+
+		// Serial Interrupts
+		UCSR1B = 0;
+		UCSR1B = ((1 << RXCIE1) | (1 << TXEN1) | (1 << RXEN1));
+
+		// https://github.com/ddiakopoulos/hiduino/issues/13
+		/* Target /ERASE line is active HIGH: there is a mosfet that inverts logic */
+		// These are defined in the makefile... 
+		AVR_ERASE_LINE_PORT |= AVR_ERASE_LINE_MASK;
+		AVR_ERASE_LINE_DDR |= AVR_ERASE_LINE_MASK; 
+	}
+}
+
+/** Stores a new device mode chosen by the host in EEPROM, and re-enumerates with its descriptors. The device
+ *  detaches from the bus long enough for the host to see it leave, so that it re-reads every descriptor when
+ *  the device attaches again.
+ *
+ *  \param[in] NewMode  Device mode to switch to, one of the \ref DeviceModes_t values
+ */
+static void Mode_Change(const uint8_t NewMode)
+{
+	StoredMode = NewMode;
+	eeprom_update_byte(&StoredModeEEPROM, NewMode);
+
+	/* A fitted mode jumper keeps the device in serial mode, the new mode only applies once it is removed */
+	if ((PINB & MODE_JUMPER_MASK) && (NewMode != mode))
+	{
+		/* Give the host time to collect the status stage of the mode request before dropping off the bus */
+		Delay_MS(MODE_SWITCH_DETACH_MS);
+
+		USB_Disable();
+		LEDs_SetStatus(LEDMASK_USB_NOTREADY);
+
+		Mode_Setup();
+
+		Delay_MS(MODE_SWITCH_DETACH_MS);
+		USB_Init();
+	}
+}
+
+/** Event handler for the library USB Connection event. */
+void EVENT_USB_Device_Connect(void)
+{
+	LEDs_SetStatus(LEDMASK_USB_ENUMERATING);
+}
+
+/** Event handler for the library USB Disconnection event. */
+void EVENT_USB_Device_Disconnect(void)
+{
+	/* The next host must be able to reset the target as soon as it asserts DTR */
+	PreviousDTRState = false;
+
+	LEDs_SetStatus(LEDMASK_USB_NOTREADY);
+}
+
+/** Event handler for the library USB Configuration Changed event. */
+void EVENT_USB_Device_ConfigurationChanged(void)
+{
+	bool ConfigSuccess = true;
+
+	/* A new configuration starts with DTR deasserted, whatever state the previous one left it in */
+	PreviousDTRState = false;
+
+	if ((mode == MODE_Serial) || (mode == MODE_Composite)){
+		/* Setup Serial Data Endpoints */
+		ConfigSuccess &= CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
+	}
+
+	if ((mode == MODE_MIDI) || (mode == MODE_Composite)){
+		/* Setup MIDI Data Endpoints */
+		ConfigSuccess &= Endpoint_ConfigureEndpoint(MIDI_STREAM_IN_EPADDR, EP_TYPE_BULK, MIDI_STREAM_EPSIZE, 1);
+		ConfigSuccess &= Endpoint_ConfigureEndpoint(MIDI_STREAM_OUT_EPADDR, EP_TYPE_BULK, MIDI_STREAM_EPSIZE, 1);
+	}
+
+	LEDs_SetStatus(ConfigSuccess ? LEDMASK_USB_READY : LEDMASK_USB_ERROR);
+}
+
+/** Event handler for the library USB Control Request reception event. */
+void EVENT_USB_Device_ControlRequest(void)
+{
+	if ((USB_ControlRequest.bmRequestType & CONTROL_REQTYPE_TYPE) == REQTYPE_VENDOR)
+	  Vendor_ProcessControlRequest();
+	else
+	  CDC_Device_ProcessControlRequest(&VirtualSerial_CDC_Interface);
+}
+
+/** Processes the vendor specific control requests listed in \ref VendorRequests_t. Unknown requests are left
+ *  unhandled, so that the library stalls them.
+ */
+void Vendor_ProcessControlRequest(void)
+{
+	switch (USB_ControlRequest.bRequest)
+	{
+		case VENDOR_REQ_SetLatencyTimer:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+
+				LatencyTimerMS = MIN(USB_ControlRequest.wValue, UINT8_MAX);
+
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		case VENDOR_REQ_GetLatencyTimer:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				uint8_t CurrentLatencyTimerMS = LatencyTimerMS;
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&CurrentLatencyTimerMS, sizeof(CurrentLatencyTimerMS));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case VENDOR_REQ_GetMIDIPackingStats:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				MIDI_PackingStats_t PackingStats;
+
+				/* Control requests are processed with interrupts enabled, so take a consistent snapshot */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					PackingStats = MIDIPackingStats;
+				}
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&PackingStats, sizeof(PackingStats));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		#if !defined(NO_MIDI_TX_RUNNING_STATUS)
+		case VENDOR_REQ_SetMIDIRunningStatus:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+
+				/* The change is applied by the main loop, as it may be queueing a message with the current setting */
+				MIDI_TX_RunningStatusRequested = (USB_ControlRequest.wValue != 0);
+
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		#endif
+		#if defined(ENABLE_MIDI_SOFT_THRU)
+		case VENDOR_REQ_SetMIDISoftThru:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+
+				/* Events already waiting in the FIFO are still sent when the soft-thru is turned off */
+				MIDI_SoftThru = (USB_ControlRequest.wValue != 0);
+
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		#endif
+		#if defined(ENABLE_MIDI_CLOCK_STATS)
+		case VENDOR_REQ_GetMIDIClockStats:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				MIDI_ClockStats_t ClockStats;
+				uint32_t          IntervalAverage;
+				uint32_t          JitterAverage;
+				uint8_t           Run;
+
+				/* The USART receive ISR updates the measurements, so take a consistent snapshot */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					ClockStats      = MIDIClockStats;
+					IntervalAverage = MIDIClock_IntervalAverage;
+					JitterAverage   = MIDIClock_JitterAverage;
+					Run             = MIDIClock_Run;
+
+					#if defined(ENABLE_MIDI_CLOCK_PLL)
+					ClockStats.Locked = MIDIClock_Locked;
+					#else
+					ClockStats.Locked = false;
+					#endif
+				}
+
+				ClockStats.Interval = (IntervalAverage >> MIDI_CLOCK_AVERAGE_SHIFT);
+				ClockStats.Jitter   = (JitterAverage >> MIDI_CLOCK_AVERAGE_SHIFT);
+				ClockStats.Tempo    = 0;
+
+				/* At 24 clocks per quarter note, the tempo in 0.01 BPM is 250 over the clock interval in seconds */
+				if ((Run > 1) && IntervalAverage)
+				{
+					uint32_t Tempo = ((((uint32_t)TIMESTAMP_TICKS_PER_MS * 250000UL) << MIDI_CLOCK_AVERAGE_SHIFT) /
+					                  IntervalAverage);
+
+					ClockStats.Tempo = (Tempo > UINT16_MAX) ? UINT16_MAX : Tempo;
+				}
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&ClockStats, sizeof(ClockStats));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		#endif
+		#if defined(ENABLE_MIDI_CLOCK_PLL)
+		case VENDOR_REQ_SetMIDIClockMode:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+
+				/* The PLL runs from the USART receive ISR and Timer 1, which must not see it half turned off */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					MIDIClock_Mode = (USB_ControlRequest.wValue & (MIDI_CLOCK_MODE_Regenerate | MIDI_CLOCK_MODE_ToSerial));
+
+					if (!(MIDIClock_Mode & MIDI_CLOCK_MODE_Regenerate))
+					{
+						MIDIClock_StopPLL();
+						MIDIClock_Balance = 0;
+					}
+				}
+
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		#endif
+		case VENDOR_REQ_GetMIDIOverflows:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				uint16_t Overflows;
+
+				/* The USART receive ISR may count an overflow in between the two bytes of the counter */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					Overflows = MIDI_GetOverflows();
+				}
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&Overflows, sizeof(Overflows));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		#if defined(ENABLE_PROFILING)
+		case VENDOR_REQ_GetProfilingStats:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				ProfilingStats_t Stats;
+
+				/* Each read starts a fresh measurement, so that the host can time one scenario at a time. The ISRs
+				 * update the counters while the request is processed, so they are copied and cleared in one go */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					Stats = ProfilingStats;
+					memset(&ProfilingStats, 0, sizeof(ProfilingStats));
+				}
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&Stats, sizeof(Stats));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		#endif
+		case VENDOR_REQ_GetDeviceStats:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				DeviceStats_t Stats;
+
+				/* Control requests are processed with interrupts enabled, so take a consistent snapshot */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					Stats = DeviceStats;
+					Stats.DroppedMIDIEvents = MIDI_GetOverflows();
+				}
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&Stats, sizeof(Stats));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case VENDOR_REQ_SetDeviceMode:
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) &&
+			    Mode_IsValid(USB_ControlRequest.wValue))
+			{
+				Endpoint_ClearSETUP();
+
+				/* The EEPROM write and re-enumeration are left to the main loop, once the request has completed */
+				RequestedMode = USB_ControlRequest.wValue;
+
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		case VENDOR_REQ_GetDeviceMode:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				uint8_t Modes[2] = {mode, RequestedMode};
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&Modes, sizeof(Modes));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case VENDOR_REQ_GetBaudRate:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				BaudRate_Setting_t BaudRate = USART_BaudRate;
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&BaudRate, sizeof(BaudRate));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+		case VENDOR_REQ_GetMIDILatency:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				MIDI_LatencyStats_t LatencyStats;
+
+				/* Control requests are processed with interrupts enabled, so take a consistent snapshot */
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					LatencyStats = MIDILatencyStats;
+				}
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&LatencyStats, sizeof(LatencyStats));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		#endif
+		case VENDOR_REQ_ClearDeviceStats:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+			{
+				Endpoint_ClearSETUP();
+
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					memset(&DeviceStats, 0, sizeof(DeviceStats));
+					memset(&MIDIPackingStats, 0, sizeof(MIDIPackingStats));
+
+					/* Serial mode keeps its received data where the MIDI event FIFO would be */
+					if (mode != MODE_Serial)
+					  USARTtoUSB_Events.Overflows = 0;
+
+					#if defined(ENABLE_MIDI_LATENCY_STATS)
+					memset(&MIDILatencyStats, 0, sizeof(MIDILatencyStats));
+					#endif
+
+					#if defined(ENABLE_MIDI_CLOCK_STATS)
+					MIDIClockStats.MinInterval = UINT16_MAX;
+					MIDIClockStats.MaxInterval = 0;
+					MIDIClockStats.Intervals   = 0;
+					#endif
+				}
+
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+	}
+}
+
+/** Raises a ring buffer high-water mark in \ref DeviceStats, if the buffer now holds more bytes than before.
+ *
+ *  \param[in,out] HighWater  High-water mark of the buffer
+ *  \param[in]     Count      Number of bytes now held in the buffer
+ */
+static inline void DeviceStats_UpdateHighWater(uint8_t* const HighWater,
+                                               const uint16_t Count)
+{
+	if (Count > *HighWater)
+	  *HighWater = Count;
+}
+
+/** Shows the USB status on the board LEDs, which the activity LEDs return to at the end of each pulse.
+ *
+ *  \param[in] LEDMask  Mask of the LEDs to light, one of the LEDMASK_USB_* masks
+ */
+static void LEDs_SetStatus(const uint8_t LEDMask)
+{
+	StatusLEDs = LEDMask;
+	LEDs_SetAllLEDs(LEDMask);
+}
+
+/** Flips an activity LED from its status for \ref ACTIVITY_LED_PULSE_MS milliseconds, after which the Timer 0 tick
+ *  restores it. Further activity during the pulse extends it.
+ *
+ *  \param[in]     LEDMask  Mask of the activity LED to pulse
+ *  \param[in,out] PulseMS  Countdown of the LED's remaining on-time
+ */
+static inline void LEDs_PulseActivity(const uint8_t LEDMask,
+                                      volatile uint8_t* const PulseMS)
+{
+	/* The LED is flipped first, so that a tick between the two cannot restore it with the new pulse pending. Each
+	 * call site passes a single constant LED, so the change is one atomic bit set or clear the tick cannot upset */
+	if (StatusLEDs & LEDMask)
+	  LEDs_TurnOffLEDs(LEDMask);
+	else
+	  LEDs_TurnOnLEDs(LEDMask);
+
+	*PulseMS = ACTIVITY_LED_PULSE_MS;
+}
+
+/** Returns an activity LED to its status once its pulse has ended.
+ *
+ *  \param[in] LEDMask  Mask of the activity LED to restore
+ */
+static inline void LEDs_RestoreStatus(const uint8_t LEDMask)
+{
+	if (StatusLEDs & LEDMask)
+	  LEDs_TurnOnLEDs(LEDMask);
+	else
+	  LEDs_TurnOffLEDs(LEDMask);
+}
+
+#if defined(ENABLE_MIDI_LATENCY_STATS) || defined(ENABLE_MIDI_CLOCK_STATS)
+/** Reads the current time for the MIDI latency and clock statistics, from the millisecond tick count and Timer 0.
+ *
+ *  \param[out] MS     Millisecond tick count
+ *  \param[out] Ticks  Timer 0 count within the millisecond, in 4us ticks
+ */
+static inline void Timestamp_Read(uint16_t* const MS,
+                                  uint8_t* const Ticks)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*MS    = TimestampMS;
+		*Ticks = TCNT0;
+
+		/* The timer may have wrapped with its tick still pending, if interrupts were already disabled */
+		if ((TIFR0 & (1 << OCF0A)) && (*Ticks < (TIMESTAMP_TICKS_PER_MS / 2)))
+		  (*MS)++;
+	}
+}
+
+/** Reads the current time as a single count, for intervals known to be shorter than its wrap.
+ *
+ *  \return Current time in 4us ticks, wrapping every 262ms
+ */
+static inline uint16_t Timestamp_Now(void)
+{
+	uint16_t MS;
+	uint8_t  Ticks;
+
+	Timestamp_Read(&MS, &Ticks);
+
+	return (uint16_t)((MS * (uint16_t)TIMESTAMP_TICKS_PER_MS) + Ticks);
+}
+#endif
+
+#if defined(ENABLE_MIDI_LATENCY_STATS)
+/** Reads the current time as a MIDI latency timestamp.
+ *
+ *  \return Current time
+ */
+static inline MIDI_Timestamp_t MIDILatency_Stamp(void)
+{
+	MIDI_Timestamp_t Stamp;
+
+	Timestamp_Read(&Stamp.MS, &Stamp.Ticks);
+
+	return Stamp;
+}
+
+/** Works out the time between two MIDI latency timestamps.
+ *
+ *  \param[in] Then  Timestamp at the start of the interval
+ *  \param[in] Now   Timestamp at the end of the interval
+ *
+ *  \return Interval in 4us ticks, saturating at 65535 (262ms) rather than wrapping
+ */
+static inline uint16_t MIDILatency_Elapsed(const MIDI_Timestamp_t Then,
+                                           const MIDI_Timestamp_t Now)
+{
+	uint16_t ElapsedMS = (Now.MS - Then.MS);
+
+	if (ElapsedMS >= (UINT16_MAX / TIMESTAMP_TICKS_PER_MS))
+	  return UINT16_MAX;
+
+	return (uint16_t)((ElapsedMS * (uint16_t)TIMESTAMP_TICKS_PER_MS) + Now.Ticks - Then.Ticks);
+}
+
+/** Counts an event's latency into one of the MIDI latency histograms.
+ *
+ *  \param[in,out] Histogram  Histogram to count the latency into
+ *  \param[in]     Latency    Latency of the event, in 4us ticks
+ */
+static inline void MIDILatency_Record(uint16_t* const Histogram,
+                                      uint16_t Latency)
+{
+	uint8_t Bucket = 0;
+
+	Latency /= MIDI_LATENCY_FIRST_BUCKET;
+
+	while (Latency && (Bucket < (MIDI_LATENCY_BUCKETS - 1)))
+	{
+		Latency >>= 1;
+		Bucket++;
+	}
+
+	if (Histogram[Bucket] != UINT16_MAX)
+	  Histogram[Bucket]++;
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Serial Worker Functions
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+/** Drives the RTS line to the target, which is active low.
+ *
+ *  \param[in] Assert  Boolean \c true to let the target send, \c false to ask it to stop
+ */
+static inline void FlowControl_SetRTS(const bool Assert)
+{
+	if (Assert)
+	  AVR_RTS_LINE_PORT &= ~AVR_RTS_LINE_MASK;
+	else
+	  AVR_RTS_LINE_PORT |= AVR_RTS_LINE_MASK;
+}
+
+/** Reads the CTS line from the target, which is active low. MIDI has no flow control and leaves the line
+ *  floating, so it always counts as asserted in MIDI mode.
+ *
+ *  \return Boolean \c true if the target is ready to receive, \c false otherwise
+ */
+static inline bool FlowControl_IsCTSAsserted(void)
+{
+	if (mode == MODE_MIDI)
+	  return true;
+
+	return !(AVR_CTS_LINE_PIN & AVR_CTS_LINE_MASK);
+}
+#endif
+
+/** Arms the USART Data Register Empty interrupt, so that \ref USBtoUSART_Buffer is drained into the USART in
+ *  the background. The interrupt disarms itself once the buffer runs empty, so this must be called each time
+ *  new data is queued for transmission.
+ */
+static inline void USART_StartTransmit(void)
+{
+	#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+	/* The main loop starts the transmission once the target asserts CTS again */
+	if (!(FlowControl_IsCTSAsserted()))
+	  return;
+	#endif
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		UCSR1B |= (1 << UDRIE1);
+	}
+}
+
+/** Drains the CDC data OUT endpoint into \ref USBtoUSART_Buffer. Rather than fetching a single byte per
+ *  main loop iteration, every byte currently held in the OUT bank is moved across in one pass, bounded by
+ *  the free space left in the buffer. Bytes which do not fit stay in the bank and are picked up on a later
+ *  pass, once the USART has made room for them.
+ */
+void Serial_To_Arduino(void)
+{
+	/* Device must be connected and configured, and the host must have set a line encoding */
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS))
+	  return;
+
+	Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.DataOUTEndpoint.Address);
+
+	if (!(Endpoint_IsOUTReceived()))
+	  return;
+
+	#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+	/* Once the buffer has filled up, leave the host waiting until it has mostly drained */
+	if (USBtoUSART_Throttled)
+	{
+		if (USBtoUSART_Buffer_GetCount() > USBTOUSART_LOW_WATERMARK)
+		  return;
+
+		USBtoUSART_Throttled = false;
+	}
+	#endif
+
+	uint8_t BytesToMove = MIN(Endpoint_BytesInEndpoint(), USBtoUSART_Buffer_GetFreeCount());
+
+	#if defined(ENABLE_COMPOSITE_MODE)
+	/* Leave room for every byte to need escaping on the shared USART */
+	if (mode == MODE_Composite)
+	  BytesToMove = MIN(Endpoint_BytesInEndpoint(), USBtoUSART_Buffer_GetFreeCount() / 2);
+	#endif
+
+	if (BytesToMove)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			DeviceStats.BytesFromHost += BytesToMove;
+		}
+
+		#if defined(ENABLE_COMPOSITE_MODE)
+		if (mode == MODE_Composite)
+		{
+			while (BytesToMove--)
+			{
+				uint8_t DataByte = Endpoint_Read_8();
+
+				USBtoUSART_Buffer_Insert(DataByte);
+
+				/* A zero length frame marks a literal escape byte in the serial data */
+				if (DataByte == COMPOSITE_FRAME_ESCAPE)
+				  USBtoUSART_Buffer_Insert(0);
+			}
+		}
+		else
+		#endif
+		{
+			/* Copy the bank contents straight into the USART transmit buffer storage, at most in two runs */
+			while (BytesToMove)
+			{
+				uint8_t* Span;
+				uint8_t  SpanLength = MIN(BytesToMove, USBtoUSART_Buffer_GetWriteSpan(&Span));
+
+				BytesToMove -= SpanLength;
+
+				for (uint8_t i = SpanLength; i; i--)
+				  *(Span++) = Endpoint_Read_8();
+
+				USBtoUSART_Buffer_CommitWrite(SpanLength);
+			}
+		}
+
+		DeviceStats_UpdateHighWater(&DeviceStats.USBtoUSARTHighWater, USBtoUSART_Buffer_GetCount());
+
+		#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+		if (USBtoUSART_Buffer_GetCount() >= USBTOUSART_HIGH_WATERMARK)
+		  USBtoUSART_Throttled = true;
+		#endif
+
+		USART_StartTransmit();
+
+		LEDs_PulseActivity(LEDMASK_RX, &RxLEDPulseMS);
+	}
+
+	/* Release the bank once it has been fully consumed (this also discards Zero Length Packets) */
+	if (!(Endpoint_BytesInEndpoint()))
+	{
+		Endpoint_ClearOUT();
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			DeviceStats.OUTPackets++;
+		}
+	}
+}
+
+/** Moves bytes from \ref USARTtoUSB_Buffer into the CDC data IN endpoint, in the manner of an FTDI latency
+ *  timer. Received bytes are gathered in the IN bank, which is only handed to the host once it holds a full
+ *  packet, once the USART receive buffer is nearly full, or once the latency timer expires. Packets stay large
+ *  at high data rates, while the delay seen by the host at low rates is bounded by \ref LatencyTimerMS. While the
+ *  host keeps up, the USART receive ISR fills the bank itself and this only decides when to send it.
+ */
+void Serial_To_Host(void)
+{
+	/* Device must be connected and configured, and the host must have set a line encoding */
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS))
+	  return;
+
+	Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.DataINEndpoint.Address);
+
+	/* Check if a packet is already enqueued to the host - if so, we shouldn't try to send more data
+	 * until it completes as there is a chance nothing is listening and a lengthy timeout could occur */
+	if (!(Endpoint_IsINReady()))
+	  return;
+
+	uint8_t BufferCount = USARTtoUSB_Buffer_GetCount();
+	uint8_t BytesToSend = MIN(BufferCount, (CDC_TXRX_EPSIZE - Endpoint_BytesInEndpoint()));
+
+	/* Copy bytes from the USART receive buffer storage into the USB IN endpoint, at most in two runs */
+	while (BytesToSend)
+	{
+		uint8_t* Span;
+		uint8_t  SpanLength = MIN(BytesToSend, USARTtoUSB_Buffer_GetReadSpan(&Span));
+
+		BytesToSend -= SpanLength;
+
+		for (uint8_t i = SpanLength; i; i--)
+		  Endpoint_Write_8(*(Span++));
+
+		USARTtoUSB_Buffer_CommitRead(SpanLength);
+	}
+
+	uint8_t BytesInBank;
+	bool    SendBank = false;
+
+	/* The USART receive ISR writes straight into the bank while the buffer is empty, so the bank must be
+	 * sent with exactly the bytes counted */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		BytesInBank = Endpoint_BytesInEndpoint();
+
+		if (BytesInBank)
+		  SendBank = ((BytesInBank == CDC_TXRX_EPSIZE) || (BufferCount >= BUFFER_NEARLY_FULL) || !(LatencyTimerRemaining));
+		else
+		  SendBank = (ZLPPending && !(LatencyTimerRemaining));
+
+		/* The host only sees the end of a transfer once a packet shorter than the endpoint comes, so a transfer
+		 * ending on a full packet is ended by a Zero Length Packet (ZLP) once the latency timer expires again. The
+		 * ZLP is only sent once the bank is free, so the main loop is never held up waiting for the host */
+		if (SendBank)
+		{
+			Endpoint_ClearIN();
+
+			DeviceStats.BytesToHost += BytesInBank;
+			DeviceStats.INPackets++;
+
+			ZLPPending = (BytesInBank == CDC_TXRX_EPSIZE);
+		}
+	}
+
+	if (SendBank)
+	{
+		LatencyTimerRemaining = LatencyTimerMS;
+
+		if (BytesInBank)
+		  LEDs_PulseActivity(LEDMASK_TX, &TxLEDPulseMS);
+	}
+	else if (!(BytesInBank) && !(ZLPPending))
+	{
+		/* Nothing is waiting for the host, keep the latency timer primed for the next byte */
+		LatencyTimerRemaining = LatencyTimerMS;
+	}
+}
+
+#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+/** Updates the RTS/CTS flow control lines. RTS is asserted again once the host asserts its own RTS control line
+ *  and the USART receive buffer has drained down to \ref RTS_LOW_WATERMARK, the receive ISR deasserts it when
+ *  the buffer fills up. Transmission held back by a deasserted CTS is restarted once the target asserts it.
+ */
+static void FlowControl_Task(void)
+{
+	if (!(VirtualSerial_CDC_Interface.State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_RTS))
+	  FlowControl_SetRTS(false);
+	else if (USARTtoUSB_Buffer_GetCount() <= RTS_LOW_WATERMARK)
+	  FlowControl_SetRTS(true);
+
+	if (!(USBtoUSART_Buffer_IsEmpty()))
+	  USART_StartTransmit();
+}
+#endif
+
+/** Reports the line errors seen since the last call to the host, in a CDC SerialState notification. Errors are
+ *  gathered into a single notification at most every \ref CDC_NOTIFICATION_INTERVAL_MS, and only sent once the
+ *  host has collected the previous one, so this never waits on the host nor holds up the data endpoints.
+ */
+static void SerialState_Task(void)
+{
+	if (!(PendingSerialState) || SerialStateTimerRemaining)
+	  return;
+
+	/* Device must be connected and configured, and the host must have set a line encoding */
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS))
+	  return;
+
+	Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.NotificationEndpoint.Address);
+
+	if (!(Endpoint_IsINReady()))
+	  return;
+
+	uint8_t LineErrors;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		LineErrors         = PendingSerialState;
+		PendingSerialState = 0;
+	}
+
+	/* The error flags report events rather than a state, so they are only set for the one notification */
+	VirtualSerial_CDC_Interface.State.ControlLineStates.DeviceToHost = LineErrors;
+	CDC_Device_SendControlLineStateChange(&VirtualSerial_CDC_Interface);
+	VirtualSerial_CDC_Interface.State.ControlLineStates.DeviceToHost = 0;
+
+	SerialStateTimerRemaining = CDC_NOTIFICATION_INTERVAL_MS;
+}
+
+/** Discards the data buffered in both directions between the host and the target, after the target has been
+ *  reset. Stale bytes would otherwise reach the target's bootloader ahead of the host's first command, or the
+ *  host ahead of the bootloader's first reply, slowing down the upload handshake.
+ */
+static void Serial_FlushBuffers(void)
+{
+	/* The USART interrupts work on the other end of each buffer */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		#if defined(ENABLE_COMPOSITE_MODE)
+		if (mode == MODE_Composite)
+		{
+			/* The Arduino's decoder keeps its framing state over the flush, so the rest of a frame which has
+			 * started going out is kept, and the stream to the target is cut on a frame boundary. Frames are
+			 * queued whole, so a pending length byte and its MIDI bytes are all in the buffer already */
+			RingBuff_Count_t TxFrameRemaining = CompositeTxMIDIBytes;
+
+			if (CompositeTxEscaped)
+			  TxFrameRemaining = (1 + USBtoUSART_Buffer.Data[USBtoUSART_Buffer.Tail & (sizeof(USBtoUSART_Buffer.Data) - 1)]);
+
+			USBtoUSART_Buffer.Head = (USBtoUSART_Buffer.Tail + TxFrameRemaining);
+		}
+		else
+		#endif
+		{
+			USBtoUSART_Buffer_Init();
+		}
+
+		USARTtoUSB_Buffer_Init();
+
+		#if defined(ENABLE_COMPOSITE_MODE)
+		CompositeRxMIDIBytes = 0;
+		CompositeRxEscaped   = false;
+		#endif
+
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+		MIDI_TxStampHead = 0;
+		MIDI_TxStampTail = 0;
+		#endif
+
+		#if defined(ENABLE_MIDI_SOFT_THRU)
+		MIDIEventFIFO_Init(&USARTtoUSART_Events);
+		MIDI_TxSysExSource = MIDI_TX_SOURCE_None;
+		#endif
+
+		/* The first MIDI message to go out after the flush must carry its status byte */
+		mRunningStatus_TX   = InvalidType;
+		FlushBuffersPending = false;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MIDI Worker Functions
+///////////////////////////////////////////////////////////////////////////////
+
+// From Arduino/Serial to USB/Host 
+void MIDI_To_Host(void)
+{
+	// Device must be connected and configured for the task to run
+	if (USB_DeviceState != DEVICE_STATE_Configured) return;
+
+	// Select the MIDI IN stream
+	Endpoint_SelectEndpoint(MIDI_STREAM_IN_EPADDR);
+
+	if (Endpoint_IsINReady())
+	{
+		MIDI_EventPacket_t MIDIEvent;
+		uint8_t            EventsInPacket = 0;
+
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+		MIDI_Timestamp_t EventTimes[MIDI_EVENTS_PER_PACKET];
+		#endif
+
+		// Pack every pending event into the bank, up to a full packet. The packet is sent as soon as nothing
+		// more is pending, so a lone event goes out straight away and low event rates see no added latency
+		while (EventsInPacket < MIDI_EVENTS_PER_PACKET)
+		{
+			#if defined(ENABLE_MIDI_LATENCY_STATS)
+			// The event's timestamp slot can be reused as soon as the event is removed, so read it first
+			EventTimes[EventsInPacket] = USARTtoUSB_EventTimes[USARTtoUSB_Events.Tail & MIDI_EVENT_FIFO_MASK];
+			#endif
+
+			if (!(MIDIEventFIFO_Pop(&USARTtoUSB_Events, &MIDIEvent)))
+			  break;
+
+			// Write the MIDI event packet to the endpoint
+			Endpoint_Write_Stream_LE(&MIDIEvent, sizeof(MIDIEvent), NULL);
+
+			EventsInPacket++;
+		}
+
+		if (EventsInPacket)
+		{
+			// Send the data in the endpoint to the host
+			Endpoint_ClearIN();
+
+			#if defined(ENABLE_MIDI_LATENCY_STATS)
+			MIDI_Timestamp_t HandOffTime = MIDILatency_Stamp();
+
+			for (uint8_t i = 0; i < EventsInPacket; i++)
+			{
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					MIDILatency_Record(MIDILatencyStats.ToHost, MIDILatency_Elapsed(EventTimes[i], HandOffTime));
+				}
+			}
+			#endif
+
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				DeviceStats.BytesToHost += (EventsInPacket * sizeof(MIDI_EventPacket_t));
+				DeviceStats.INPackets++;
+
+				MIDIPackingStats.Events += EventsInPacket;
+				MIDIPackingStats.Packets++;
+			}
+
+			LEDs_PulseActivity(LEDMASK_TX, &TxLEDPulseMS);
+		}
+	}
+
+}
+
+/** Retrieves the room in \ref USBtoUSART_Buffer which must be free before a MIDI message is queued into it, so
+ *  that the message is never split.
+ *
+ *  \return Largest number of bytes a single queued MIDI message can take
+ */
+static inline uint8_t MIDI_MessageSpace(void)
+{
+	#if defined(ENABLE_COMPOSITE_MODE)
+	// On the shared USART each message also needs room for its frame header
+	if (mode == MODE_Composite)
+	  return 5;
+	#endif
+
+	return 3;
+}
+
+/** Queues the MIDI message carried by a USB-MIDI event into \ref USBtoUSART_Buffer for the Arduino. The caller
+ *  must check that \ref MIDI_MessageSpace() bytes are free in the buffer beforehand.
+ *
+ *  \param[in] MIDIEvent  Event whose message is to be sent to the Arduino
+ *  \param[in] Source     Where the event came from, one of the \ref MIDI_TxSources_t values
+ */
+static void MIDI_QueueMessage(const MIDI_EventPacket_t* const MIDIEvent,
+                              const uint8_t Source)
+{
+	// Passthrough to Arduino only the bytes which make up the message, as given by the Code Index Number
+	uint8_t        CIN        = (MIDIEvent->Event & 0x0F);
+	uint8_t        DataLength = pgm_read_byte(&MIDI_CINDataLength[CIN]);
+	const uint8_t* Data       = &MIDIEvent->Data1;
+
+	if ((CIN >= 0x08) && (CIN <= 0x0E))
+	{
+		#if !defined(NO_MIDI_TX_RUNNING_STATUS)
+		// After the host changes the setting, the status byte of the next channel message is always sent in full
+		if (MIDI_TX_RunningStatus != MIDI_TX_RunningStatusRequested)
+		{
+			MIDI_TX_RunningStatus = MIDI_TX_RunningStatusRequested;
+			mRunningStatus_TX     = InvalidType;
+		}
+
+		// Channel message: the status byte can be left out when it repeats the previous one
+		if (MIDI_TX_RunningStatus && (MIDIEvent->Data1 == mRunningStatus_TX))
+		{
+			Data++;
+			DataLength--;
+		}
+		#endif
+
+		mRunningStatus_TX = MIDIEvent->Data1;
+	}
+	else if (MIDIEvent->Data1 < Clock)
+	{
+		// System Common and SysEx data cancel the running status, interleaved Real Time messages do not
+		mRunningStatus_TX = InvalidType;
+	}
+
+	#if defined(ENABLE_MIDI_SOFT_THRU)
+	// Keep track of whose System Exclusive message is going out, as it must not be cut by the other source's
+	// message. Packets with CIN 0x5 to 0x7 end one, even when they also start it (SysEx of up to three bytes),
+	// so are checked before a CIN 0x4 start or continuation
+	if ((CIN >= 0x05) && (CIN <= 0x07))
+	  MIDI_TxSysExSource = MIDI_TX_SOURCE_None;
+	else if (CIN == 0x04)
+	  MIDI_TxSysExSource = Source;
+	else if ((MIDIEvent->Data1 & 0x80) && (MIDIEvent->Data1 < Clock))
+	  MIDI_TxSysExSource = MIDI_TX_SOURCE_None;
+	#endif
+
+	#if defined(ENABLE_COMPOSITE_MODE)
+	// Frame the message so the Arduino can tell it apart from the serial data
+	if ((mode == MODE_Composite) && DataLength)
+	{
+		USBtoUSART_Buffer_Insert(COMPOSITE_FRAME_ESCAPE);
+		USBtoUSART_Buffer_Insert(DataLength);
+	}
+	#endif
+
+	#if defined(ENABLE_MIDI_LATENCY_STATS)
+	uint8_t TxStampHead = MIDI_TxStampHead;
+
+	// Track the host's message until its last byte leaves, if there is a free slot for it. The slot can be handed
+	// to the transmit interrupt straight away, as the buffer's tail cannot pass the message's end before it is in
+	if ((Source == MIDI_TX_SOURCE_Host) && DataLength &&
+	    ((uint8_t)(TxStampHead - MIDI_TxStampTail) < MIDI_LATENCY_TX_STAMPS))
+	{
+		MIDI_TxStampTimes[TxStampHead & (MIDI_LATENCY_TX_STAMPS - 1)] = MIDI_OUTBankTime;
+		MIDI_TxStampEnds[TxStampHead & (MIDI_LATENCY_TX_STAMPS - 1)]  = (USBtoUSART_Buffer.Head + DataLength);
+
+		MIDI_TxStampHead = (TxStampHead + 1);
+	}
+	#endif
+
+	while (DataLength--)
+	  USBtoUSART_Buffer_Insert(*(Data++));
+}
+
+#if defined(ENABLE_MIDI_SOFT_THRU)
+/** Moves the MIDI events echoed by the soft-thru into the USART transmit buffer, merging them into the stream of
+ *  messages from the host a whole message at a time. Real Time messages may go in between the parts of a System
+ *  Exclusive message from the host, anything else waits for it to end along with the events queued behind it.
+ */
+static void MIDI_SoftThru_Task(void)
+{
+	MIDI_EventPacket_t MIDIEvent;
+	uint8_t            EventsQueued = 0;
+	uint8_t            MessageSpace = MIDI_MessageSpace();
+
+	while ((USBtoUSART_Buffer_GetFreeCount() >= MessageSpace) &&
+	       MIDIEventFIFO_Peek(&USARTtoUSART_Events, &MIDIEvent))
+	{
+		bool RealTime = (((MIDIEvent.Event & 0x0F) == 0x0F) && (MIDIEvent.Data1 >= Clock));
+
+		if ((MIDI_TxSysExSource == MIDI_TX_SOURCE_Host) && !(RealTime))
+		  break;
+
+		MIDIEventFIFO_Pop(&USARTtoUSART_Events, &MIDIEvent);
+		MIDI_QueueMessage(&MIDIEvent, MIDI_TX_SOURCE_Thru);
+
+		EventsQueued++;
+	}
+
+	/* Once turned off, the rest of an echoed System Exclusive message will never come, so stop waiting for it */
+	if (!(MIDI_SoftThru) && (MIDI_TxSysExSource == MIDI_TX_SOURCE_Thru) &&
+	    !(MIDIEventFIFO_GetCount(&USARTtoUSART_Events)))
+	{
+		MIDI_TxSysExSource = MIDI_TX_SOURCE_None;
+	}
+
+	if (EventsQueued)
+	{
+		DeviceStats_UpdateHighWater(&DeviceStats.USBtoUSARTHighWater, USBtoUSART_Buffer_GetCount());
+
+		// The USART transmit interrupt sends the queued bytes in the background
+		USART_StartTransmit();
+	}
+}
+#endif
+
+// From USB/Host to Arduino/Serial
+void MIDI_To_Arduino(void)
+{
+	// Device must be connected and configured for the task to run
+	if (USB_DeviceState != DEVICE_STATE_Configured) return;
+
+	// Select the MIDI OUT stream
+	Endpoint_SelectEndpoint(MIDI_STREAM_OUT_EPADDR);
+
+	/* Check if a MIDI command has been received */
+	if (!(Endpoint_IsOUTReceived()))
+	  return;
+
+	#if defined(ENABLE_MIDI_LATENCY_STATS)
+	// A bank can take several passes to move across, the latency of its events starts when it is first seen
+	if (!(MIDI_OUTBankTimed))
+	{
+		MIDI_OUTBankTime  = MIDILatency_Stamp();
+		MIDI_OUTBankTimed = true;
+	}
+	#endif
+
+	uint8_t EventsQueued = 0;
+	uint8_t MessageSpace = MIDI_MessageSpace();
+
+	// Work through every event in the bank for as long as the USART transmit buffer can take a whole
+	// message, the rest stays in the bank until the USART has caught up so the USB side never blocks
+	while ((Endpoint_BytesInEndpoint() >= sizeof(MIDI_EventPacket_t)) &&
+	       (USBtoUSART_Buffer_GetFreeCount() >= MessageSpace))
+	{
+		#if defined(ENABLE_MIDI_SOFT_THRU)
+		/* A System Exclusive message echoed by the soft-thru has to end before the host's next message goes in */
+		if (MIDI_TxSysExSource == MIDI_TX_SOURCE_Thru)
+		  break;
+		#endif
+
+		MIDI_EventPacket_t MIDIEvent;
+
+		/* Read the MIDI event packet from the endpoint */
+		Endpoint_Read_Stream_LE(&MIDIEvent, sizeof(MIDIEvent), NULL);
+
+		MIDI_QueueMessage(&MIDIEvent, MIDI_TX_SOURCE_Host);
+
+		EventsQueued++;
+	}
+
+	if (EventsQueued)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			DeviceStats.BytesFromHost += (EventsQueued * sizeof(MIDI_EventPacket_t));
+		}
+
+		DeviceStats_UpdateHighWater(&DeviceStats.USBtoUSARTHighWater, USBtoUSART_Buffer_GetCount());
+
+		// The USART transmit interrupt sends the queued bytes in the background
+		USART_StartTransmit();
+
+		LEDs_PulseActivity(LEDMASK_RX, &RxLEDPulseMS);
+	}
+
+	/* If the endpoint is now empty (or only holds a truncated event), clear the bank */
+	if (Endpoint_BytesInEndpoint() < sizeof(MIDI_EventPacket_t))
+	{
+		/* Clear the endpoint ready for new packet */
+		Endpoint_ClearOUT();
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			DeviceStats.OUTPackets++;
+		}
+
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+		MIDI_OUTBankTimed = false;
+		#endif
+	}
+}
+
+/** ISR for the millisecond tick of Timer 0, counting down the latency timer and returning the activity LEDs to their
+ *  status once their pulse has run out. Keeping these in a timer makes their timing independent of the main loop speed.
+ */
+ISR(TIMER0_COMPA_vect, ISR_BLOCK)
+{
+	TimestampMS++;
+
+	if (LatencyTimerRemaining)
+	  LatencyTimerRemaining--;
+
+	if (SerialStateTimerRemaining)
+	  SerialStateTimerRemaining--;
+
+	if (TargetResetRemaining && !(--TargetResetRemaining))
+	  AVR_RESET_LINE_PORT |= AVR_RESET_LINE_MASK;
+
+	if (TxLEDPulseMS && !(--TxLEDPulseMS))
+	  LEDs_RestoreStatus(LEDMASK_TX);
+
+	if (RxLEDPulseMS && !(--RxLEDPulseMS))
+	  LEDs_RestoreStatus(LEDMASK_RX);
+}
 
-/** Underlying data buffer for \ref USBtoUSART_Buffer, where the stored bytes are located. */
-static uint8_t      USBtoUSART_Buffer_Data[128];
+#if defined(ENABLE_MIDI_CLOCK_PLL)
+/** ISR for Timer 1 reaching the period of the regenerated MIDI clock, sending the next clock while the PLL is
+ *  locked. The PLL unlocks once it has run \ref MIDI_CLOCK_HOLDOVER clocks ahead of the received ones.
+ */
+ISR(TIMER1_COMPA_vect, ISR_BLOCK)
+{
+	if (MIDIClock_Balance <= -MIDI_CLOCK_HOLDOVER)
+	{
+		MIDIClock_StopPLL();
+		return;
+	}
 
-/** Circular buffer to hold data from the serial port before it is sent to the host. */
-static RingBuffer_t USARTtoUSB_Buffer;
+	MIDIClock_Balance--;
+	MIDIClock_Send();
 
-/** Underlying data buffer for \ref USARTtoUSB_Buffer, where the stored bytes are located. */
-static uint8_t      USARTtoUSB_Buffer_Data[128];
+	/* Any phase correction only applied to the clock just sent */
+	OCR1A = (MIDIClock_Period - 1);
+}
+#endif
 
-/** LUFA CDC Class driver interface configuration and state information. This structure is
- *  passed to all CDC Class driver functions, so that multiple instances of the same class
- *  within a device can be differentiated from one another.
+/** Writes a byte received from the serial port straight into the CDC data IN endpoint bank, skipping
+ *  \ref USARTtoUSB_Buffer while the host keeps up. This is only done while the buffer is empty, so that bytes
+ *  reach the host in the order they were received, and never beyond a full bank, which \ref Serial_To_Host() then
+ *  sends.
+ *
+ *  \param[in] ReceivedByte  Byte received from the serial port
+ *
+ *  \return Boolean \c true if the byte was written to the bank, \c false if it must go through the buffer
  */
-USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
+static inline bool USART_WriteToINBank(const uint8_t ReceivedByte)
+{
+	if (!(USARTtoUSB_Buffer_IsEmpty()))
+	  return false;
+
+	/* The interrupted code may be working on any endpoint, which must be selected again afterwards */
+	uint8_t PreviousEndpoint = Endpoint_GetCurrentEndpoint();
+	bool    Written          = false;
+
+	Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.DataINEndpoint.Address);
+
+	if (Endpoint_IsINReady() && (Endpoint_BytesInEndpoint() < CDC_TXRX_EPSIZE))
 	{
-		.Config =
-			{
-				.ControlInterfaceNumber         = INTERFACE_ID_CDC_CCI,
-				.DataINEndpoint                 =
-					{
-						.Address                = CDC_TX_EPADDR,
-						.Size                   = CDC_TXRX_EPSIZE,
-						.Banks                  = 1,
-					},
-				.DataOUTEndpoint                =
-					{
-						.Address                = CDC_RX_EPADDR,
-						.Size                   = CDC_TXRX_EPSIZE,
-						.Banks                  = 1,
-					},
-				.NotificationEndpoint           =
-					{
-						.Address                = CDC_NOTIFICATION_EPADDR,
-						.Size                   = CDC_NOTIFICATION_EPSIZE,
-						.Banks                  = 1,
-					},
-			},
-	};
+		Endpoint_Write_8(ReceivedByte);
+		Written = true;
+	}
 
+	Endpoint_SelectEndpoint(PreviousEndpoint);
 
-/** Main program entry point. This routine contains the overall program flow, including initial
- *  setup of all components and the main program loop.
+	return Written;
+}
+
+/** Hands a byte received from the serial port to the CDC interface, writing it straight into the IN endpoint
+ *  bank when possible and into \ref USARTtoUSB_Buffer otherwise, or counts it as dropped if the buffer is full.
+ *
+ *  \param[in] ReceivedByte  Byte received from the serial port
  */
-int main(void)
+static inline void USART_ReceiveSerialByte(const uint8_t ReceivedByte)
 {
-	SetupHardware();
-	
-	if(mode == 0){
-		RingBuffer_InitBuffer(&USBtoUSART_Buffer, USBtoUSART_Buffer_Data, sizeof(USBtoUSART_Buffer_Data));
-		RingBuffer_InitBuffer(&USARTtoUSB_Buffer, USARTtoUSB_Buffer_Data, sizeof(USARTtoUSB_Buffer_Data));
+	if (USART_WriteToINBank(ReceivedByte))
+	  return;
 
-		LEDs_SetAllLEDs(LEDMASK_USB_NOTREADY);
-		GlobalInterruptEnable();
+	if (!(USARTtoUSB_Buffer_IsFull()))
+	{
+		USARTtoUSB_Buffer_Insert(ReceivedByte);
 
-		for (;;)
-		{
-			/* Only try to read in bytes from the CDC interface if the transmit buffer is not full */
-			if (!(RingBuffer_IsFull(&USBtoUSART_Buffer)))
-			{
-				int16_t ReceivedByte = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
+		DeviceStats_UpdateHighWater(&DeviceStats.USARTtoUSBHighWater, USARTtoUSB_Buffer_GetCount());
 
-				/* Store received byte into the USART transmit buffer */
-				if (!(ReceivedByte < 0))
-				  RingBuffer_Insert(&USBtoUSART_Buffer, ReceivedByte);
-			}
+		#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+		/* Ask the target to pause while there is still room for the bytes it sends before reacting */
+		if (USARTtoUSB_Buffer_GetCount() >= RTS_HIGH_WATERMARK)
+		  FlowControl_SetRTS(false);
+		#endif
+	}
+	else
+	{
+		/* Bytes lost to a full buffer are reported to the host as an overrun, like those lost in the USART */
+		DeviceStats.DroppedBytes++;
+		PendingSerialState |= CDC_CONTROL_LINE_IN_OVERRUNERROR;
+	}
+}
 
-			uint16_t BufferCount = RingBuffer_GetCount(&USARTtoUSB_Buffer);
-			if (BufferCount)
-			{
-				Endpoint_SelectEndpoint(VirtualSerial_CDC_Interface.Config.DataINEndpoint.Address);
+#if defined(ENABLE_MIDI_CLOCK_PLL)
+/** Stops regenerating the MIDI clock, until the PLL locks onto the received clock again. */
+static void MIDIClock_StopPLL(void)
+{
+	TIMSK1 = 0;
+	TCCR1B = 0;
 
-				/* Check if a packet is already enqueued to the host - if so, we shouldn't try to send more data
-				 * until it completes as there is a chance nothing is listening and a lengthy timeout could occur */
-				if (Endpoint_IsINReady())
-				{
-					/* Never send more than one bank size less one byte to the host at a time, so that we don't block
-					 * while a Zero Length Packet (ZLP) to terminate the transfer is sent if the host isn't listening */
-					uint8_t BytesToSend = MIN(BufferCount, (CDC_TXRX_EPSIZE - 1));
+	MIDIClock_Locked = false;
+}
 
-					/* Read bytes from the USART receive buffer into the USB IN endpoint */
-					while (BytesToSend--)
-					{
-						/* Try to send the next byte of data to the host, abort if there is an error without dequeuing */
-						if (CDC_Device_SendByte(&VirtualSerial_CDC_Interface,
-												RingBuffer_Peek(&USARTtoUSB_Buffer)) != ENDPOINT_READYWAIT_NoError)
-						{
-							break;
-						}
-
-						/* Dequeue the already sent byte from the buffer now we have confirmed that no transmission error occurred */
-						RingBuffer_Remove(&USARTtoUSB_Buffer);
-					}
-				}
-			}
+/** Sends a regenerated MIDI clock to the host, and to the serial port if enabled in MIDI mode. Being a Real Time
+ *  message it goes straight into the USART when it is free, or ahead of any other byte queued for it otherwise.
+ *  Must be called with interrupts disabled.
+ */
+static void MIDIClock_Send(void)
+{
+	if (USB_DeviceState == DEVICE_STATE_Configured)
+	{
+		MIDI_EventPacket_t ClockEvent = { .Event = MIDI_EVENT(0, Clock), .Data1 = Clock };
 
-			/* Load the next byte from the USART transmit buffer into the USART if transmit buffer space is available */
-			if (Serial_IsSendReady() && !(RingBuffer_IsEmpty(&USBtoUSART_Buffer)))
-			  Serial_SendByte(RingBuffer_Remove(&USBtoUSART_Buffer));
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+		uint8_t Head = USARTtoUSB_Events.Head;
 
-			CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
-			USB_USBTask();
+		if (MIDIEventFIFO_Push(&USARTtoUSB_Events, &ClockEvent))
+		  USARTtoUSB_EventTimes[Head & MIDI_EVENT_FIFO_MASK] = MIDILatency_Stamp();
+		#else
+		MIDIEventFIFO_Push(&USARTtoUSB_Events, &ClockEvent);
+		#endif
+	}
+
+	if ((MIDIClock_Mode & MIDI_CLOCK_MODE_ToSerial) && (mode == MODE_MIDI))
+	{
+		if (UCSR1A & (1 << UDRE1))
+		{
+			UDR1 = Clock;
+		}
+		else
+		{
+			MIDIClock_TxPending = true;
+			UCSR1B |= (1 << UDRIE1);
 		}
-	} else if (mode == 1){
-		GlobalInterruptEnable();
+	}
+}
+
+/** Keeps the clock PLL locked onto a MIDI clock just received from the serial port. The regenerated clock follows
+ *  the averaged interval of the received one, and each received clock pulls its phase a little towards itself.
+ *
+ *  \return Boolean \c true if the received clock is replaced by the regenerated ones, \c false if it is to be passed on
+ */
+static inline bool MIDIClock_TrackPLL(void)
+{
+	if (!(MIDIClock_Mode & MIDI_CLOCK_MODE_Regenerate))
+	  return false;
 
-		sei();
+	uint16_t Period = (MIDIClock_IntervalAverage >> MIDI_CLOCK_AVERAGE_SHIFT);
 
-		for (;;)
+	if (!(MIDIClock_Locked))
+	{
+		if (MIDIClock_Balance < 0)
 		{
-			if (tx_ticks > 0) 
-			{
-				tx_ticks--;
-			}
-			else if (tx_ticks == 0)
-			{
-				LEDs_TurnOffLEDs(LEDS_LED2);
-			}
-										
-			if (rx_ticks > 0)
-			{
-				rx_ticks--;
-			}
-			else if (rx_ticks == 0)
-			{
-				LEDs_TurnOffLEDs(LEDS_LED1);
-			}
-				
-			MIDI_To_Arduino();
-			MIDI_To_Host();
+			/* The PLL unlocked after sending this clock ahead of time, it must not go out twice */
+			MIDIClock_Balance++;
+			return true;
+		}
+
+		if (MIDIClock_Run <= MIDI_CLOCK_LOCK_INTERVALS)
+		  return false;
+
+		/* Start the regenerated clock in phase with this one, which is still passed on as it is. Timer 1 counts in
+		 * the same 4us ticks as the timestamps */
+		MIDIClock_Period  = Period;
+		MIDIClock_Balance = 0;
+		MIDIClock_Locked  = true;
+
+		TCNT1  = 0;
+		OCR1A  = (Period - 1);
+		TIFR1  = (1 << OCF1A);
+		TIMSK1 = (1 << OCIE1A);
+		TCCR1B = ((1 << WGM12) | (1 << CS11) | (1 << CS10));
+
+		return false;
+	}
 
-			USB_USBTask();
+	uint16_t Elapsed = TCNT1;
+	uint32_t Top;
+
+	MIDIClock_Period = Period;
+
+	if (++MIDIClock_Balance <= 0)
+	{
+		/* The regenerated clock went out first, so delay the next one */
+		Top = (Period + (Elapsed >> MIDI_CLOCK_PHASE_SHIFT));
+	}
+	else
+	{
+		/* Lagging behind by a whole clock, catch up straight away */
+		if (MIDIClock_Balance > 1)
+		{
+			MIDIClock_Send();
+			MIDIClock_Balance--;
 		}
+
+		/* The regenerated clock is still to come, so bring it forward */
+		Top = (Elapsed < Period) ? (Period - ((Period - Elapsed) >> MIDI_CLOCK_PHASE_SHIFT)) : Period;
 	}
+
+	/* The new compare value must stay ahead of the count, or the timer would run on until it wraps */
+	if (Top < (Elapsed + 4UL))
+	  Top = (Elapsed + 4UL);
+	else if (Top > UINT16_MAX)
+	  Top = UINT16_MAX;
+
+	OCR1A = (Top - 1);
+	return true;
 }
+#endif
 
-/** Configures the board hardware and chip peripherals for the demo's functionality. */
-void SetupHardware(void)
+#if defined(ENABLE_MIDI_CLOCK_STATS)
+/** Measures the interval from the previous MIDI clock received from the serial port, and hands the clock on to the
+ *  PLL if it is built in. Transport messages restart the PLL, so that the first clock after them is passed on as
+ *  it comes.
+ *
+ *  \param[in] ReceivedByte  MIDI clock or transport Real Time message received from the serial port
+ *
+ *  \return Boolean \c true if the message is replaced by the regenerated clocks, \c false if it is to be passed on
+ */
+static inline bool MIDIClock_Receive(const uint8_t ReceivedByte)
 {
-	DDRB = 0x00;
-	PORTB = 0x04;
-	
-	if ((PINB & 0x04) == 1){
-		mode = 1;
-	} else if ((PINB & 0x04) == 0){
-		mode = 0;
-	}
-	
-	if(mode == 0){
-		#if (ARCH == ARCH_AVR8)
-			/* Disable watchdog if enabled by bootloader/fuses */
-			MCUSR &= ~(1 << WDRF);
-			wdt_disable();
-
-			/* Disable clock division */
-			clock_prescale_set(clock_div_1);
+	if (ReceivedByte != Clock)
+	{
+		#if defined(ENABLE_MIDI_CLOCK_PLL)
+		MIDIClock_StopPLL();
+		MIDIClock_Balance = 0;
 		#endif
 
-		/* Hardware Initialization */
-		LEDs_Init();
-		USB_Init();
-	} else if (mode == 1){
-		// Disable watchdog if enabled by bootloader/fuses
-		MCUSR &= ~(1 << WDRF);
-		wdt_disable();
+		return false;
+	}
 
-		Serial_Init(31250, false);
+	uint16_t Now   = Timestamp_Now();
+	uint16_t NowMS = TimestampMS;
 
-		// Start the flush timer so that overflows occur rapidly to
-		// push received bytes to the USB interface
-		TCCR0B = (1 << CS02);
-				
-		// Serial Interrupts
-		UCSR1B = 0;
-		UCSR1B = ((1 << RXCIE1) | (1 << TXEN1) | (1 << RXEN1));
+	if (MIDIClock_Run && ((uint16_t)(NowMS - MIDIClock_LastMS) < MIDI_CLOCK_MAX_INTERVAL_MS))
+	{
+		uint16_t Interval = (Now - MIDIClock_LastTime);
 
-		// https://github.com/ddiakopoulos/hiduino/issues/13
-		/* Target /ERASE line is active HIGH: there is a mosfet that inverts logic */
-		// These are defined in the makefile... 
-		AVR_ERASE_LINE_PORT |= AVR_ERASE_LINE_MASK;
-		AVR_ERASE_LINE_DDR |= AVR_ERASE_LINE_MASK; 
+		if (MIDIClock_Run == 1)
+		{
+			/* First interval of a new run, the averages start from it */
+			MIDIClock_IntervalAverage = ((uint32_t)Interval << MIDI_CLOCK_AVERAGE_SHIFT);
+			MIDIClock_JitterAverage   = 0;
+		}
+		else
+		{
+			uint16_t Average   = (MIDIClock_IntervalAverage >> MIDI_CLOCK_AVERAGE_SHIFT);
+			uint16_t Deviation = (Interval > Average) ? (Interval - Average) : (Average - Interval);
 
-		// Disable clock division
-		clock_prescale_set(clock_div_1);
+			MIDIClock_IntervalAverage = (MIDIClock_IntervalAverage - Average + Interval);
+			MIDIClock_JitterAverage   = (MIDIClock_JitterAverage - (MIDIClock_JitterAverage >> MIDI_CLOCK_AVERAGE_SHIFT) +
+			                             Deviation);
+		}
 
-		LEDs_Init();
-		USB_Init();
+		if (Interval < MIDIClockStats.MinInterval)
+		  MIDIClockStats.MinInterval = Interval;
+
+		if (Interval > MIDIClockStats.MaxInterval)
+		  MIDIClockStats.MaxInterval = Interval;
+
+		if (MIDIClockStats.Intervals != UINT16_MAX)
+		  MIDIClockStats.Intervals++;
+
+		if (MIDIClock_Run != UINT8_MAX)
+		  MIDIClock_Run++;
+	}
+	else
+	{
+		MIDIClock_Run = 1;
 	}
-}
 
-/** Event handler for the library USB Connection event. */
-void EVENT_USB_Device_Connect(void)
-{
-	LEDs_SetAllLEDs(LEDMASK_USB_ENUMERATING);
+	MIDIClock_LastTime = Now;
+	MIDIClock_LastMS   = NowMS;
+
+	#if defined(ENABLE_MIDI_CLOCK_PLL)
+	return MIDIClock_TrackPLL();
+	#else
+	return false;
+	#endif
 }
+#endif
 
-/** Event handler for the library USB Disconnection event. */
-void EVENT_USB_Device_Disconnect(void)
+/** Parses a MIDI byte received from the serial port into \ref USARTtoUSB_Events while the host is there to take
+ *  them, timestamping any event it completes for the latency statistics. The soft-thru is fed from the parser as
+ *  well, so that it carries on whether or not the host keeps up or is there at all.
+ *
+ *  \param[in] ReceivedByte  Byte received from the serial port
+ */
+static inline void USART_ReceiveMIDIByte(const uint8_t ReceivedByte)
 {
-	LEDs_SetAllLEDs(LEDMASK_USB_NOTREADY);
+	#if defined(ENABLE_MIDI_CLOCK_STATS)
+	/* Clocks are timed as soon as they arrive, and dropped while the PLL regenerates them */
+	if ((ReceivedByte == Clock) || ((ReceivedByte >= Start) && (ReceivedByte <= Stop)))
+	{
+		if (MIDIClock_Receive(ReceivedByte))
+		  return;
+	}
+	#endif
+
+	MIDIEventFIFO_t* HostEvents = NULL;
+	MIDIEventFIFO_t* ThruEvents = NULL;
+
+	if (USB_DeviceState == DEVICE_STATE_Configured)
+	  HostEvents = &USARTtoUSB_Events;
+
+	#if defined(ENABLE_MIDI_SOFT_THRU)
+	/* Echo the events back to the serial port as well, without a round trip through the host */
+	if (MIDI_SoftThru)
+	  ThruEvents = &USARTtoUSART_Events;
+	#endif
+
+	#if defined(ENABLE_MIDI_LATENCY_STATS)
+	uint8_t Head = USARTtoUSB_Events.Head;
+	#endif
+
+	MIDIParser_ProcessByte(&USARTtoUSB_Parser, HostEvents, ThruEvents, ReceivedByte);
+
+	#if defined(ENABLE_MIDI_LATENCY_STATS)
+	/* The main loop cannot remove the new events before this ISR returns, so they can be stamped after the fact */
+	if (Head != USARTtoUSB_Events.Head)
+	{
+		MIDI_Timestamp_t Now = MIDILatency_Stamp();
+
+		do
+		{
+			USARTtoUSB_EventTimes[Head & MIDI_EVENT_FIFO_MASK] = Now;
+		}
+		while (++Head != USARTtoUSB_Events.Head);
+	}
+	#endif
 }
 
-/** Event handler for the library USB Configuration Changed event. */
-void EVENT_USB_Device_ConfigurationChanged(void)
+#if defined(ENABLE_COMPOSITE_MODE)
+/** Splits the byte stream received from the serial port in composite mode between the CDC and MIDI interfaces.
+ *  Bytes are serial data, except for frames made of \ref COMPOSITE_FRAME_ESCAPE followed by a length: a zero
+ *  length stands for a literal escape byte of serial data, otherwise that many MIDI bytes follow.
+ *
+ *  \param[in] ReceivedByte  Byte received from the serial port
+ */
+static inline void Composite_ReceiveByte(const uint8_t ReceivedByte)
 {
-	bool ConfigSuccess = true;
-	if (mode == 0){
-		/* Setup Serial Data Endpoints */
-		ConfigSuccess &= CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
-	} else if (mode == 1){
-		/* Setup MIDI Data Endpoints */
-		ConfigSuccess &= Endpoint_ConfigureEndpoint(MIDI_STREAM_IN_EPADDR, EP_TYPE_BULK, MIDI_STREAM_EPSIZE, 1);
-		ConfigSuccess &= Endpoint_ConfigureEndpoint(MIDI_STREAM_OUT_EPADDR, EP_TYPE_BULK, MIDI_STREAM_EPSIZE, 1);
+	if (CompositeRxMIDIBytes)
+	{
+		CompositeRxMIDIBytes--;
+		USART_ReceiveMIDIByte(ReceivedByte);
+		return;
+	}
+
+	if (CompositeRxEscaped)
+	{
+		CompositeRxEscaped = false;
+
+		if (ReceivedByte)
+		  CompositeRxMIDIBytes = ReceivedByte;
+		else
+		  USART_ReceiveSerialByte(COMPOSITE_FRAME_ESCAPE);
+
+		return;
+	}
+	else if (ReceivedByte == COMPOSITE_FRAME_ESCAPE)
+	{
+		CompositeRxEscaped = true;
+		return;
 	}
 
-	LEDs_SetAllLEDs(ConfigSuccess ? LEDMASK_USB_READY : LEDMASK_USB_ERROR);
+	USART_ReceiveSerialByte(ReceivedByte);
 }
+#endif
 
-/** Event handler for the library USB Control Request reception event. */
-void EVENT_USB_Device_ControlRequest(void)
+#if defined(ENABLE_COMPOSITE_MODE)
+/** Follows the composite mode framing of the byte stream transmitted to the serial port, so that the transmit
+ *  buffer can later be cut on a frame boundary. This mirrors the decoding done by \ref Composite_ReceiveByte().
+ *
+ *  \param[in] SentByte  Byte loaded into the USART
+ */
+static inline void Composite_TransmitByte(const uint8_t SentByte)
 {
-	CDC_Device_ProcessControlRequest(&VirtualSerial_CDC_Interface);
+	if (CompositeTxMIDIBytes)
+	{
+		CompositeTxMIDIBytes--;
+	}
+	else if (CompositeTxEscaped)
+	{
+		CompositeTxEscaped   = false;
+		CompositeTxMIDIBytes = SentByte;
+	}
+	else if (SentByte == COMPOSITE_FRAME_ESCAPE)
+	{
+		CompositeTxEscaped = true;
+	}
 }
+#endif
 
-///////////////////////////////////////////////////////////////////////////////
-// MIDI Worker Functions
-///////////////////////////////////////////////////////////////////////////////
-
-// From Arduino/Serial to USB/Host 
-void MIDI_To_Host(void)
+/** ISR to manage the reception of data from the serial port, placing received bytes into a circular buffer
+ *  (serial mode) or parsing them into MIDI events (MIDI mode) for later transmission to the host. In composite
+ *  mode the received stream is split between the two.
+ */
+ISR(USART1_RX_vect, ISR_BLOCK)
 {
-	// Device must be connected and configured for the task to run
-	if (USB_DeviceState != DEVICE_STATE_Configured) return;
+	PROFILE_START(ISRStart);
 
-	// Select the MIDI IN stream
-	Endpoint_SelectEndpoint(MIDI_STREAM_IN_EPADDR);
+	/* The error flags belong to the received byte, so must be read before it is taken from UDR1 */
+	uint8_t LineStatus   = UCSR1A;
+	uint8_t ReceivedByte = UDR1;
 
-	if (Endpoint_IsINReady())
+	if (LineStatus & ((1 << DOR1) | (1 << FE1) | (1 << UPE1)))
 	{
-		if (mPendingMessageValid == true)
+		if (LineStatus & (1 << DOR1))
 		{
-			mPendingMessageValid = false;
+			DeviceStats.OverrunErrors++;
+			PendingSerialState |= CDC_CONTROL_LINE_IN_OVERRUNERROR;
+		}
 
-			// Write the MIDI event packet to the endpoint
-			Endpoint_Write_Stream_LE(&mCompleteMessage, sizeof(mCompleteMessage), NULL);
+		if (LineStatus & (1 << FE1))
+		{
+			DeviceStats.FramingErrors++;
+			PendingSerialState |= CDC_CONTROL_LINE_IN_FRAMEERROR;
+		}
 
-			// Clear out complete message
-			memset(&mCompleteMessage, 0, sizeof(mCompleteMessage)); 
+		if (LineStatus & (1 << UPE1))
+		{
+			DeviceStats.ParityErrors++;
+			PendingSerialState |= CDC_CONTROL_LINE_IN_PARITYERROR;
+		}
+	}
 
-			// Send the data in the endpoint to the host
-			Endpoint_ClearIN();
+	if (USB_DeviceState != DEVICE_STATE_Configured)
+	{
+		DeviceStats.DroppedBytes++;
 
-			LEDs_TurnOnLEDs(LEDS_LED2);
-			tx_ticks = TICK_COUNT; 
-		}
+		#if defined(ENABLE_MIDI_SOFT_THRU)
+		/* The soft-thru does not need the host, so keeps echoing the MIDI stream without one */
+		if ((mode == MODE_MIDI) && MIDI_SoftThru)
+		  USART_ReceiveMIDIByte(ReceivedByte);
+		#endif
 	}
+	else if(mode == MODE_Serial){
+		USART_ReceiveSerialByte(ReceivedByte);
+	} else if (mode == MODE_MIDI){
+		USART_ReceiveMIDIByte(ReceivedByte);
+	}
+	#if defined(ENABLE_COMPOSITE_MODE)
+	else if (mode == MODE_Composite){
+		Composite_ReceiveByte(ReceivedByte);
+	}
+	#endif
 
+	PROFILE_END(ISRStart, ProfilingStats.RXISRMaxCycles);
 }
 
-// From USB/Host to Arduino/Serial
-void MIDI_To_Arduino(void)
+/** ISR to feed the USART from \ref USBtoUSART_Buffer each time its data register empties, so that bytes from the
+ *  host leave back-to-back at the full line rate instead of at most once per main loop iteration.
+ */
+ISR(USART1_UDRE_vect, ISR_BLOCK)
 {
-	// Device must be connected and configured for the task to run
-	if (USB_DeviceState != DEVICE_STATE_Configured) return;
+	PROFILE_START(ISRStart);
 
-	// Select the MIDI OUT stream
-	Endpoint_SelectEndpoint(MIDI_STREAM_OUT_EPADDR);
+	bool TargetReady = true;
 
-	/* Check if a MIDI command has been received */
-	if (Endpoint_IsOUTReceived())
+	#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+	TargetReady = FlowControl_IsCTSAsserted();
+	#endif
+
+	#if defined(ENABLE_MIDI_CLOCK_PLL)
+	/* A regenerated MIDI clock goes ahead of the queued bytes, as Real Time messages may go in between others */
+	if (MIDIClock_TxPending)
 	{
-		MIDI_EventPacket_t MIDIEvent;
+		UDR1 = Clock;
+		MIDIClock_TxPending = false;
+	}
+	else
+	#endif
+	if (TargetReady && !(USBtoUSART_Buffer_IsEmpty()))
+	{
+		uint8_t SentByte = USBtoUSART_Buffer_Remove();
 
-		/* Read the MIDI event packet from the endpoint */
-		Endpoint_Read_Stream_LE(&MIDIEvent, sizeof(MIDIEvent), NULL);
+		UDR1 = SentByte;
 
-		// Passthrough to Arduino
-		Serial_SendByte(MIDIEvent.Data1);
-		Serial_SendByte(MIDIEvent.Data2); 
-		Serial_SendByte(MIDIEvent.Data3); 
+		#if defined(ENABLE_COMPOSITE_MODE)
+		if (mode == MODE_Composite)
+		  Composite_TransmitByte(SentByte);
+		#endif
 
-		LEDs_TurnOnLEDs(LEDS_LED1);
-		rx_ticks = TICK_COUNT;
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+		uint8_t TxStampTail = MIDI_TxStampTail;
 
-		/* If the endpoint is now empty, clear the bank */
-		if (!(Endpoint_BytesInEndpoint()))
+		/* A tracked MIDI message is handed off once its last byte is loaded into the USART */
+		if ((TxStampTail != MIDI_TxStampHead) &&
+		    (USBtoUSART_Buffer.Tail == MIDI_TxStampEnds[TxStampTail & (MIDI_LATENCY_TX_STAMPS - 1)]))
 		{
-			/* Clear the endpoint ready for new packet */
-			Endpoint_ClearOUT();
+			MIDILatency_Record(MIDILatencyStats.ToArduino,
+			                   MIDILatency_Elapsed(MIDI_TxStampTimes[TxStampTail & (MIDI_LATENCY_TX_STAMPS - 1)],
+			                                       MIDILatency_Stamp()));
+
+			MIDI_TxStampTail = (TxStampTail + 1);
 		}
+		#endif
 	}
 
-}
-
-/** ISR to manage the reception of data from the serial port, placing received bytes into a circular buffer
- *  for later transmission to the host.
- */
-ISR(USART1_RX_vect, ISR_BLOCK)
-{
-	if(mode == 0){
-		uint8_t ReceivedByte = UDR1;
-
-		if ((USB_DeviceState == DEVICE_STATE_Configured) && !(RingBuffer_IsFull(&USARTtoUSB_Buffer)))
-		  RingBuffer_Insert(&USARTtoUSB_Buffer, ReceivedByte);
-	} else if (mode == 1){
-		// Device must be connected and configured for the task to run
-	if (USB_DeviceState != DEVICE_STATE_Configured) return;
+	/* Nothing left to send or the target is not ready (CTS deasserted), disarm until the main loop queues more
+	 * data or sees CTS asserted again */
+	if (!(TargetReady) || USBtoUSART_Buffer_IsEmpty())
+	  UCSR1B &= ~(1 << UDRIE1);
 
-	const uint8_t extracted = UDR1;
-
-	// Borrowed + Modified from Francois Best's Arduino MIDI Library
-	// https://github.com/FortySevenEffects/arduino_midi_library
-    if (mPendingMessageIndex == 0)
-    {
-        // Start a new pending message
-        mPendingMessage[0] = extracted;
-
-        // Check for running status first
-        if (isChannelMessage(getTypeFromStatusByte(mRunningStatus_RX)))
-        {
-            // Only these types allow Running Status
-
-            // If the status byte is not received, prepend it to the pending message
-            if (extracted < 0x80)
-            {
-                mPendingMessage[0]   = mRunningStatus_RX;
-                mPendingMessage[1]   = extracted;
-                mPendingMessageIndex = 1;
-            }
-            // Else we received another status byte, so the running status does not apply here.
-            // It will be updated upon completion of this message.
-        }
-
-        switch (getTypeFromStatusByte(mPendingMessage[0]))
-        {
-            // 1 byte messages
-            case Start:
-            case Continue:
-            case Stop:
-            case Clock:
-            case ActiveSensing:
-            case SystemReset:
-            case TuneRequest:
-                // Handle the message type directly here.
-            	mCompleteMessage.Event 	 = MIDI_EVENT(0, getTypeFromStatusByte(mPendingMessage[0]));
-                mCompleteMessage.Data1   = mPendingMessage[0];
-                mCompleteMessage.Data2   = 0;
-                mCompleteMessage.Data3   = 0;
-                mPendingMessageValid  	 = true;
-
-                // We still need to reset these
-                mPendingMessageIndex = 0;
-                mPendingMessageExpectedLength = 0;
-
-                return;
-                break;
-
-            // 2 bytes messages
-            case ProgramChange:
-            case AfterTouchChannel:
-            case TimeCodeQuarterFrame:
-            case SongSelect:
-                mPendingMessageExpectedLength = 2;
-                break;
-
-            // 3 bytes messages
-            case NoteOn:
-            case NoteOff:
-            case ControlChange:
-            case PitchBend:
-            case AfterTouchPoly:
-            case SongPosition:
-                mPendingMessageExpectedLength = 3;
-                break;
-
-            case SystemExclusive:
-                break;
-
-            case InvalidType:
-            default:
-                // Something bad happened
-                break;
-        }
-
-        if (mPendingMessageIndex >= (mPendingMessageExpectedLength - 1))
-        {
-            // Reception complete
-            mCompleteMessage.Event = MIDI_EVENT(0, getTypeFromStatusByte(mPendingMessage[0]));
-            mCompleteMessage.Data1 = mPendingMessage[0]; // status = channel + type
- 			mCompleteMessage.Data2 = mPendingMessage[1];
-
-            // Save Data3 only if applicable
-            if (mPendingMessageExpectedLength == 3)
-                mCompleteMessage.Data3 = mPendingMessage[2];
-            else
-                mCompleteMessage.Data3 = 0;
-
-            mPendingMessageIndex = 0;
-            mPendingMessageExpectedLength = 0;
-            mPendingMessageValid = true;
-            return;
-        }
-        else
-        {
-            // Waiting for more data
-            mPendingMessageIndex++;
-        }
-    }
-    else
-    {
-        // First, test if this is a status byte
-        if (extracted >= 0x80)
-        {
-            // Reception of status bytes in the middle of an uncompleted message
-            // are allowed only for interleaved Real Time message or EOX
-            switch (extracted)
-            {
-                case Clock:
-                case Start:
-                case Continue:
-                case Stop:
-                case ActiveSensing:
-                case SystemReset:
-
-                    // Here we will have to extract the one-byte message,
-                    // pass it to the structure for being read outside
-                    // the MIDI class, and recompose the message it was
-                    // interleaved into. Oh, and without killing the running status..
-                    // This is done by leaving the pending message as is,
-                    // it will be completed on next calls.
-           		 	mCompleteMessage.Event = MIDI_EVENT(0, getTypeFromStatusByte(extracted));
-            		mCompleteMessage.Data1 = extracted;
-                    mCompleteMessage.Data2 = 0;
-                    mCompleteMessage.Data3 = 0;
-                   	mPendingMessageValid   = true;
-                    return;
-                    break;
-                default:
-                    break;
-            }
-        }
-
-        // Add extracted data byte to pending message
-        mPendingMessage[mPendingMessageIndex] = extracted;
-
-        // Now we are going to check if we have reached the end of the message
-        if (mPendingMessageIndex >= (mPendingMessageExpectedLength - 1))
-        {
-
-        	mCompleteMessage.Event = MIDI_EVENT(0, getTypeFromStatusByte(mPendingMessage[0]));
-            mCompleteMessage.Data1 = mPendingMessage[0];
-            mCompleteMessage.Data2 = mPendingMessage[1];
-
-            // Save Data3 only if applicable
-            if (mPendingMessageExpectedLength == 3)
-                mCompleteMessage.Data3 = mPendingMessage[2];
-            else
-                mCompleteMessage.Data3 = 0;
-
-            // Reset local variables
-            mPendingMessageIndex = 0;
-            mPendingMessageExpectedLength = 0;
-            mPendingMessageValid = true;
-
-            // Activate running status (if enabled for the received type)
-            switch (getTypeFromStatusByte(mPendingMessage[0]))
-            {
-                case NoteOff:
-                case NoteOn:
-                case AfterTouchPoly:
-                case ControlChange:
-                case ProgramChange:
-                case AfterTouchChannel:
-                case PitchBend:
-                    // Running status enabled: store it from received message
-                    mRunningStatus_RX = mPendingMessage[0];
-                    break;
-
-                default:
-                    // No running status
-                    mRunningStatus_RX = InvalidType;
-                    break;
-            }
-            return;
-        }
-        else
-        {
-            // Not complete? Then update the index of the pending message.
-            mPendingMessageIndex++;
-        }
-    }
-	}
+	PROFILE_END(ISRStart, ProfilingStats.UDREISRMaxCycles);
 }
 
 /** Event handler for the CDC Class driver Line Encoding Changed event.
@@ -580,60 +2229,43 @@ void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCI
 	UCSR1A = 0;
 	UCSR1C = 0;
 
+	/* Use whichever of the normal and double speed modes gets closest to the requested baud rate */
+	BaudRate_Select(F_CPU, CDCInterfaceInfo->State.LineEncoding.BaudRateBPS, &USART_BaudRate);
+
 	/* Set the new baud rate before configuring the USART */
-	UBRR1  = SERIAL_2X_UBBRVAL(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS);
+	UBRR1  = USART_BaudRate.UBRR;
 
-	/* Reconfigure the USART in double speed mode for a wider baud rate range at the expense of accuracy */
+	/* Reconfigure the USART, re-arming the transmit interrupt so that any bytes still queued for the target are
+	 * sent with the new settings */
 	UCSR1C = ConfigMask;
-	UCSR1A = (1 << U2X1);
-	UCSR1B = ((1 << RXCIE1) | (1 << TXEN1) | (1 << RXEN1));
+	UCSR1A = (USART_BaudRate.DoubleSpeed ? (1 << U2X1) : 0);
+	UCSR1B = ((1 << RXCIE1) | (1 << UDRIE1) | (1 << TXEN1) | (1 << RXEN1));
 
 	/* Release the TX line after the USART has been reconfigured */
 	PORTD &= ~(1 << 3);
 }
 
-///////////////////////////////////////////////////////////////////////////////
-// MIDI Utility Functions
-///////////////////////////////////////////////////////////////////////////////
-
-MidiMessageType getStatus(MidiMessageType inType, uint8_t inChannel) 
-{
-    return ((uint8_t)inType | ((inChannel - 1) & 0x0f));
-}
-
-MidiMessageType getTypeFromStatusByte(uint8_t inStatus)
+/** Event handler for the CDC Class driver Host-to-Device Control Line State Changed event, pulsing the target's
+ *  reset line each time the host asserts DTR (driving the line low), as it does when opening the port for an
+ *  upload.
+ *
+ *  \param[in] CDCInterfaceInfo  Pointer to the CDC class interface configuration structure being referenced
+ */
+void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
 {
-    if ((inStatus  < 0x80) ||
-        (inStatus == 0xf4) ||
-        (inStatus == 0xf5) ||
-        (inStatus == 0xf9) ||
-        (inStatus == 0xfD))
-    {
-        // Data bytes and undefined.
-        return InvalidType;
-    }
+	/* MIDI mode has no CDC interface, so a request that reaches here is not meant for it */
+	if (mode == MODE_MIDI)
+	  return;
 
-    if (inStatus < 0xf0)
-    {
-        // Channel message, remove channel nibble.
-        return (inStatus & 0xf0);
-    }
+	bool CurrentDTRState = (CDCInterfaceInfo->State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_DTR);
 
-    return inStatus;
-}
+	if (CurrentDTRState && !(PreviousDTRState))
+	{
+		AVR_RESET_LINE_PORT &= ~AVR_RESET_LINE_MASK;
 
-uint8_t getChannelFromStatusByte(uint8_t inStatus)
-{
-	return (inStatus & 0x0f) + 1;
-}
+		TargetResetRemaining = TARGET_RESET_PULSE_MS;
+		FlushBuffersPending  = true;
+	}
 
-bool isChannelMessage(uint8_t inType)
-{
-    return (inType == NoteOff           ||
-            inType == NoteOn            ||
-            inType == ControlChange     ||
-            inType == AfterTouchPoly    ||
-            inType == AfterTouchChannel ||
-            inType == PitchBend         ||
-            inType == ProgramChange);
+	PreviousDTRState = CurrentDTRState;
 }
@@ -41,13 +41,18 @@
 		#include <avr/wdt.h>
 		#include <avr/interrupt.h>
 		#include <avr/power.h>
+		#include <avr/eeprom.h>
+		#include <util/atomic.h>
 		#include <stdbool.h>
 
 		#include "Descriptors.h"
+		#include "Lib/MIDIEventFIFO.h"
+		#include "Lib/MIDIParser.h"
+		#include "Lib/LightweightRingBuff.h"
+		#include "Lib/BaudRate.h"
 
 		#include <LUFA/Drivers/Board/LEDs.h>
 		#include <LUFA/Drivers/Peripheral/Serial.h>
-		#include <LUFA/Drivers/Misc/RingBuffer.h>
 		#include <LUFA/Drivers/USB/USB.h>
 		#include <LUFA/Platform/Platform.h>
 
@@ -64,48 +69,363 @@
 		/** LED mask for the library LED driver, to indicate that an error has occurred in the USB interface. */
 		#define LEDMASK_USB_ERROR        (LEDS_LED1 | LEDS_LED3)
 
+		/** LED mask for the library LED driver, to indicate that data is being sent to the host. */
+		#define LEDMASK_TX               LEDS_LED2
+
+		/** LED mask for the library LED driver, to indicate that data is being received from the host. */
+		#define LEDMASK_RX               LEDS_LED1
+
+		/** Mask of the PORTB pin read as the mode jumper, which forces serial mode when pulled low. */
+		#define MODE_JUMPER_MASK         (1 << 2)
+
+		/** Device mode used until the host chooses one with \ref VENDOR_REQ_SetDeviceMode. */
+		#if defined(ENABLE_COMPOSITE_MODE)
+			#define DEFAULT_DEVICE_MODE  MODE_Composite
+		#else
+			#define DEFAULT_DEVICE_MODE  MODE_MIDI
+		#endif
+
+		/** Time in milliseconds the device waits before detaching from the bus on a mode change, and then stays
+		 *  detached so that the host notices it has gone.
+		 */
+		#define MODE_SWITCH_DETACH_MS    50
+
+		#if ((defined(__AVR_ATmega8U2__) || defined(__AVR_ATmega16U2__) || defined(__AVR_AT90USB82__) ||  \
+		      defined(__AVR_AT90USB162__)) &&                                                             \
+		     (defined(ENABLE_MIDI_LATENCY_STATS) || defined(ENABLE_MIDI_CLOCK_STATS) ||                   \
+		      defined(ENABLE_MIDI_SOFT_THRU) || defined(ENABLE_PROFILING)))
+			/** Size of the USART buffers on parts with only 512 bytes of RAM when the optional features taking RAM
+			 *  are enabled, which must leave room for the stack of the USB interrupt and the USART interrupts nested
+			 *  within it.
+			 */
+			#define USART_BUFFER_DEFAULT_SIZE  64
+		#else
+			#define USART_BUFFER_DEFAULT_SIZE  128
+		#endif
+
+		#if !defined(USBTOUSART_BUFFER_SIZE)
+			/** Size in bytes of the buffer holding data from the host until the USART has sent it. */
+			#define USBTOUSART_BUFFER_SIZE   USART_BUFFER_DEFAULT_SIZE
+		#endif
+
+		#if !defined(USARTTOUSB_BUFFER_SIZE)
+			/** Size in bytes of the buffer holding data received by the USART until it is sent to the host. */
+			#define USARTTOUSB_BUFFER_SIZE   USART_BUFFER_DEFAULT_SIZE
+		#endif
+
+		/** Time in milliseconds the target's reset line is held low when the host asserts DTR. */
+		#define TARGET_RESET_PULSE_MS    5
+
+		/** Number of bytes waiting in the USART receive buffer above which the pending IN packet is sent to the
+		 *  host straight away, without waiting for the latency timer to expire.
+		 */
+		#define BUFFER_NEARLY_FULL       ((USARTTOUSB_BUFFER_SIZE * 3) / 4)
+
+		/** Escape byte framing the MIDI messages within the serial data on the shared USART in composite mode.
+		 *  It is followed by a length byte, with zero standing for a literal escape byte of serial data. The
+		 *  value is an undefined MIDI status byte, so never appears within MIDI traffic.
+		 */
+		#define COMPOSITE_FRAME_ESCAPE   0xFD
+
+		#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+			/** Number of bytes waiting in the USART receive buffer at or above which RTS is deasserted, asking the
+			 *  target to stop sending. The rest of the buffer takes the bytes the target sends before it reacts.
+			 */
+			#define RTS_HIGH_WATERMARK       BUFFER_NEARLY_FULL
+
+			/** Number of bytes waiting in the USART receive buffer at or below which RTS is asserted again. */
+			#define RTS_LOW_WATERMARK        (USARTTOUSB_BUFFER_SIZE / 4)
+
+			/** Number of bytes waiting in the USART transmit buffer at or above which no more data is taken
+			 *  from the host. A whole OUT bank then always fits when the buffer is below it.
+			 */
+			#define USBTOUSART_HIGH_WATERMARK (USBTOUSART_BUFFER_SIZE - CDC_TXRX_EPSIZE)
+
+			/** Number of bytes waiting in the USART transmit buffer at or below which data is taken from the
+			 *  host again.
+			 */
+			#define USBTOUSART_LOW_WATERMARK  (USBTOUSART_BUFFER_SIZE / 4)
+		#endif
+
+		/** Number of Timer 0 counts in each millisecond tick, which are also the 4us units of the MIDI latency
+		 *  timestamps.
+		 */
+		#define TIMESTAMP_TICKS_PER_MS   (F_CPU / 64 / 1000)
+
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+			/** Number of buckets in each MIDI latency histogram. */
+			#define MIDI_LATENCY_BUCKETS       8
+
+			/** Upper bound of the first MIDI latency histogram bucket in timestamp ticks (256us). Each further
+			 *  bucket ends at twice the latency of the one before, and the last one has no upper bound.
+			 */
+			#define MIDI_LATENCY_FIRST_BUCKET  64
+
+			/** Number of messages queued for the Arduino whose latency can be tracked at once, a power of two.
+			 *  Messages queued while all are in use are not timed.
+			 */
+			#define MIDI_LATENCY_TX_STAMPS     8
+		#endif
+
+		#if defined(ENABLE_MIDI_CLOCK_STATS)
+			/** Longest interval between two MIDI clocks in milliseconds (10 BPM) still taken as part of a running
+			 *  clock. A longer gap restarts the measurement.
+			 */
+			#define MIDI_CLOCK_MAX_INTERVAL_MS 250
+
+			/** Weight of each new interval in the averaged clock interval and jitter, as a power of two divisor. */
+			#define MIDI_CLOCK_AVERAGE_SHIFT   4
+		#endif
+
+		#if defined(ENABLE_MIDI_CLOCK_PLL)
+			/** Number of clock intervals in a row which must be measured before the PLL locks onto the clock. */
+			#define MIDI_CLOCK_LOCK_INTERVALS  4
+
+			/** Number of clocks the PLL may regenerate ahead of the received ones before it unlocks, which
+			 *  happens when the clock source stops or jumps to a much slower tempo.
+			 */
+			#define MIDI_CLOCK_HOLDOVER        1
+
+			/** Share of each measured phase error corrected on the next regenerated clock, as a power of two
+			 *  divisor.
+			 */
+			#define MIDI_CLOCK_PHASE_SHIFT     2
+		#endif
+
+		/** Maximum number of USB-MIDI event packets that fit into a single MIDI IN endpoint bank. */
+		#define MIDI_EVENTS_PER_PACKET   (MIDI_STREAM_EPSIZE / sizeof(MIDI_EventPacket_t))
+
+		#if defined(ENABLE_PROFILING)
+			/** Starts timing a profiled section of code, keeping the current cycle count in a new local variable. */
+			#define PROFILE_START(Start)     const uint16_t Start = Profile_ReadCycles()
+
+			/** Ends timing a profiled section of code, recording its length in CPU cycles into \c Max if it is the
+			 *  longest seen so far.
+			 */
+			#define PROFILE_END(Start, Max)  Profile_RecordCycles((uint16_t)(Profile_ReadCycles() - (Start)), &(Max))
+		#else
+			#define PROFILE_START(Start)
+			#define PROFILE_END(Start, Max)  do { } while (0)
+		#endif
+
+	/* Preprocessor Checks: */
+		#if (!RINGBUFF_SIZE_VALID(USBTOUSART_BUFFER_SIZE) || !RINGBUFF_SIZE_VALID(USARTTOUSB_BUFFER_SIZE))
+			#error The USART buffer sizes must be powers of two between 2 and 128.
+		#endif
+
+		#if (BUFFER_NEARLY_FULL >= USARTTOUSB_BUFFER_SIZE)
+			#error BUFFER_NEARLY_FULL must be less than USARTTOUSB_BUFFER_SIZE.
+		#endif
+
+		#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+			#if (!defined(AVR_RTS_LINE_PORT) || !defined(AVR_CTS_LINE_PIN))
+				#error ENABLE_HARDWARE_FLOW_CONTROL needs the AVR_RTS_LINE_* and AVR_CTS_LINE_* pins defined in the makefile.
+			#endif
+
+			#if ((RTS_LOW_WATERMARK >= RTS_HIGH_WATERMARK) || (USBTOUSART_LOW_WATERMARK >= USBTOUSART_HIGH_WATERMARK))
+				#error The low flow control watermarks must be below the high ones.
+			#endif
+		#endif
+
+		#if defined(ENABLE_MIDI_CLOCK_PLL)
+			#if !defined(ENABLE_MIDI_CLOCK_STATS)
+				#error ENABLE_MIDI_CLOCK_PLL needs the MIDI clock measurement, which must be enabled with ENABLE_MIDI_CLOCK_STATS.
+			#endif
+
+			#if defined(ENABLE_PROFILING)
+				#error ENABLE_MIDI_CLOCK_PLL and ENABLE_PROFILING both need Timer 1, and cannot be used together.
+			#endif
+		#endif
+
+	/* Enums: */
+		/** Enum for the vendor specific control requests understood by the device. All of them are addressed
+		 *  to the device as a whole, and use the request codes of the equivalent FTDI requests where one exists.
+		 */
+		enum VendorRequests_t
+		{
+			VENDOR_REQ_SetLatencyTimer = 0x09, /**< Sets the serial mode latency timer to wValue milliseconds */
+			VENDOR_REQ_GetLatencyTimer = 0x0A, /**< Returns the serial mode latency timer as a single byte */
+			VENDOR_REQ_GetMIDIPackingStats = 0x40, /**< Returns the MIDI IN packing statistics as a \ref MIDI_PackingStats_t */
+			VENDOR_REQ_GetMIDIOverflows    = 0x41, /**< Returns the number of received MIDI events dropped on a full FIFO */
+			VENDOR_REQ_SetMIDIRunningStatus = 0x42, /**< Enables (wValue non-zero) or disables running status towards the Arduino */
+			VENDOR_REQ_GetProfilingStats    = 0x43, /**< Returns and clears the \ref ProfilingStats_t, when built with ENABLE_PROFILING */
+			VENDOR_REQ_GetDeviceStats       = 0x44, /**< Returns the traffic and error counters as a \ref DeviceStats_t */
+			VENDOR_REQ_ClearDeviceStats     = 0x45, /**< Clears the traffic and error counters */
+			VENDOR_REQ_SetDeviceMode        = 0x46, /**< Stores wValue as the device mode and re-enumerates in it */
+			VENDOR_REQ_GetDeviceMode        = 0x47, /**< Returns the current and the host chosen device modes, a byte each */
+			VENDOR_REQ_GetBaudRate          = 0x48, /**< Returns the USART baud rate setting as a \ref BaudRate_Setting_t */
+			VENDOR_REQ_GetMIDILatency       = 0x49, /**< Returns the MIDI latency histograms as a \ref MIDI_LatencyStats_t */
+			VENDOR_REQ_SetMIDISoftThru      = 0x4A, /**< Enables (wValue non-zero) or disables the MIDI soft-thru, when built with ENABLE_MIDI_SOFT_THRU */
+			VENDOR_REQ_GetMIDIClockStats    = 0x4B, /**< Returns the received MIDI clock measurements as a \ref MIDI_ClockStats_t */
+			VENDOR_REQ_SetMIDIClockMode     = 0x4C, /**< Sets the MIDI clock PLL to the \ref MIDI_ClockModes_t mask in wValue, when built with ENABLE_MIDI_CLOCK_PLL */
+		};
+
+		/** Enum for the flags making up the MIDI clock PLL mode, set with \ref VENDOR_REQ_SetMIDIClockMode. */
+		enum MIDI_ClockModes_t
+		{
+			MIDI_CLOCK_MODE_Off        = 0, /**< Received clocks are passed on as they come */
+			MIDI_CLOCK_MODE_Regenerate = (1 << 0), /**< Received clocks are replaced by steady ones from the PLL once it has locked */
+			MIDI_CLOCK_MODE_ToSerial   = (1 << 1), /**< The regenerated clocks are also sent to the serial port, in MIDI mode */
+		};
+
+		/** Enum for the sources of the MIDI messages merged into the USART transmit stream. */
+		enum MIDI_TxSources_t
+		{
+			MIDI_TX_SOURCE_None = 0, /**< No source, when no System Exclusive message is in progress */
+			MIDI_TX_SOURCE_Host = 1, /**< Messages sent by the host to the MIDI OUT endpoint */
+			MIDI_TX_SOURCE_Thru = 2, /**< Messages received from the serial port, echoed back by the soft-thru */
+		};
+
+	/* Type Defines: */
+		/** Type define for the MIDI IN packing statistics, returned by \ref VENDOR_REQ_GetMIDIPackingStats. The
+		 *  average number of events carried by each USB packet is given by \c Events / \c Packets.
+		 */
+		typedef struct
+		{
+			uint32_t Events; /**< Total number of USB-MIDI event packets sent to the host */
+			uint32_t Packets; /**< Total number of IN endpoint packets used to send them */
+		} MIDI_PackingStats_t;
+
+		/** Type define for the worst case timings recorded when built with ENABLE_PROFILING, returned by
+		 *  \ref VENDOR_REQ_GetProfilingStats. Times are in CPU cycles, and so wrap past 65535 cycles (4ms at 16MHz).
+		 */
+		typedef struct
+		{
+			uint16_t RXISRMaxCycles; /**< Longest run of the USART receive ISR body */
+			uint16_t UDREISRMaxCycles; /**< Longest run of the USART data register empty ISR body */
+			uint16_t LoopMaxCycles; /**< Longest main loop iteration, including any interrupts it was held up by */
+		} ProfilingStats_t;
+
+		/** Type define for the traffic and error counters kept in every mode, returned by
+		 *  \ref VENDOR_REQ_GetDeviceStats. Byte counts are of the USB data stream, so in MIDI mode each event
+		 *  counts as four bytes. Dividing them by the matching packet count gives the average packet fill.
+		 */
+		typedef struct
+		{
+			uint32_t BytesToHost; /**< Bytes sent to the host through the data IN endpoint */
+			uint32_t BytesFromHost; /**< Bytes received from the host through the data OUT endpoint */
+			uint32_t INPackets; /**< Data IN packets sent to the host */
+			uint32_t OUTPackets; /**< Data OUT packets received from the host */
+			uint16_t OverrunErrors; /**< Bytes lost because the USART receiver overran */
+			uint16_t FramingErrors; /**< Bytes received with a bad stop bit */
+			uint16_t ParityErrors; /**< Bytes received with a bad parity bit */
+			uint16_t DroppedBytes; /**< Bytes received from the serial port while not configured or with no room left */
+			uint16_t DroppedMIDIEvents; /**< MIDI events dropped because the event FIFO was full */
+			uint8_t  USARTtoUSBHighWater; /**< Most bytes ever waiting in the USART to USB buffer */
+			uint8_t  USBtoUSARTHighWater; /**< Most bytes ever waiting in the USB to USART buffer */
+		} DeviceStats_t;
+
+		#if defined(ENABLE_MIDI_LATENCY_STATS)
+			/** Type define for a MIDI latency timestamp. The millisecond count lets latencies longer than the
+			 *  262ms wrap of a 16-bit count of 4us ticks be told apart from short ones.
+			 */
+			typedef struct
+			{
+				uint16_t MS; /**< Millisecond tick count */
+				uint8_t  Ticks; /**< Timer 0 count within the millisecond, in 4us ticks */
+			} MIDI_Timestamp_t;
+
+			/** Type define for the MIDI latency histograms, returned by \ref VENDOR_REQ_GetMIDILatency. Each counts
+			 *  the events whose latency fell into each bucket, see \ref MIDI_LATENCY_FIRST_BUCKET, and stops at
+			 *  65535. Towards the host, latency runs from the reception of an event's last byte by the USART to
+			 *  the hand-off of its IN packet to the USB controller. Towards the Arduino, it runs from the OUT packet
+			 *  holding an event being seen to the message's last byte being loaded into the USART. Latencies too
+			 *  long to count in 16 bits of 4us ticks are counted in the last bucket.
+			 */
+			typedef struct
+			{
+				uint16_t ToHost[MIDI_LATENCY_BUCKETS]; /**< Histogram of the latencies of events sent to the host */
+				uint16_t ToArduino[MIDI_LATENCY_BUCKETS]; /**< Histogram of the latencies of messages sent to the Arduino */
+			} MIDI_LatencyStats_t;
+		#endif
+
+		#if defined(ENABLE_MIDI_CLOCK_STATS)
+			/** Type define for the measurements of the MIDI clock received from the serial port, returned by
+			 *  \ref VENDOR_REQ_GetMIDIClockStats. Intervals are in 4us timestamp ticks, and are only measured between
+			 *  clocks less than \ref MIDI_CLOCK_MAX_INTERVAL_MS apart.
+			 */
+			typedef struct
+			{
+				uint16_t Tempo; /**< Tempo given by the average interval at 24 clocks per quarter note, in 0.01 BPM, zero if unknown */
+				uint16_t Interval; /**< Average interval between clocks */
+				uint16_t Jitter; /**< Average deviation of each interval from the average interval */
+				uint16_t MinInterval; /**< Shortest interval measured */
+				uint16_t MaxInterval; /**< Longest interval measured */
+				uint16_t Intervals; /**< Number of intervals measured, saturating at 65535 */
+				uint8_t  Locked; /**< Non-zero while the clock PLL is locked and regenerating the clocks */
+			} MIDI_ClockStats_t;
+		#endif
+
+	/* Inline Functions: */
+		#if defined(ENABLE_PROFILING)
+			/** Reads the free running Timer 1 cycle counter. The 16-bit read is made atomic, as an ISR reading the
+			 *  timer in between the two halves would corrupt the shared high byte latch.
+			 *
+			 *  \return Current Timer 1 count, in CPU cycles
+			 */
+			static inline uint16_t Profile_ReadCycles(void)
+			{
+				uint16_t Cycles;
+
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					Cycles = TCNT1;
+				}
+
+				return Cycles;
+			}
+
+			/** Records the length of a profiled section of code if it is the longest seen so far.
+			 *
+			 *  \param[in]     Cycles  Length of the profiled section, in CPU cycles
+			 *  \param[in,out] Max     Longest length recorded so far
+			 */
+			static inline void Profile_RecordCycles(const uint16_t Cycles,
+			                                        uint16_t* const Max)
+			{
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+				{
+					if (Cycles > *Max)
+					  *Max = Cycles;
+				}
+			}
+		#endif
+
 	/* Function Prototypes: */
 		void SetupHardware(void);
 
+		#if defined(INCLUDE_FROM_USBTOSERIAL_C)
+			static bool Mode_IsValid(const uint16_t Mode);
+			static void Mode_Setup(void);
+			static void Mode_Change(const uint8_t NewMode);
+			static void LEDs_SetStatus(const uint8_t LEDMask);
+			static void SerialState_Task(void);
+			static void Serial_FlushBuffers(void);
+
+			static void MIDI_QueueMessage(const MIDI_EventPacket_t* const MIDIEvent,
+			                              const uint8_t Source);
+
+			#if defined(ENABLE_HARDWARE_FLOW_CONTROL)
+				static void FlowControl_Task(void);
+			#endif
+
+			#if defined(ENABLE_MIDI_SOFT_THRU)
+				static void MIDI_SoftThru_Task(void);
+			#endif
+
+			#if defined(ENABLE_MIDI_CLOCK_PLL)
+				static void MIDIClock_StopPLL(void);
+				static void MIDIClock_Send(void);
+			#endif
+		#endif
+
+		void Serial_To_Arduino(void);
+		void Serial_To_Host(void);
+		void Vendor_ProcessControlRequest(void);
+
 		void MIDI_To_Arduino(void);
 		void MIDI_To_Host(void);
 	
-		typedef enum
-		{
-			InvalidType           = 0x00,    ///< For notifying errors
-			NoteOff               = 0x80,    ///< Note Off
-			NoteOn                = 0x90,    ///< Note On
-			AfterTouchPoly        = 0xA0,    ///< Polyphonic AfterTouch
-			ControlChange         = 0xB0,    ///< Control Change / Channel Mode
-			ProgramChange         = 0xC0,    ///< Program Change
-			AfterTouchChannel     = 0xD0,    ///< Channel (monophonic) AfterTouch
-			PitchBend             = 0xE0,    ///< Pitch Bend
-			SystemExclusive       = 0xF0,    ///< System Exclusive
-			TimeCodeQuarterFrame  = 0xF1,    ///< System Common - MIDI Time Code Quarter Frame
-			SongPosition          = 0xF2,    ///< System Common - Song Position Pointer
-			SongSelect            = 0xF3,    ///< System Common - Song Select
-			TuneRequest           = 0xF6,    ///< System Common - Tune Request
-			Clock                 = 0xF8,    ///< System Real Time - Timing Clock
-			Start                 = 0xFA,    ///< System Real Time - Start
-			Continue              = 0xFB,    ///< System Real Time - Continue
-			Stop                  = 0xFC,    ///< System Real Time - Stop
-			ActiveSensing         = 0xFE,    ///< System Real Time - Active Sensing
-			SystemReset           = 0xFF,    ///< System Real Time - System Reset
-		} MidiMessageType;
-
-		uint8_t		mRunningStatus_RX;
-		uint8_t		mRunningStatus_TX;
-		uint8_t		mPendingMessage[3];
-		uint8_t		mPendingMessageExpectedLength;
-		uint8_t		mPendingMessageIndex;
-		bool		mPendingMessageValid;
-		
-		MIDI_EventPacket_t mCompleteMessage;
-
-		MidiMessageType getStatus(MidiMessageType inType, uint8_t inChannel);
-		MidiMessageType getTypeFromStatusByte(uint8_t inStatus);
-		uint8_t getChannelFromStatusByte(uint8_t inStatus);
-		bool isChannelMessage(uint8_t inType);
 		
 		void EVENT_USB_Device_Connect(void);
 		void EVENT_USB_Device_Disconnect(void);
@@ -113,6 +433,7 @@
 		void EVENT_USB_Device_ControlRequest(void);
 
 		void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+		void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
 
 #endif
 